@@ -0,0 +1,79 @@
+# Allocation-heavy benchmark: system malloc vs the per-VM arena allocator.
+#
+# Each configuration runs in its own child process, so that the resident set
+# size reported for one configuration is not affected by the others.
+#
+# Usage: perl -Mblib bench/alloc.pl [iterations]
+use strict;
+use warnings;
+
+use Time::HiRes qw(time);
+use JavaScript::Duktape::XS;
+
+my $CLASS = 'JavaScript::Duktape::XS';
+my $PAGE_SIZE = 4096;
+
+exit main();
+
+sub main {
+    my $iterations = shift @ARGV || 20;
+
+    printf("%-8s %-6s %12s %12s %14s\n", 'config', 'script', 'seconds', 'ops/sec', 'rss_delta_kb');
+    foreach my $script (sort keys %{ scripts() }) {
+        foreach my $arena (0, 1) {
+            run_child($script, $arena, $iterations);
+        }
+    }
+    return 0;
+}
+
+sub scripts {
+    return {
+        objects => <<'JS',
+var list = [];
+for (var j = 0; j < 20000; ++j) {
+    list.push({ id: j, name: 'n' + j, pair: [ j, j + 1 ] });
+    if (list.length > 5000) { list = list.slice(2500); }
+}
+JS
+        strings => <<'JS',
+var parts = [];
+for (var j = 0; j < 30000; ++j) {
+    parts.push(('k' + j).toUpperCase() + ':' + (j * 7));
+    if (parts.length > 1000) { parts = [ parts.join(',').length ]; }
+}
+JS
+    };
+}
+
+sub resident_kb {
+    open my $fh, '<', '/proc/self/statm' or return 0;
+    my ($size, $resident) = split ' ', scalar <$fh>;
+    return $resident * $PAGE_SIZE / 1024;
+}
+
+sub run_child {
+    my ($script, $arena, $iterations) = @_;
+
+    my $pid = fork();
+    die "Could not fork: $!" unless defined $pid;
+    if ($pid) {
+        waitpid($pid, 0);
+        return;
+    }
+
+    my $js = scripts()->{$script};
+    my $vm = $CLASS->new({ arena_allocator => $arena });
+    my $rss0 = resident_kb();
+    my $t0 = time();
+    for (1..$iterations) {
+        $vm->eval($js);
+        $vm->run_gc();
+    }
+    my $elapsed = time() - $t0;
+    my $rss1 = resident_kb();
+    printf("%-8s %-6s %12.3f %12.1f %14d\n",
+           $arena ? 'arena' : 'malloc', $script, $elapsed,
+           $iterations / $elapsed, $rss1 - $rss0);
+    exit(0);
+}
@@ -0,0 +1,44 @@
+# VM teardown benchmark: per-object frees vs bulk arena release.
+#
+# Builds a heap with lots of small objects, then times reset() (which tears
+# down the heap and creates a fresh one) for each allocator configuration.
+#
+# Usage: perl -Mblib bench/teardown.pl [objects]
+use strict;
+use warnings;
+
+use Time::HiRes qw(time);
+use JavaScript::Duktape::XS;
+
+my $CLASS = 'JavaScript::Duktape::XS';
+
+exit main();
+
+sub main {
+    my $objects = shift @ARGV || 500_000;
+
+    my %configs = (
+        malloc        => {},
+        arena         => { arena_allocator => 1 },
+        arena_madvise => { arena_allocator => 1, arena_madvise => 1 },
+    );
+
+    my $js = <<JS;
+var rows = [];
+for (var j = 0; j < $objects; ++j) {
+    rows.push({ id: j, label: 'row ' + j, cells: [ j, j * 2 ] });
+}
+JS
+
+    printf("%-14s %12s %12s\n", 'config', 'build_s', 'teardown_s');
+    foreach my $name (sort keys %configs) {
+        my $vm = $CLASS->new($configs{$name});
+        my $t0 = time();
+        $vm->eval($js);
+        my $t1 = time();
+        $vm->reset();
+        my $t2 = time();
+        printf("%-14s %12.3f %12.3f\n", $name, $t1 - $t0, $t2 - $t1);
+    }
+    return 0;
+}
@@ -0,0 +1,42 @@
+# Execution timeout benchmark: cost of the periodic timeout check.
+#
+# Runs a tight loop with no timeout, with a timeout checked against the clock,
+# and with a timeout flagged by the watchdog thread.
+#
+# Usage: perl -Mblib bench/timeout.pl [iterations]
+use strict;
+use warnings;
+
+use Time::HiRes qw(time);
+use JavaScript::Duktape::XS;
+
+my $CLASS = 'JavaScript::Duktape::XS';
+
+exit main();
+
+sub main {
+    my $iterations = shift @ARGV || 50_000_000;
+
+    my %configs = (
+        none     => {},
+        clock    => { max_timeout_us => 60_000_000 },
+        watchdog => { max_timeout_us => 60_000_000, timeout_watchdog => 1 },
+    );
+
+    my $js = <<JS;
+var total = 0;
+for (var j = 0; j < $iterations; ++j) {
+    total += j & 7;
+}
+JS
+
+    printf("%-10s %12s\n", 'config', 'elapsed_s');
+    foreach my $name (sort keys %configs) {
+        my $vm = $CLASS->new($configs{$name});
+        my $t0 = time();
+        $vm->eval($js);
+        my $t1 = time();
+        printf("%-10s %12.3f\n", $name, $t1 - $t0);
+    }
+    return 0;
+}
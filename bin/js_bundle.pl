@@ -0,0 +1,89 @@
+# script to pack a tree of JS modules into a bundle for the module_bundle option
+use strict;
+use warnings;
+
+use File::Find;
+use File::Spec;
+use Getopt::Long;
+
+use constant BUNDLE_MAGIC => 'PLDUKBN1';
+use constant HEADER_SIZE  => 16;
+use constant ENTRY_SIZE   => 24;
+
+exit main();
+
+sub main {
+    my $output;
+    my $bytecode = 0;
+    GetOptions('output=s' => \$output, 'bytecode' => \$bytecode)
+        && $output && @ARGV
+        or die "usage: $0 [--bytecode] --output FILE DIR...\n";
+
+    my %modules;
+    foreach my $dir (@ARGV) {
+        collect($dir, \%modules);
+    }
+
+    # precompiling needs the same Duktape that will later load the bundle
+    my $vm;
+    if ($bytecode) {
+        require JavaScript::Duktape::XS;
+        $vm = JavaScript::Duktape::XS->new();
+    }
+    write_bundle($output, \%modules, $vm);
+    return 0;
+}
+
+sub collect {
+    my ($dir, $modules) = @_;
+
+    my $wanted = sub {
+        return unless -f $_ && m{\.(?:js|json)\z};
+        my $id = File::Spec->abs2rel($_, $dir);
+        $id =~ s{\\}{/}g;
+        if (exists $modules->{$id}) {
+            warn "Skipping $_, already have a module $id\n";
+            return;
+        }
+        $modules->{$id} = read_source($_);
+    };
+    find({ wanted => $wanted, no_chdir => 1 }, $dir);
+}
+
+sub read_source {
+    my ($file) = @_;
+
+    open my $fh, '<:raw', $file or die "Could not open $file: $!";
+    my $source = do { local $/; <$fh> };
+    close $fh;
+    $source = "module.exports = $source;" if $file =~ m{\.json\z};
+    return $source;
+}
+
+sub write_bundle {
+    my ($output, $modules, $vm) = @_;
+
+    # the index is sorted by id, so modules can be found with a binary search
+    my @ids = sort keys %$modules;
+    my $base = HEADER_SIZE + ENTRY_SIZE * @ids;
+    my $index = '';
+    my $data = '';
+    foreach my $id (@ids) {
+        my $source = $modules->{$id};
+        my $code = $vm ? $vm->compile_module($id, $source) : '';
+        my @fields;
+        foreach my $chunk ($id, $source, $code) {
+            $data .= "\0" x ((8 - length($data) % 8) % 8);  # keep code aligned
+            push @fields, $base + length($data), length($chunk);
+            $data .= $chunk;
+        }
+        $index .= pack('L6', @fields);
+    }
+    die "Bundle too large\n" if $base + length($data) > 0xffffffff;
+
+    my $tmp = "$output.$$.tmp";
+    open my $fh, '>:raw', $tmp or die "Could not create $tmp: $!";
+    print $fh BUNDLE_MAGIC, pack('L2', scalar @ids, 0), $index, $data;
+    close $fh or die "Could not write $tmp: $!";
+    rename $tmp, $output or die "Could not rename $tmp to $output: $!";
+}
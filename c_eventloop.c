@@ -1,6 +1,11 @@
 /*
  *  Timer insertion is an O(n) operation; in a real world eventloop based on a
  *  heap insertion would be O(log N).
+ *
+ *  Jobs (microtasks, as queued by queueMicrotask() and Promise reactions) are
+ *  kept in a FIFO and are always drained to completion before any timer is
+ *  considered, and again after each timer callback.  Queueing a job is O(1)
+ *  and never goes through the sorted timer list or poll().
  */
 #include <stdio.h>
 #include <poll.h>
@@ -14,11 +19,15 @@
 #endif
 
 #define  TIMERS_SLOT_NAME       "eventTimers"
+#define  JOBS_SLOT_NAME         "eventJobs"
+#define  STATE_SLOT_NAME        "eventState"
+#define  TIMER_LIST_SLOT_NAME   "eventTimerList"
 #define  MIN_DELAY              1.0
 #define  MIN_WAIT               1.0
 #define  MAX_WAIT               60000.0
 #define  MAX_EXPIRIES           10
 #define  MAX_TIMERS             4096     /* this is quite excessive for embedded use, but good for testing */
+#define  MIN_TIMERS             16
 
 typedef struct {
     int64_t id;       /* numeric ID (returned from e.g. setTimeout); zero if unused */
@@ -33,31 +42,88 @@ typedef struct {
      */
 } ev_timer;
 
-/* Active timers.  Dense list, terminates to end of list or first unused timer.
- * The list is sorted by 'target', with lowest 'target' (earliest expiry) last
- * in the list.  When a timer's callback is being called, the timer is moved
- * to 'timer_expiring' as it needs special handling should the user callback
- * delete that particular timer.
+/* The event loop state for each heap is kept in a fixed buffer in the
+ * "global stash", in <stash>.eventState, so that each heap has its own
+ * timers and jobs.  Duktape never moves a buffer, so a pointer to the state
+ * stays valid as long as the heap lives.
  */
-static ev_timer timer_list[MAX_TIMERS];
-static ev_timer timer_expiring;
-static int timer_count;  /* last timer at timer_count - 1 */
-static int64_t timer_next_id = 1;
+typedef struct {
+    /* Active timers.  Dense list, terminates to end of list or first unused
+     * timer.  The list is sorted by 'target', with lowest 'target' (earliest
+     * expiry) last in the list.  When a timer's callback is being called, the
+     * timer is moved to 'timer_expiring' as it needs special handling should
+     * the user callback delete that particular timer.
+     *
+     * The list itself is a dynamic buffer in <stash>.eventTimerList, grown
+     * as needed up to MAX_TIMERS; it moves when it grows, so never keep a
+     * pointer into it across a call that can create a timer.
+     */
+    ev_timer *timer_list;
+    int timer_max;    /* room in timer_list */
+    ev_timer timer_expiring;
+    int timer_count;  /* last timer at timer_count - 1 */
+    int64_t timer_next_id;
+
+    /* Pending jobs.  The callbacks are held in the "global stash", in the
+     * array <stash>.eventJobs; 'job_head' is the index of the next job to run
+     * and 'job_tail' the index where the next queued job will be stored.  When
+     * the queue is drained both indexes go back to zero and the array is
+     * truncated.
+     */
+    duk_uarridx_t job_head;
+    duk_uarridx_t job_tail;
+} ev_state;
+
+static ev_state *get_state(duk_context *ctx) {
+    ev_state *state;
+
+    duk_push_global_stash(ctx);
+    duk_get_prop_string(ctx, -1, STATE_SLOT_NAME);
+    state = (ev_state *) duk_require_buffer(ctx, -1, NULL);
+    duk_pop_2(ctx);
+    return state;
+}
+
+/* Make sure there is room for one more timer in the list. */
+static void reserve_timer(duk_context *ctx, ev_state *state) {
+    int timer_max;
+    void *list;
 
-static ev_timer *find_nearest_timer(void) {
+    if (state->timer_count < state->timer_max) {
+        return;
+    }
+    if (state->timer_max >= MAX_TIMERS) {
+        (void) duk_error(ctx, DUK_ERR_RANGE_ERROR, "out of timer slots");
+    }
+    timer_max = state->timer_max ? state->timer_max * 2 : MIN_TIMERS;
+    if (timer_max > MAX_TIMERS) {
+        timer_max = MAX_TIMERS;
+    }
+
+    duk_push_global_stash(ctx);
+    duk_get_prop_string(ctx, -1, TIMER_LIST_SLOT_NAME);
+    list = duk_resize_buffer(ctx, -1, timer_max * sizeof(ev_timer));
+    duk_pop_2(ctx);
+
+    memset((void *) ((ev_timer *) list + state->timer_max), 0, (timer_max - state->timer_max) * sizeof(ev_timer));
+    state->timer_list = (ev_timer *) list;
+    state->timer_max = timer_max;
+}
+
+static ev_timer *find_nearest_timer(ev_state *state) {
     /* Last timer expires first (list is always kept sorted). */
-    if (timer_count <= 0) {
+    if (state->timer_count <= 0) {
         return NULL;
     }
-    return timer_list + timer_count - 1;
+    return state->timer_list + state->timer_count - 1;
 }
 
 /* Bubble last timer on timer list backwards until it has been moved to
  * its proper sorted position (based on 'target' time).
  */
-static void bubble_last_timer(void) {
+static void bubble_last_timer(ev_state *state) {
     int i;
-    int n = timer_count;
+    int n = state->timer_count;
     ev_timer *t;
     ev_timer tmp;
 
@@ -65,7 +131,7 @@ static void bubble_last_timer(void) {
         /* Timer to bubble is at index i, timer to compare to is
          * at i-1 (both guaranteed to exist).
          */
-        t = timer_list + i;
+        t = state->timer_list + i;
         if (t->target <= (t-1)->target) {
             /* 't' expires earlier than (or same time as) 't-1', so we're done. */
             break;
@@ -78,7 +144,45 @@ static void bubble_last_timer(void) {
     }
 }
 
+static void run_jobs(duk_context *ctx) {
+    ev_state *state = get_state(ctx);
+    int rc;
+
+    if (state->job_head >= state->job_tail) {
+        return;
+    }
+
+    duk_push_global_stash(ctx);
+    duk_get_prop_string(ctx, -1, JOBS_SLOT_NAME);
+    /* [ ... stash eventJobs ] */
+
+    /* Jobs queued by a running job are appended at 'job_tail' and will be
+     * picked up by this same loop, so on exit the queue is empty.
+     */
+    while (state->job_head < state->job_tail) {
+        duk_uarridx_t idx = state->job_head++;
+
+#if DUKTAPE_EVENTLOOP_DEBUG > 0
+        fprintf(stderr, "calling job %lu\n", (unsigned long) idx);
+        fflush(stderr);
+#endif
+
+        duk_get_prop_index(ctx, -1, idx);  /* -> [ ... stash eventJobs func ] */
+        duk_push_undefined(ctx);
+        duk_put_prop_index(ctx, -3, idx);  /* release reference to callback */
+        rc = duk_pcall(ctx, 0 /*nargs*/);  /* -> [ ... stash eventJobs retval ] */
+        check_duktape_call_for_errors(rc, ctx);
+        duk_pop(ctx);    /* [ ... stash eventJobs ] */
+    }
+
+    state->job_head = state->job_tail = 0;
+    duk_set_length(ctx, -1, 0);
+
+    duk_pop_2(ctx);  /* -> [ ... ] */
+}
+
 static void expire_timers(duk_context *ctx) {
+    ev_state *state = get_state(ctx);
     ev_timer *t;
     int sanity = MAX_EXPIRIES;
     double now;
@@ -98,10 +202,10 @@ static void expire_timers(duk_context *ctx) {
         /*
          *  Expired timer(s) still exist?
          */
-        if (timer_count <= 0) {
+        if (state->timer_count <= 0) {
             break;
         }
-        t = timer_list + timer_count - 1;
+        t = state->timer_list + state->timer_count - 1;
         if (t->target > now) {
             break;
         }
@@ -110,10 +214,10 @@ static void expire_timers(duk_context *ctx) {
          *  Move the timer to 'expiring' for the duration of the callback.
          *  Mark a one-shot timer deleted, compute a new target for an interval.
          */
-        memcpy((void *) &timer_expiring, (void *) t, sizeof(ev_timer));
+        memcpy((void *) &state->timer_expiring, (void *) t, sizeof(ev_timer));
         memset((void *) t, 0, sizeof(ev_timer));
-        timer_count--;
-        t = &timer_expiring;
+        state->timer_count--;
+        t = &state->timer_expiring;
 
         if (t->oneshot) {
             t->removed = 1;
@@ -139,6 +243,9 @@ static void expire_timers(duk_context *ctx) {
         check_duktape_call_for_errors(rc, ctx);
         duk_pop(ctx);    /* [ ... stash eventTimers ] */
 
+        /* Jobs queued by the callback run before anything else. */
+        run_jobs(ctx);
+
         if (t->removed) {
             /* One-shot timer (always removed) or removed by user callback. */
 #if DUKTAPE_EVENTLOOP_DEBUG > 0
@@ -155,29 +262,33 @@ static void expire_timers(duk_context *ctx) {
             fprintf(stderr, "queueing timer %d back into active list\n", (int) t->id);
             fflush(stderr);
 #endif
-            if (timer_count >= MAX_TIMERS) {
-                (void) duk_error(ctx, DUK_ERR_RANGE_ERROR, "out of timer slots");
-            }
-            memcpy((void *) (timer_list + timer_count), (void *) t, sizeof(ev_timer));
-            timer_count++;
-            bubble_last_timer();
+            reserve_timer(ctx, state);
+            memcpy((void *) (state->timer_list + state->timer_count), (void *) t, sizeof(ev_timer));
+            state->timer_count++;
+            bubble_last_timer(state);
         }
     }
 
-    memset((void *) &timer_expiring, 0, sizeof(ev_timer));
+    memset((void *) &state->timer_expiring, 0, sizeof(ev_timer));
 
     duk_pop_2(ctx);  /* -> [ ... ] */
 }
 
 duk_ret_t eventloop_run(duk_context *ctx, void *udata) {
+    ev_state *state = get_state(ctx);
     ev_timer *t;
+    double target;
     double now;
     double diff;
     int timeout;
     int rc;
 
-    (void) udata;
     for (;;) {
+        /*
+         *  Run all pending jobs.
+         */
+        run_jobs(ctx);
+
         /*
          *  Expire timers.
          */
@@ -188,9 +299,16 @@ duk_ret_t eventloop_run(duk_context *ctx, void *udata) {
          *  the wait is relative).
          */
         now = now_us() / 1000.0;
-        t = find_nearest_timer();
+        t = find_nearest_timer(state);
         if (t) {
-            diff = t->target - now;
+            target = t->target;  /* the idle callback might move the timer list */
+            diff = target - now;
+            if (diff >= MIN_WAIT) {
+                /* give the embedder a chance to use the idle time */
+                eventloop_idle(ctx, udata, (int) (diff > MAX_WAIT ? MAX_WAIT : diff));
+                now = now_us() / 1000.0;
+                diff = target - now;
+            }
             if (diff < MIN_WAIT) {
                 diff = MIN_WAIT;
             } else if (diff > MAX_WAIT) {
@@ -230,6 +348,7 @@ duk_ret_t eventloop_run(duk_context *ctx, void *udata) {
 }
 
 static int create_timer(duk_context *ctx) {
+    ev_state *state = get_state(ctx);
     double delay;
     int oneshot;
     int idx;
@@ -250,12 +369,10 @@ static int create_timer(duk_context *ctx) {
     }
     oneshot = duk_require_boolean(ctx, 2);
 
-    if (timer_count >= MAX_TIMERS) {
-        (void) duk_error(ctx, DUK_ERR_RANGE_ERROR, "out of timer slots");
-    }
-    idx = timer_count++;
-    timer_id = timer_next_id++;
-    t = timer_list + idx;
+    reserve_timer(ctx, state);
+    idx = state->timer_count++;
+    timer_id = state->timer_next_id++;
+    t = state->timer_list + idx;
 
     memset((void *) t, 0, sizeof(ev_timer));
     t->id = timer_id;
@@ -267,7 +384,7 @@ static int create_timer(duk_context *ctx) {
     /* Timer is now at the last position; use swaps to "bubble" it to its
      * correct sorted position.
      */
-    bubble_last_timer();
+    bubble_last_timer(state);
 
     /* Finally, register the callback to the global stash 'eventTimers' object. */
     duk_push_global_stash(ctx);
@@ -286,6 +403,7 @@ static int create_timer(duk_context *ctx) {
 }
 
 static int delete_timer(duk_context *ctx) {
+    ev_state *state = get_state(ctx);
     int i, n;
     int64_t timer_id;
     ev_timer *t;
@@ -307,7 +425,7 @@ static int delete_timer(duk_context *ctx) {
      *  expiry code remove it.
      */
 
-    t = &timer_expiring;
+    t = &state->timer_expiring;
     if (t->id == timer_id) {
         t->removed = 1;
         duk_push_true(ctx);
@@ -318,24 +436,24 @@ static int delete_timer(duk_context *ctx) {
         return 1;
     }
 
-    n = timer_count;
+    n = state->timer_count;
     for (i = 0; i < n; i++) {
-        t = timer_list + i;
+        t = state->timer_list + i;
         if (t->id == timer_id) {
             found = 1;
 
             /* Shift elements downwards to keep the timer list dense
              * (no need if last element).
              */
-            if (i < timer_count - 1) {
-                memmove((void *) t, (void *) (t + 1), (timer_count - i - 1) * sizeof(ev_timer));
+            if (i < state->timer_count - 1) {
+                memmove((void *) t, (void *) (t + 1), (state->timer_count - i - 1) * sizeof(ev_timer));
             }
 
             /* Zero last element for clarity. */
-            memset((void *) (timer_list + n - 1), 0, sizeof(ev_timer));
+            memset((void *) (state->timer_list + n - 1), 0, sizeof(ev_timer));
 
             /* Update timer_count. */
-            timer_count--;
+            state->timer_count--;
 
             /* The C state is now up-to-date, but we still need to delete
              * the timer callback state from the global 'stash'.
@@ -364,15 +482,46 @@ static int delete_timer(duk_context *ctx) {
     return 1;
 }
 
+static int enqueue_job(duk_context *ctx) {
+    ev_state *state = get_state(ctx);
+
+    /* indexes:
+     *   0 = function (callback)
+     */
+    duk_require_function(ctx, 0);
+
+    duk_push_global_stash(ctx);
+    duk_get_prop_string(ctx, -1, JOBS_SLOT_NAME);  /* -> [ func stash eventJobs ] */
+    duk_dup(ctx, 0);
+    duk_put_prop_index(ctx, -2, state->job_tail);  /* eventJobs[job_tail] = callback */
+    state->job_tail++;
+
+#if DUKTAPE_EVENTLOOP_DEBUG > 0
+    fprintf(stderr, "queued job %lu\n", (unsigned long) (state->job_tail - 1));
+    fflush(stderr);
+#endif
+    return 0;
+}
+
 static duk_function_list_entry eventloop_funcs[] = {
     { "createTimer", create_timer, 3 },
     { "deleteTimer", delete_timer, 1 },
+    { "enqueueJob", enqueue_job, 1 },
     { NULL, NULL, 0 }
 };
 
 void eventloop_register(duk_context *ctx) {
-    memset((void *) timer_list, 0, MAX_TIMERS * sizeof(ev_timer));
-    memset((void *) &timer_expiring, 0, sizeof(ev_timer));
+    ev_state *state;
+
+    /* Initialize global stash 'eventState' and 'eventTimerList'. */
+    duk_push_global_stash(ctx);
+    state = (ev_state *) duk_push_fixed_buffer(ctx, sizeof(ev_state));
+    memset((void *) state, 0, sizeof(ev_state));
+    state->timer_next_id = 1;
+    duk_put_prop_string(ctx, -2, STATE_SLOT_NAME);
+    duk_push_dynamic_buffer(ctx, 0);
+    duk_put_prop_string(ctx, -2, TIMER_LIST_SLOT_NAME);
+    duk_pop(ctx);
 
     /* Set global 'EventLoop'. */
     duk_push_global_object(ctx);
@@ -386,4 +535,10 @@ void eventloop_register(duk_context *ctx) {
     duk_push_object(ctx);
     duk_put_prop_string(ctx, -2, TIMERS_SLOT_NAME);
     duk_pop(ctx);
+
+    /* Initialize global stash 'eventJobs'. */
+    duk_push_global_stash(ctx);
+    duk_push_array(ctx);
+    duk_put_prop_string(ctx, -2, JOBS_SLOT_NAME);
+    duk_pop(ctx);
 }
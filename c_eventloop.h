@@ -4,4 +4,9 @@
 void eventloop_register(duk_context *ctx);
 duk_ret_t eventloop_run(duk_context *ctx, void *udata);
 
+/* Called by eventloop_run() when it is about to sleep for 'timeout' ms; the
+ * embedder can use this to do some housekeeping, for example run the GC.
+ */
+void eventloop_idle(duk_context *ctx, void *udata, int timeout);
+
 #endif
@@ -18,24 +18,64 @@
 #include "pl_native.h"
 #include "pl_inlined.h"
 #include "pl_sandbox.h"
+#include "pl_arena.h"
+#include "pl_watchdog.h"
+#include "pl_profile.h"
+#include "pl_resolver.h"
+#include "pl_bundle.h"
+#include "pl_bytecode.h"
+#include "pl_worker.h"
+#include "duk_callstack.h"
+#include "duk_console.h"
 #include "pl_util.h"
 
 #define MAX_MEMORY_MINIMUM  (128 * 1024) /* 128 KB */
 #define MAX_TIMEOUT_MINIMUM (500000)     /* 500_000 us = 500 ms = 0.5 s */
+#define MAX_CPU_TIME_MINIMUM (500000)    /* 500_000 us = 500 ms = 0.5 s */
+#define MAX_INSTRUCTIONS_MINIMUM (PL_SANDBOX_INSTRUCTIONS_PER_CHECK)
+#define CONSOLE_BUFFER_MINIMUM (1024)    /* 1 KB */
+
+#define CONSOLE_LEVEL_NAME_DEBUG "debug"
+#define CONSOLE_LEVEL_NAME_INFO  "info"
+#define CONSOLE_LEVEL_NAME_WARN  "warn"
+#define CONSOLE_LEVEL_NAME_ERROR "error"
+
+#define GC_OPT_NAME_MODE      "mode"
+#define GC_OPT_NAME_BUDGET_US "budget_us"
+
+#define GC_MODE_NAME_FULL     "full"
+#define GC_MODE_NAME_LIGHT    "light"
+#define GC_MODE_NAME_COMPACT  "compact"
+
+#define WORKERS_OPT_NAME_SOURCE         "source"
+#define WORKERS_OPT_NAME_HANDLER        "handler"
+#define WORKERS_OPT_NAME_THREADS        "threads"
+#define WORKERS_OPT_NAME_MAX_TIMEOUT_US "max_timeout_us"
+
+#define WORKERS_DEFAULT_HANDLER "onmessage"
+
+#define MAP_OPT_NAME_THREADS    "threads"
+#define MAP_OPT_NAME_CHUNK_SIZE "chunk_size"
 
 #define TIMEOUT_RESET(duk) \
     do { \
         if (duk->max_timeout_us > 0) { \
             duk->eval_start_us = now_us(); \
+            if (duk->flags & DUK_OPT_FLAG_TIMEOUT_WATCHDOG) { \
+                pl_watchdog_arm(duk); \
+            } \
         } \
+        if (duk->max_cpu_time_us > 0) { \
+            duk->eval_start_cpu_us = cpu_now_us(); \
+        } \
+        duk->eval_start_instructions = duk->instruction_count; \
+        duk->exec_expired = 0; \
     } while (0) \
 
 static void duk_fatal_error_handler(void* udata, const char* msg)
 {
-    dTHX;
-
-    /* Duk* duk = (Duk*) udata; */
-    UNUSED_ARG(udata);
+    Duk* duk = (Duk*) udata;
+    PL_DUK_THX(duk);
 
     PerlIO_printf(PerlIO_stderr(), "duktape fatal error, aborting: %s\n", msg ? msg : "*NONE*");
     abort();
@@ -48,11 +88,31 @@ static void set_up(Duk* duk)
     }
     duk->inited = 1;
 
+    if ((duk->flags & DUK_OPT_FLAG_ARENA_ALLOCATOR) && !duk->arena) {
+        duk->arena = pl_arena_create();
+        if (!duk->arena) {
+            croak("Could not create memory arena\n");
+        }
+    }
+
+    duk->soft_trigger_bytes = duk->soft_allocated_bytes;
+    duk->soft_gc_pending = 0;
+
     duk->ctx = duk_create_heap(pl_sandbox_alloc, pl_sandbox_realloc, pl_sandbox_free, duk, duk_fatal_error_handler);
     if (!duk->ctx) {
         croak("Could not create duk heap\n");
     }
 
+    /* the profiler needs to be called much more often than the default */
+    duk->instructions_per_check = PL_SANDBOX_INSTRUCTIONS_PER_CHECK;
+    if (duk->profile) {
+        duk->instructions_per_check = PL_PROFILE_INSTRUCTIONS_PER_CHECK;
+        duk_set_interrupt_interval(duk->ctx, PL_PROFILE_INSTRUCTIONS_PER_CHECK);
+
+        /* only profile the caller's code, not the JS we run to set up the VM */
+        pl_profile_pause(duk->profile, 1);
+    }
+
     TIMEOUT_RESET(duk);
 
     /* register a bunch of native functions */
@@ -69,6 +129,10 @@ static void set_up(Duk* duk)
 
     /* initialize console object */
     pl_console_init(duk);
+
+    if (duk->profile) {
+        pl_profile_pause(duk->profile, 0);
+    }
 }
 
 static void tear_down(Duk* duk)
@@ -78,18 +142,33 @@ static void tear_down(Duk* duk)
     }
     duk->inited = 0;
 
-    duk_destroy_heap(duk->ctx);
+    pl_watchdog_disarm(duk);
+    pl_console_flush(duk);
+
+    if (duk->arena) {
+        /*
+         * The arena owns every block in the heap, so we just throw all of
+         * them away at once instead of freeing each object; this means JS
+         * finalizers are not run.
+         */
+        pl_arena_release(duk->arena, duk->flags & DUK_OPT_FLAG_ARENA_MADVISE);
+        duk->total_allocated_bytes = 0;
+    } else {
+        duk_destroy_heap(duk->ctx);
+    }
+    duk->ctx = 0;
 }
 
 static Duk* create_duktape_object(pTHX_ HV* opt)
 {
     Duk* duk = (Duk*) malloc(sizeof(Duk));
     memset(duk, 0, sizeof(Duk));
-
-    duk->pagesize_bytes = getpagesize();
+    duk->perl = (PerlInterpreter*) PERL_GET_THX;
 
     duk->stats = newHV();
     duk->msgs = newHV();
+    duk->max_messages = PL_CONSOLE_MAX_MESSAGES;
+    duk->max_message_bytes = PL_CONSOLE_MAX_MESSAGE_BYTES;
 
     if (opt) {
         hv_iterinit(opt);
@@ -117,16 +196,139 @@ static Duk* create_duktape_object(pTHX_ HV* opt)
                 duk->flags |= SvTRUE(value) ? DUK_OPT_FLAG_SAVE_MESSAGES : 0;
                 continue;
             }
+            if (memcmp(kstr, DUK_OPT_NAME_ARENA_ALLOCATOR, klen) == 0) {
+                duk->flags |= SvTRUE(value) ? DUK_OPT_FLAG_ARENA_ALLOCATOR : 0;
+                continue;
+            }
+            if (memcmp(kstr, DUK_OPT_NAME_ARENA_MADVISE, klen) == 0) {
+                duk->flags |= SvTRUE(value) ? DUK_OPT_FLAG_ARENA_MADVISE : 0;
+                continue;
+            }
+            if (memcmp(kstr, DUK_OPT_NAME_IDLE_GC, klen) == 0) {
+                duk->flags |= SvTRUE(value) ? DUK_OPT_FLAG_IDLE_GC : 0;
+                continue;
+            }
+            if (memcmp(kstr, DUK_OPT_NAME_TIMEOUT_WATCHDOG, klen) == 0) {
+                duk->flags |= SvTRUE(value) ? DUK_OPT_FLAG_TIMEOUT_WATCHDOG : 0;
+                continue;
+            }
             if (memcmp(kstr, DUK_OPT_NAME_MAX_MEMORY_BYTES, klen) == 0) {
                 int param = SvIV(value);
                 duk->max_allocated_bytes = param > MAX_MEMORY_MINIMUM ? param : MAX_MEMORY_MINIMUM;
                 continue;
             }
+            if (memcmp(kstr, DUK_OPT_NAME_SOFT_MEMORY_BYTES, klen) == 0) {
+                int param = SvIV(value);
+                duk->soft_allocated_bytes = param > MAX_MEMORY_MINIMUM ? param : MAX_MEMORY_MINIMUM;
+                continue;
+            }
             if (memcmp(kstr, DUK_OPT_NAME_MAX_TIMEOUT_US, klen) == 0) {
                 int param = SvIV(value);
                 duk->max_timeout_us = param > MAX_TIMEOUT_MINIMUM ? param : MAX_TIMEOUT_MINIMUM;
                 continue;
             }
+            if (memcmp(kstr, DUK_OPT_NAME_PROFILE_INTERVAL_US, klen) == 0) {
+                double param = SvNV(value);
+                if (param > 0 && !duk->profile) {
+                    duk->profile = pl_profile_create(param);
+                    if (!duk->profile) {
+                        croak("Could not create profiler\n");
+                    }
+                }
+                continue;
+            }
+            if (memcmp(kstr, DUK_OPT_NAME_MAX_CPU_TIME_US, klen) == 0) {
+                int param = SvIV(value);
+                duk->max_cpu_time_us = param > MAX_CPU_TIME_MINIMUM ? param : MAX_CPU_TIME_MINIMUM;
+                continue;
+            }
+            if (memcmp(kstr, DUK_OPT_NAME_MAX_INSTRUCTIONS, klen) == 0) {
+                double param = SvNV(value);
+                duk->max_instructions = param > MAX_INSTRUCTIONS_MINIMUM ? param : MAX_INSTRUCTIONS_MINIMUM;
+                continue;
+            }
+            if (memcmp(kstr, DUK_OPT_NAME_CONSOLE_BUFFER_BYTES, klen) == 0) {
+                int param = SvIV(value);
+                duk->console_buffer_bytes = param <= 0 ? 0 : param > CONSOLE_BUFFER_MINIMUM ? param : CONSOLE_BUFFER_MINIMUM;
+                continue;
+            }
+            if (memcmp(kstr, DUK_OPT_NAME_MAX_MESSAGES, klen) == 0) {
+                int param = SvIV(value);
+                duk->max_messages = param > 1 ? param : 1;
+                continue;
+            }
+            if (memcmp(kstr, DUK_OPT_NAME_MAX_MESSAGE_BYTES, klen) == 0) {
+                int param = SvIV(value);
+                duk->max_message_bytes = param > 1 ? param : 1;
+                continue;
+            }
+            if (memcmp(kstr, DUK_OPT_NAME_CONSOLE_LEVEL, klen) == 0) {
+                const char* name = SvPV_nolen(value);
+                if (strcmp(name, CONSOLE_LEVEL_NAME_DEBUG) == 0) {
+                    duk->console_level = DUK_CONSOLE_LEVEL_DEBUG;
+                } else if (strcmp(name, CONSOLE_LEVEL_NAME_INFO) == 0) {
+                    duk->console_level = DUK_CONSOLE_LEVEL_INFO;
+                } else if (strcmp(name, CONSOLE_LEVEL_NAME_WARN) == 0) {
+                    duk->console_level = DUK_CONSOLE_LEVEL_WARN;
+                } else if (strcmp(name, CONSOLE_LEVEL_NAME_ERROR) == 0) {
+                    duk->console_level = DUK_CONSOLE_LEVEL_ERROR;
+                } else {
+                    croak("Unknown console level %s\n", name);
+                }
+                continue;
+            }
+            if (memcmp(kstr, DUK_OPT_NAME_MODULE_CACHE, klen) == 0) {
+                duk->flags |= SvTRUE(value) ? DUK_OPT_FLAG_MODULE_CACHE : 0;
+                continue;
+            }
+            if (memcmp(kstr, DUK_OPT_NAME_SHARE_MODULES, klen) == 0) {
+                duk->flags |= SvTRUE(value) ? DUK_OPT_FLAG_SHARE_MODULES | DUK_OPT_FLAG_MODULE_CACHE : 0;
+                continue;
+            }
+            if (memcmp(kstr, DUK_OPT_NAME_MODULE_CACHE_DIR, klen) == 0) {
+                if (!SvOK(value)) {
+                    continue;
+                }
+                free(duk->module_cache_dir);
+                duk->module_cache_dir = strdup(SvPV_nolen(value));
+                if (!duk->module_cache_dir) {
+                    croak("Could not save module cache directory\n");
+                }
+                duk->flags |= DUK_OPT_FLAG_MODULE_CACHE;
+                continue;
+            }
+            if (memcmp(kstr, DUK_OPT_NAME_MODULE_BUNDLE, klen) == 0) {
+                const char* path = SvPV_nolen(value);
+                pl_bundle_close(duk->bundle);
+                duk->bundle = pl_bundle_open(path);
+                if (!duk->bundle) {
+                    croak("Could not open module bundle %s\n", path);
+                }
+                continue;
+            }
+            if (memcmp(kstr, DUK_OPT_NAME_MODULE_PATHS, klen) == 0) {
+                AV* paths = 0;
+                int top = 0;
+                int j = 0;
+                if (!SvROK(value) || SvTYPE(SvRV(value)) != SVt_PVAV) {
+                    croak("Option %s must be an arrayref\n", DUK_OPT_NAME_MODULE_PATHS);
+                }
+                if (!duk->resolver) {
+                    duk->resolver = pl_resolver_create();
+                    if (!duk->resolver) {
+                        croak("Could not create module resolver\n");
+                    }
+                }
+                paths = (AV*) SvRV(value);
+                top = av_top_index(paths);
+                for (j = 0; j <= top; ++j) {
+                    SV** path = av_fetch(paths, j, 0);
+                    if (path && SvOK(*path) && !pl_resolver_add_path(duk->resolver, SvPV_nolen(*path))) {
+                        croak("Could not add module path\n");
+                    }
+                }
+                continue;
+            }
             croak("Unknown option %*.*s\n", (int) klen, (int) klen, kstr);
         }
     }
@@ -135,16 +337,164 @@ static Duk* create_duktape_object(pTHX_ HV* opt)
     return duk;
 }
 
+static void parse_gc_options(pTHX_ HV* opt, int* mode, double* budget_us)
+{
+    hv_iterinit(opt);
+    while (1) {
+        SV* value = 0;
+        I32 klen = 0;
+        char* kstr = 0;
+        HE* entry = hv_iternext(opt);
+        if (!entry) {
+            break; /* no more hash keys */
+        }
+        kstr = hv_iterkey(entry, &klen);
+        if (!kstr || klen < 0) {
+            continue; /* invalid key */
+        }
+        value = hv_iterval(opt, entry);
+        if (!value) {
+            continue; /* invalid value */
+        }
+        if (memcmp(kstr, GC_OPT_NAME_MODE, klen) == 0) {
+            const char* name = SvPV_nolen(value);
+            if (strcmp(name, GC_MODE_NAME_FULL) == 0) {
+                *mode = PL_GC_MODE_FULL;
+            } else if (strcmp(name, GC_MODE_NAME_LIGHT) == 0) {
+                *mode = PL_GC_MODE_LIGHT;
+            } else if (strcmp(name, GC_MODE_NAME_COMPACT) == 0) {
+                *mode = PL_GC_MODE_COMPACT;
+            } else {
+                croak("Unknown GC mode %s\n", name);
+            }
+            continue;
+        }
+        if (memcmp(kstr, GC_OPT_NAME_BUDGET_US, klen) == 0) {
+            *budget_us = SvNV(value);
+            continue;
+        }
+        croak("Unknown GC option %*.*s\n", (int) klen, (int) klen, kstr);
+    }
+}
+
+static void parse_map_options(pTHX_ HV* opt, int* threads, size_t* chunk_size)
+{
+    hv_iterinit(opt);
+    while (1) {
+        SV* value = 0;
+        I32 klen = 0;
+        char* kstr = 0;
+        HE* entry = hv_iternext(opt);
+        if (!entry) {
+            break; /* no more hash keys */
+        }
+        kstr = hv_iterkey(entry, &klen);
+        if (!kstr || klen < 0) {
+            continue; /* invalid key */
+        }
+        value = hv_iterval(opt, entry);
+        if (!value) {
+            continue; /* invalid value */
+        }
+        if (memcmp(kstr, MAP_OPT_NAME_THREADS, klen) == 0) {
+            *threads = SvIV(value);
+            continue;
+        }
+        if (memcmp(kstr, MAP_OPT_NAME_CHUNK_SIZE, klen) == 0) {
+            IV size = SvIV(value);
+            *chunk_size = size > 0 ? (size_t) size : 0;
+            continue;
+        }
+        croak("Unknown parallel_map option %*.*s\n", (int) klen, (int) klen, kstr);
+    }
+}
+
 static int session_dtor(pTHX_ SV* sv, MAGIC* mg)
 {
     Duk* duk = (Duk*) mg->mg_ptr;
     UNUSED_ARG(sv);
     tear_down(duk);
+    pl_arena_destroy(duk->arena);
+    duk->arena = 0;
+    pl_stats_destroy(duk);
+    pl_console_destroy(duk);
+    pl_profile_destroy(duk->profile);
+    duk->profile = 0;
+    pl_resolver_destroy(duk->resolver);
+    duk->resolver = 0;
+    free(duk->module_cache_dir);
+    duk->module_cache_dir = 0;
+    pl_bundle_close(duk->bundle);
+    duk->bundle = 0;
     return 0;
 }
 
 static MGVTBL session_magic_vtbl = { .svt_free = session_dtor };
 
+static WorkerPool* create_workers_object(pTHX_ HV* opt)
+{
+    const char* source = 0;
+    const char* handler = WORKERS_DEFAULT_HANDLER;
+    int threads = 0;
+    double max_timeout_us = 0;
+
+    if (opt) {
+        hv_iterinit(opt);
+        while (1) {
+            SV* value = 0;
+            I32 klen = 0;
+            char* kstr = 0;
+            HE* entry = hv_iternext(opt);
+            if (!entry) {
+                break; /* no more hash keys */
+            }
+            kstr = hv_iterkey(entry, &klen);
+            if (!kstr || klen < 0) {
+                continue; /* invalid key */
+            }
+            value = hv_iterval(opt, entry);
+            if (!value) {
+                continue; /* invalid value */
+            }
+            if (memcmp(kstr, WORKERS_OPT_NAME_SOURCE, klen) == 0) {
+                source = SvPV_nolen(value);
+                continue;
+            }
+            if (memcmp(kstr, WORKERS_OPT_NAME_HANDLER, klen) == 0) {
+                handler = SvPV_nolen(value);
+                continue;
+            }
+            if (memcmp(kstr, WORKERS_OPT_NAME_THREADS, klen) == 0) {
+                threads = SvIV(value);
+                continue;
+            }
+            if (memcmp(kstr, WORKERS_OPT_NAME_MAX_TIMEOUT_US, klen) == 0) {
+                max_timeout_us = SvNV(value);
+                if (max_timeout_us < MAX_TIMEOUT_MINIMUM) {
+                    max_timeout_us = MAX_TIMEOUT_MINIMUM;
+                }
+                continue;
+            }
+            croak("Unknown worker option %*.*s\n", (int) klen, (int) klen, kstr);
+        }
+    }
+    if (!source) {
+        croak("Option %s is required for workers\n", WORKERS_OPT_NAME_SOURCE);
+    }
+
+    return pl_worker_create(aTHX_ source, handler, threads, max_timeout_us);
+}
+
+static int workers_dtor(pTHX_ SV* sv, MAGIC* mg)
+{
+    WorkerPool* pool = (WorkerPool*) mg->mg_ptr;
+    UNUSED_ARG(sv);
+    pl_worker_destroy(pool);
+    return 0;
+}
+
+static MGVTBL workers_magic_vtbl = { .svt_free = workers_dtor };
+
 MODULE = JavaScript::Duktape::XS       PACKAGE = JavaScript::Duktape::XS
 PROTOTYPES: DISABLE
 
@@ -166,24 +516,65 @@ reset(Duk* duk)
 HV*
 get_stats(Duk* duk)
   CODE:
+    pl_stats_save(aTHX_ duk);
     RETVAL = duk->stats;
   OUTPUT: RETVAL
 
+SV*
+get_stats_raw(Duk* duk)
+  CODE:
+    RETVAL = pl_stats_raw(aTHX_ duk);
+  OUTPUT: RETVAL
+
+SV*
+get_stats_raw_names(Duk* duk)
+  CODE:
+    UNUSED_ARG(duk);
+    RETVAL = pl_stats_raw_names(aTHX);
+  OUTPUT: RETVAL
+
 void
 reset_stats(Duk* duk)
   PPCODE:
     duk->stats = newHV();
+    pl_stats_reset(duk);
+
+SV*
+profile_report(Duk* duk)
+  CODE:
+    RETVAL = pl_profile_report(aTHX_ duk->profile);
+  OUTPUT: RETVAL
+
+void
+reset_profile(Duk* duk)
+  PPCODE:
+    if (duk->profile) {
+        pl_profile_reset(duk->profile);
+    }
+
+void
+flush_console(Duk* duk)
+  PPCODE:
+    pl_console_flush(duk);
 
 HV*
 get_msgs(Duk* duk)
   CODE:
+    pl_console_save_msgs(aTHX_ duk);
     RETVAL = duk->msgs;
   OUTPUT: RETVAL
 
+SV*
+get_msgs_detailed(Duk* duk)
+  CODE:
+    RETVAL = pl_console_msgs_detailed(aTHX_ duk);
+  OUTPUT: RETVAL
+
 void
 reset_msgs(Duk* duk)
   PPCODE:
     duk->msgs = newHV();
+    pl_console_reset_msgs(duk);
 
 SV*
 get(Duk* duk, const char* name)
@@ -195,7 +586,7 @@ get(Duk* duk, const char* name)
     ctx = duk->ctx;
     pl_stats_start(aTHX_ duk, &stats);
     RETVAL = pl_get_global_or_property(aTHX_ ctx, name);
-    pl_stats_stop(aTHX_ duk, &stats, "get");
+    pl_stats_stop(aTHX_ duk, &stats, PL_STATS_OP_GET);
   OUTPUT: RETVAL
 
 SV*
@@ -208,7 +599,7 @@ exists(Duk* duk, const char* name)
     ctx = duk->ctx;
     pl_stats_start(aTHX_ duk, &stats);
     RETVAL = pl_exists_global_or_property(aTHX_ ctx, name);
-    pl_stats_stop(aTHX_ duk, &stats, "exists");
+    pl_stats_stop(aTHX_ duk, &stats, PL_STATS_OP_EXISTS);
   OUTPUT: RETVAL
 
 SV*
@@ -221,7 +612,7 @@ typeof(Duk* duk, const char* name)
     ctx = duk->ctx;
     pl_stats_start(aTHX_ duk, &stats);
     RETVAL = pl_typeof_global_or_property(aTHX_ ctx, name);
-    pl_stats_stop(aTHX_ duk, &stats, "typeof");
+    pl_stats_stop(aTHX_ duk, &stats, PL_STATS_OP_TYPEOF);
   OUTPUT: RETVAL
 
 SV*
@@ -234,7 +625,7 @@ instanceof(Duk* duk, const char* object, const char* class)
     ctx = duk->ctx;
     pl_stats_start(aTHX_ duk, &stats);
     RETVAL = pl_instanceof_global_or_property(aTHX_ ctx, object, class);
-    pl_stats_stop(aTHX_ duk, &stats, "instanceof");
+    pl_stats_stop(aTHX_ duk, &stats, PL_STATS_OP_INSTANCEOF);
   OUTPUT: RETVAL
 
 int
@@ -247,7 +638,7 @@ set(Duk* duk, const char* name, SV* value)
     ctx = duk->ctx;
     pl_stats_start(aTHX_ duk, &stats);
     RETVAL = pl_set_global_or_property(aTHX_ ctx, name, value);
-    pl_stats_stop(aTHX_ duk, &stats, "set");
+    pl_stats_stop(aTHX_ duk, &stats, PL_STATS_OP_SET);
   OUTPUT: RETVAL
 
 int
@@ -260,7 +651,7 @@ remove(Duk* duk, const char* name)
     ctx = duk->ctx;
     pl_stats_start(aTHX_ duk, &stats);
     RETVAL = pl_del_global_or_property(aTHX_ ctx, name);
-    pl_stats_stop(aTHX_ duk, &stats, "remove");
+    pl_stats_stop(aTHX_ duk, &stats, PL_STATS_OP_REMOVE);
   OUTPUT: RETVAL
 
 SV*
@@ -278,18 +669,29 @@ dispatch_function_in_event_loop(Duk* duk, const char* func)
     TIMEOUT_RESET(duk);
     pl_stats_start(aTHX_ duk, &stats);
     RETVAL = newSViv(pl_run_function_in_event_loop(duk, func));
-    pl_stats_stop(aTHX_ duk, &stats, "dispatch");
+    pl_stats_stop(aTHX_ duk, &stats, PL_STATS_OP_DISPATCH);
   OUTPUT: RETVAL
 
 SV*
-run_gc(Duk* duk)
+run_gc(Duk* duk, HV* opt = NULL)
   PREINIT:
     Stats stats;
+    int mode = PL_GC_MODE_FULL;
+    double budget_us = 0;
   CODE:
+    if (opt) {
+        parse_gc_options(aTHX_ opt, &mode, &budget_us);
+    }
     TIMEOUT_RESET(duk);
     pl_stats_start(aTHX_ duk, &stats);
-    RETVAL = newSVnv(pl_run_gc(duk));
-    pl_stats_stop(aTHX_ duk, &stats, "run_gc");
+    RETVAL = newSVnv(pl_run_gc(duk, mode, budget_us));
+    pl_stats_stop(aTHX_ duk, &stats, PL_STATS_OP_RUN_GC);
+  OUTPUT: RETVAL
+
+SV*
+heap_info(Duk* duk)
+  CODE:
+    RETVAL = pl_heap_info(aTHX_ duk);
   OUTPUT: RETVAL
 
 SV*
@@ -302,5 +704,83 @@ global_objects(Duk* duk)
     ctx = duk->ctx;
     pl_stats_start(aTHX_ duk, &stats);
     RETVAL = pl_global_objects(aTHX_ ctx);
-    pl_stats_stop(aTHX_ duk, &stats, "global_objects");
+    pl_stats_stop(aTHX_ duk, &stats, PL_STATS_OP_GLOBAL_OBJECTS);
+  OUTPUT: RETVAL
+
+SV*
+compile_module(Duk* duk, const char* id, SV* source)
+  CODE:
+    RETVAL = pl_bundle_compile(aTHX_ duk, id, source);
+  OUTPUT: RETVAL
+
+SV*
+parallel_map(Duk* duk, const char* func, AV* list, HV* opt = NULL)
+  PREINIT:
+    int threads = 0;
+    size_t chunk_size = 0;
+  CODE:
+    if (opt) {
+        parse_map_options(aTHX_ opt, &threads, &chunk_size);
+    }
+    RETVAL = pl_worker_map(aTHX_ duk, func, list, threads, chunk_size);
+  OUTPUT: RETVAL
+
+void
+clear_module_cache(...)
+  PPCODE:
+    pl_bytecode_clear();
+
+MODULE = JavaScript::Duktape::XS       PACKAGE = JavaScript::Duktape::XS::Workers
+PROTOTYPES: DISABLE
+
+#################################################################
+
+WorkerPool*
+new(char* CLASS, HV* opt = NULL)
+  CODE:
+    RETVAL = create_workers_object(aTHX_ opt);
+  OUTPUT: RETVAL
+
+UV
+post(WorkerPool* pool, SV* message)
+  CODE:
+    RETVAL = pl_worker_post(aTHX_ pool, message);
+  OUTPUT: RETVAL
+
+void
+poll(WorkerPool* pool)
+  PREINIT:
+    AV* results = 0;
+    SSize_t j = 0;
+  PPCODE:
+    results = (AV*) sv_2mortal((SV*) newAV());
+    pl_worker_collect(aTHX_ pool, 0, results);
+    EXTEND(SP, av_top_index(results) + 1);
+    for (j = 0; j <= av_top_index(results); ++j) {
+        PUSHs(*av_fetch(results, j, 0));
+    }
+
+void
+wait_results(WorkerPool* pool, double timeout_us = -1)
+  PREINIT:
+    AV* results = 0;
+    SSize_t j = 0;
+  PPCODE:
+    results = (AV*) sv_2mortal((SV*) newAV());
+    pl_worker_collect(aTHX_ pool, timeout_us, results);
+    EXTEND(SP, av_top_index(results) + 1);
+    for (j = 0; j <= av_top_index(results); ++j) {
+        PUSHs(*av_fetch(results, j, 0));
+    }
+
+UV
+pending(WorkerPool* pool)
+  CODE:
+    RETVAL = pl_worker_pending(aTHX_ pool);
+  OUTPUT: RETVAL
+
+int
+fd(WorkerPool* pool)
+  CODE:
+    RETVAL = pl_worker_fd(pool);
   OUTPUT: RETVAL
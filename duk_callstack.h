@@ -0,0 +1,40 @@
+#if !defined(DUK_CALLSTACK_H_INCLUDED)
+#define DUK_CALLSTACK_H_INCLUDED
+
+#include "duktape.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/*
+ * One activation in the call stack.  The strings point into Duktape's heap
+ * and are not NUL terminated; they are only valid until Duktape runs again.
+ */
+typedef struct {
+    const char *name;   /* function name, NULL if anonymous */
+    duk_size_t name_len;
+    const char *file;   /* file name, NULL for native functions */
+    duk_size_t file_len;
+    duk_uint_t line;    /* line being executed, 0 if unknown */
+    int native;         /* not a compiled JS function */
+} duk_callstack_entry;
+
+/*
+ * Fill up to 'max_entries' entries for the thread currently running, innermost
+ * activation first, and return how many were filled.  This has no side
+ * effects at all, so it can be called from the exec timeout check.
+ */
+extern duk_size_t duk_get_callstack(duk_context *ctx, duk_callstack_entry *entries, duk_size_t max_entries);
+
+/*
+ * Run the executor interrupt (and so the exec timeout check) every 'interval'
+ * bytecode instructions; zero restores Duktape's default.
+ */
+extern void duk_set_interrupt_interval(duk_context *ctx, duk_int_t interval);
+
+#if defined(__cplusplus)
+}
+#endif  /* end 'extern "C"' wrapper */
+
+#endif  /* DUK_CALLSTACK_H_INCLUDED */
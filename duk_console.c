@@ -7,10 +7,10 @@
  */
 
 #include <stdio.h>
+#include <string.h>
 #include "duktape.h"
 #include "duk_console.h"
-
-/* XXX: Add some form of log level filtering. */
+#include "duk_jx.h"
 
 /* XXX: Should all output be written via e.g. console.write(formattedMsg)?
  * This would make it easier for user code to redirect all console output
@@ -22,38 +22,105 @@
 typedef struct ConsoleConfig {
     ConsoleHandler* handler;
     void* data;
+    void* format;  /* our own console.format, kept alive in the heap stash */
+    duk_uint_t min_level;
 } ConsoleConfig;
 
-static ConsoleConfig console_config;
+/* Each heap keeps its console config in a buffer in the heap stash */
+#define DUK__CONSOLE_CONFIG DUK_HIDDEN_SYMBOL("consoleConfig")
+#define DUK__CONSOLE_FORMAT DUK_HIDDEN_SYMBOL("consoleFormat")
+
+/* Formatted objects longer than this many characters are cut short */
+#define DUK__CONSOLE_FORMAT_MAX_LENGTH (64 * 1024)
+
+static ConsoleConfig* duk__console_get_config(duk_context *ctx, int create)
+{
+    ConsoleConfig* config = 0;
+    duk_push_heap_stash(ctx);
+    if (duk_get_prop_string(ctx, -1, DUK__CONSOLE_CONFIG)) {
+        config = (ConsoleConfig*) duk_get_buffer(ctx, -1, 0);
+    } else if (create) {
+        config = (ConsoleConfig*) duk_push_fixed_buffer(ctx, sizeof(ConsoleConfig));
+        memset(config, 0, sizeof(ConsoleConfig));
+        duk_put_prop_string(ctx, -3, DUK__CONSOLE_CONFIG);
+    }
+    duk_pop_2(ctx);  /* pop config and stash; the stash keeps the buffer alive */
+    return config;
+}
 
-int duk_console_log(duk_uint_t flags, const char* fmt, ...)
+int duk_console_log(duk_context *ctx, duk_uint_t flags, const char* fmt, ...)
 {
     int ret = 0;
-    if (console_config.handler) {
+    ConsoleConfig* config = duk__console_get_config(ctx, 0);
+    if (config && config->handler) {
         va_list ap;
         va_start(ap, fmt);
-        ret = console_config.handler(flags, console_config.data, fmt, ap);
+        ret = config->handler(flags, config->data, fmt, ap);
         va_end(ap);
     }
     return ret;
 }
 
-void duk_console_register_handler(ConsoleHandler* handler, void* data)
+void duk_console_register_handler(duk_context *ctx, ConsoleHandler* handler, void* data)
 {
-    console_config.handler = handler;
-    console_config.data = data;
+    ConsoleConfig* config = duk__console_get_config(ctx, 1);
+    config->handler = handler;
+    config->data = data;
+}
+
+void duk_console_set_min_level(duk_context *ctx, duk_uint_t level)
+{
+    ConsoleConfig* config = duk__console_get_config(ctx, 1);
+    config->min_level = DUK_CONSOLE_LEVEL(level);
+}
+
+static duk_ret_t duk__console_jx_encode(duk_context *ctx, void *udata) {
+	(void) udata;
+	duk_jx_encode(ctx, -1);  /* safe calls share our value stack frame */
+	return 1;
+}
+
+/* Same as our console.format(), without calling into JS. */
+static void duk__console_format_native(duk_context *ctx, duk_idx_t idx) {
+	duk_dup(ctx, idx);
+	if (duk_safe_call(ctx, duk__console_jx_encode, NULL, 1 /*nargs*/, 1 /*nrets*/) != DUK_EXEC_SUCCESS) {
+		/* e.g. cyclic input: fall back to ToString(v) */
+		duk_pop(ctx);
+		duk_dup(ctx, idx);
+		duk_safe_to_string(ctx, -1);
+	}
+	if (duk_get_length(ctx, -1) > DUK__CONSOLE_FORMAT_MAX_LENGTH) {
+		duk_substring(ctx, -1, 0, DUK__CONSOLE_FORMAT_MAX_LENGTH);
+		duk_push_string(ctx, "...");
+		duk_concat(ctx, 2);
+	}
+	duk_replace(ctx, idx);
 }
 
 static duk_ret_t duk__console_log_helper(duk_context *ctx, const char *error_name) {
     duk_uint_t flags = (duk_uint_t) duk_get_current_magic(ctx);
     duk_idx_t n = duk_get_top(ctx);
     duk_idx_t i;
+    ConsoleConfig* config = duk__console_get_config(ctx, 0);
+    int native = 0;
+
+	/* Filter out messages below the minimum level before doing any work. */
+	if (config && DUK_CONSOLE_LEVEL(flags) < config->min_level) {
+		return 0;
+	}
 
 	duk_get_global_string(ctx, "console");
 	duk_get_prop_string(ctx, -1, "format");
 
+	/* Unless the user replaced console.format, we can format natively. */
+	native = config && config->format && duk_get_heapptr(ctx, -1) == config->format;
+
 	for (i = 0; i < n; i++) {
 		if (duk_check_type_mask(ctx, i, DUK_TYPE_MASK_OBJECT)) {
+			if (native) {
+				duk__console_format_native(ctx, i);
+				continue;
+			}
 			/* Slow path formatting. */
 			duk_dup(ctx, -1);  /* console.format */
 			duk_dup(ctx, i);
@@ -76,7 +143,7 @@ static duk_ret_t duk__console_log_helper(duk_context *ctx, const char *error_nam
 		duk_get_prop_string(ctx, -1, "stack");
 	}
 
-    duk_console_log(flags, "%s\n", duk_to_string(ctx, -1));
+    duk_console_log(ctx, flags, "%s\n", duk_to_string(ctx, -1));
 	return 0;
 }
 
@@ -151,6 +218,11 @@ void duk_console_init(duk_context *ctx, duk_uint_t flags) {
 		        "}"
 		    "};"
 		"})(Duktape.enc)");
+	duk__console_get_config(ctx, 1)->format = duk_get_heapptr(ctx, -1);
+	duk_push_heap_stash(ctx);
+	duk_dup(ctx, -2);
+	duk_put_prop_string(ctx, -2, DUK__CONSOLE_FORMAT);
+	duk_pop(ctx);  /* heap stash */
 	duk_put_prop_string(ctx, -2, "format");
 
 	flags = flags_orig;
@@ -159,11 +231,11 @@ void duk_console_init(duk_context *ctx, duk_uint_t flags) {
 	    /* No output indicators were specified; these levels go to stdout. */
 	    flags |= DUK_CONSOLE_TO_STDOUT;
 	}
-	duk__console_reg_vararg_func(ctx, duk__console_assert, "assert", flags);
-	duk__console_reg_vararg_func(ctx, duk__console_log, "log", flags);
-	duk__console_reg_vararg_func(ctx, duk__console_log, "debug", flags);  /* alias to console.log */
-	duk__console_reg_vararg_func(ctx, duk__console_trace, "trace", flags);
-	duk__console_reg_vararg_func(ctx, duk__console_info, "info", flags);
+	duk__console_reg_vararg_func(ctx, duk__console_assert, "assert", flags | DUK_CONSOLE_LEVEL_ERROR);
+	duk__console_reg_vararg_func(ctx, duk__console_log, "log", flags | DUK_CONSOLE_LEVEL_INFO);
+	duk__console_reg_vararg_func(ctx, duk__console_log, "debug", flags | DUK_CONSOLE_LEVEL_DEBUG);  /* alias to console.log */
+	duk__console_reg_vararg_func(ctx, duk__console_trace, "trace", flags | DUK_CONSOLE_LEVEL_DEBUG);
+	duk__console_reg_vararg_func(ctx, duk__console_info, "info", flags | DUK_CONSOLE_LEVEL_INFO);
 
 	flags = flags_orig;
 	if (!(flags & DUK_CONSOLE_TO_STDOUT) &&
@@ -171,10 +243,10 @@ void duk_console_init(duk_context *ctx, duk_uint_t flags) {
 	    /* No output indicators were specified; these levels go to stderr. */
 	    flags |= DUK_CONSOLE_TO_STDERR;
 	}
-	duk__console_reg_vararg_func(ctx, duk__console_warn, "warn", flags);
-	duk__console_reg_vararg_func(ctx, duk__console_error, "error", flags);
-	duk__console_reg_vararg_func(ctx, duk__console_error, "exception", flags);  /* alias to console.error */
-	duk__console_reg_vararg_func(ctx, duk__console_dir, "dir", flags);
+	duk__console_reg_vararg_func(ctx, duk__console_warn, "warn", flags | DUK_CONSOLE_LEVEL_WARN);
+	duk__console_reg_vararg_func(ctx, duk__console_error, "error", flags | DUK_CONSOLE_LEVEL_ERROR);
+	duk__console_reg_vararg_func(ctx, duk__console_error, "exception", flags | DUK_CONSOLE_LEVEL_ERROR);  /* alias to console.error */
+	duk__console_reg_vararg_func(ctx, duk__console_dir, "dir", flags | DUK_CONSOLE_LEVEL_INFO);
 
 	duk_put_global_string(ctx, "console");
 
@@ -20,6 +20,17 @@ extern "C" {
 /* Send output to stderr. */
 #define DUK_CONSOLE_TO_STDERR      (1 << 3)
 
+/* Severity of a message, kept in the flags next to the output indicators. */
+#define DUK_CONSOLE_LEVEL_SHIFT    4
+#define DUK_CONSOLE_LEVEL_MASK     (0x7 << DUK_CONSOLE_LEVEL_SHIFT)
+#define DUK_CONSOLE_LEVEL_DEBUG    (1 << DUK_CONSOLE_LEVEL_SHIFT)  /* debug, trace */
+#define DUK_CONSOLE_LEVEL_INFO     (2 << DUK_CONSOLE_LEVEL_SHIFT)  /* log, info, dir */
+#define DUK_CONSOLE_LEVEL_WARN     (3 << DUK_CONSOLE_LEVEL_SHIFT)  /* warn */
+#define DUK_CONSOLE_LEVEL_ERROR    (4 << DUK_CONSOLE_LEVEL_SHIFT)  /* error, exception, assert */
+
+/* Get the level out of a set of flags */
+#define DUK_CONSOLE_LEVEL(flags)   ((flags) & DUK_CONSOLE_LEVEL_MASK)
+
 /* The console handler prototype */
 typedef int (ConsoleHandler)(duk_uint_t flags, void* data,
                              const char* fmt, va_list ap);
@@ -27,11 +38,18 @@ typedef int (ConsoleHandler)(duk_uint_t flags, void* data,
 /* Initialize the console system */
 extern void duk_console_init(duk_context *ctx, duk_uint_t flags);
 
-/* Register a console handler */
-extern void duk_console_register_handler(ConsoleHandler* handler, void* data);
+/* Register a console handler for the heap ctx belongs to */
+extern void duk_console_register_handler(duk_context *ctx, ConsoleHandler* handler, void* data);
+
+/*
+ * Set the minimum level (one of DUK_CONSOLE_LEVEL_*) for messages logged from
+ * JS in the heap ctx belongs to; less severe messages are discarded before
+ * doing any formatting.  Zero means no filtering.
+ */
+extern void duk_console_set_min_level(duk_context *ctx, duk_uint_t level);
 
 /* Public function to log messages, callable from C */
-extern int duk_console_log(duk_uint_t flags, const char* fmt, ...);
+extern int duk_console_log(duk_context *ctx, duk_uint_t flags, const char* fmt, ...);
 
 #if defined(__cplusplus)
 }
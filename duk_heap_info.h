@@ -0,0 +1,49 @@
+#if !defined(DUK_HEAP_INFO_H_INCLUDED)
+#define DUK_HEAP_INFO_H_INCLUDED
+
+#include "duktape.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/* Number of heap elements of one kind, and the bytes they use */
+typedef struct {
+    duk_size_t count;
+    duk_size_t bytes;
+} duk_heap_info_entry;
+
+typedef struct {
+    duk_heap_info_entry objects;    /* any object not listed below */
+    duk_heap_info_entry functions;  /* compiled, native and bound functions */
+    duk_heap_info_entry threads;    /* including value stacks and call stacks */
+    duk_heap_info_entry strings;
+    duk_heap_info_entry buffers;    /* including dynamic buffer data */
+
+    duk_size_t strtab_size;         /* number of buckets in the string table */
+    duk_size_t strtab_used;         /* buckets with at least one string */
+    duk_size_t strtab_longest;      /* length of the longest bucket chain */
+
+    duk_size_t pending_finalize;    /* objects waiting for their finalizer */
+
+    duk_size_t freed_refcount;      /* elements freed when their refcount dropped to zero */
+    duk_size_t freed_markandsweep;  /* elements freed by mark-and-sweep */
+} duk_heap_info;
+
+/*
+ * Returns the size of a block allocated with the heap's allocation functions;
+ * Duktape itself does not keep track of that.
+ */
+typedef duk_size_t (*duk_heap_info_size_function)(void *udata, void *ptr);
+
+/*
+ * Walk the heap and fill 'info'.  This does not run the GC or touch any
+ * refcounts, so it can be called at any time from outside Duktape.
+ */
+extern void duk_get_heap_info(duk_context *ctx, duk_heap_info *info, duk_heap_info_size_function size_func);
+
+#if defined(__cplusplus)
+}
+#endif  /* end 'extern "C"' wrapper */
+
+#endif  /* DUK_HEAP_INFO_H_INCLUDED */
@@ -0,0 +1,21 @@
+#if !defined(DUK_JX_H_INCLUDED)
+#define DUK_JX_H_INCLUDED
+
+#include "duktape.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/*
+ * Replace the value at 'idx' with its JX encoding, exactly as returned by
+ * Duktape.enc('jx', value), but without going through the interpreter.
+ * Throws on errors, such as cyclic input.
+ */
+extern void duk_jx_encode(duk_context *ctx, duk_idx_t idx);
+
+#if defined(__cplusplus)
+}
+#endif  /* end 'extern "C"' wrapper */
+
+#endif  /* DUK_JX_H_INCLUDED */
@@ -199,13 +199,31 @@ static void duk__push_module_object(duk_context *ctx, const char *id, duk_bool_t
 	duk_put_prop_string(ctx, -2, "require");
 }
 
+/* Wrap the module code in a function expression.  This is the simplest
+ * way to implement CommonJS closure semantics and matches the behavior of
+ * e.g. Node.js.
+ */
+void duk_module_node_wrap_source(duk_context *ctx) {
+	const char *src;
+
+	/*
+	 *  Stack: [ ... source ] => [ ... func_src ]
+	 */
+
+	src = duk_require_string(ctx, -1);
+	duk_push_string(ctx, "(function(exports,require,module,__filename,__dirname){");
+	duk_push_string(ctx, (src[0] == '#' && src[1] == '!') ? "//" : "");  /* Shebang support. */
+	duk_dup(ctx, -3);  /* source */
+	duk_push_string(ctx, "\n})");  /* Newline allows module last line to contain a // comment. */
+	duk_concat(ctx, 4);
+	duk_remove(ctx, -2);
+}
+
 #if DUK_VERSION >= 19999
 static duk_int_t duk__eval_module_source(duk_context *ctx, void *udata) {
 #else
 static duk_int_t duk__eval_module_source(duk_context *ctx) {
 #endif
-	const char *src;
-
 	/*
 	 *  Stack: [ ... module source ]
 	 */
@@ -214,21 +232,26 @@ static duk_int_t duk__eval_module_source(duk_context *ctx) {
 	(void) udata;
 #endif
 
-	/* Wrap the module code in a function expression.  This is the simplest
-	 * way to implement CommonJS closure semantics and matches the behavior of
-	 * e.g. Node.js.
-	 */
-	duk_push_string(ctx, "(function(exports,require,module,__filename,__dirname){");
-	src = duk_require_string(ctx, -2);
-	duk_push_string(ctx, (src[0] == '#' && src[1] == '!') ? "//" : "");  /* Shebang support. */
-	duk_dup(ctx, -3);  /* source */
-	duk_push_string(ctx, "\n})");  /* Newline allows module last line to contain a // comment. */
-	duk_concat(ctx, 4);
+	duk_dup(ctx, -1);  /* source */
+	duk_module_node_wrap_source(ctx);
 
 	/* [ ... module source func_src ] */
 
 	(void) duk_get_prop_string(ctx, -3, "filename");
-	duk_compile(ctx, DUK_COMPILE_EVAL);
+
+	/* Let the optional compile callback do the compiling, so it can cache
+	 * the result; it gets [ func_src filename ] and returns the same kind
+	 * of function duk_compile() would.
+	 */
+	duk_push_global_stash(ctx);
+	if (duk_get_prop_string(ctx, -1, "\xff" "modCompile")) {
+		duk_insert(ctx, -4);  /* [ ... compile func_src filename stash ] */
+		duk_pop(ctx);
+		duk_call(ctx, 2);
+	} else {
+		duk_pop_2(ctx);
+		duk_compile(ctx, DUK_COMPILE_EVAL);
+	}
 	duk_call(ctx, 0);
 
 	/* [ ... module source func ] */
@@ -312,6 +335,12 @@ void duk_module_node_init(duk_context *ctx) {
 	duk_get_prop_string(ctx, options_idx, "load");
 	duk_require_function(ctx, -1);
 	duk_put_prop_string(ctx, -2, "\xff" "modLoad");
+	if (duk_get_prop_string(ctx, options_idx, "compile")) {
+		duk_require_function(ctx, -1);
+		duk_put_prop_string(ctx, -2, "\xff" "modCompile");
+	} else {
+		duk_pop(ctx);
+	}
 	duk_pop(ctx);
 
 	/* Stash main module. */
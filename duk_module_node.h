@@ -9,6 +9,7 @@ extern "C" {
 
 extern duk_ret_t duk_module_node_peval_main(duk_context *ctx, const char *path);
 extern void duk_module_node_init(duk_context *ctx);
+extern void duk_module_node_wrap_source(duk_context *ctx);
 
 #if defined(__cplusplus)
 }
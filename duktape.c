@@ -8759,6 +8759,17 @@ struct duk_heap {
 #endif
 #endif
 
+	/* Counts of heap elements freed by refcounting and by mark-and-sweep,
+	 * reported by duk_get_heap_info() (JavaScript::Duktape::XS addition).
+	 */
+	duk_size_t freed_refcount;
+	duk_size_t freed_markandsweep;
+
+	/* Bytecode instructions between executor interrupts; zero means
+	 * DUK_HTHREAD_INTCTR_DEFAULT (JavaScript::Duktape::XS addition).
+	 */
+	duk_int_t interrupt_interval;
+
 	/* Stats. */
 #if defined(DUK_USE_DEBUG)
 	duk_int_t stats_exec_opcodes;
@@ -48463,6 +48474,7 @@ DUK_LOCAL void duk__sweep_stringtable(duk_heap *heap, duk_size_t *out_count_keep
 				 * strings are enabled) and the struct itself.
 				 */
 				duk_free_hstring(heap, (duk_hstring *) h);
+				heap->freed_markandsweep++;
 
 				/* Don't update 'prev'; it should be last string kept. */
 			}
@@ -48636,6 +48648,7 @@ DUK_LOCAL void duk__sweep_heap(duk_heap *heap, duk_small_uint_t flags, duk_size_
 
 			/* Free object and all auxiliary (non-heap) allocs. */
 			duk_heap_free_heaphdr_raw(heap, curr);
+			heap->freed_markandsweep++;
 		}
 
 		curr = next;
@@ -50092,6 +50105,7 @@ DUK_LOCAL void duk__refcount_free_pending(duk_heap *heap) {
 		/* prev->next is intentionally not updated and is garbage. */
 
 		duk_free_hobject(heap, (duk_hobject *) curr);  /* Invalidates 'curr'. */
+		heap->freed_refcount++;
 
 		curr = prev;
 	} while (curr != NULL);
@@ -50242,6 +50256,7 @@ DUK_LOCAL DUK_INLINE void duk__refcount_refzero_hstring(duk_heap *heap, duk_hstr
 	duk_heap_strcache_string_remove(heap, str);
 	duk_heap_strtable_unlink(heap, str);
 	duk_free_hstring(heap, str);
+	heap->freed_refcount++;
 }
 
 /*
@@ -50256,6 +50271,7 @@ DUK_LOCAL DUK_INLINE void duk__refcount_refzero_hbuffer(duk_heap *heap, duk_hbuf
 
 	DUK_HEAP_REMOVE_FROM_HEAP_ALLOCATED(heap, (duk_heaphdr *) buf);
 	duk_free_hbuffer(heap, buf);
+	heap->freed_refcount++;
 }
 
 /*
@@ -73860,7 +73876,7 @@ DUK_LOCAL DUK__NOINLINE_PERF DUK_COLD duk_small_uint_t duk__executor_interrupt(d
 #endif
 
 	retval = DUK__INT_NOACTION;
-	ctr = DUK_HTHREAD_INTCTR_DEFAULT;
+	ctr = thr->heap->interrupt_interval > 0 ? thr->heap->interrupt_interval : DUK_HTHREAD_INTCTR_DEFAULT;
 
 	/*
 	 *  Avoid nested calls.  Concretely this happens during debugging, e.g.
@@ -95116,3 +95132,196 @@ DUK_INTERNAL duk_double_t duk_util_tinyrandom_get_double(duk_hthread *thr) {
 #undef DUK__RANDOM_XOROSHIRO128PLUS
 #undef DUK__RND_BIT
 #undef DUK__UPDATE_RND
+#line 1 "duk_heap_info.c"
+/*
+ *  Heap introspection (JavaScript::Duktape::XS addition).
+ *
+ *  Walks the heap allocated list, the finalize list and the string table
+ *  read-only, classifying every element and adding up the sizes of the
+ *  blocks it owns.  Block sizes come from a caller supplied function, as
+ *  the allocator is the only one that knows them.
+ */
+
+#include "duk_heap_info.h"
+
+DUK_LOCAL void duk__heap_info_add(duk_heap_info_entry *entry, duk_size_t bytes) {
+	entry->count++;
+	entry->bytes += bytes;
+}
+
+DUK_LOCAL duk_size_t duk__heap_info_block(duk_heap *heap, duk_heap_info_size_function size_func, void *ptr) {
+	return ptr ? size_func(heap->heap_udata, ptr) : 0;
+}
+
+DUK_LOCAL void duk__heap_info_heaphdr(duk_heap *heap, duk_heap_info *info, duk_heap_info_size_function size_func, duk_heaphdr *hdr) {
+	duk_size_t bytes = duk__heap_info_block(heap, size_func, (void *) hdr);
+
+	if (DUK_HEAPHDR_GET_TYPE(hdr) == DUK_HTYPE_BUFFER) {
+		duk_hbuffer *h = (duk_hbuffer *) hdr;
+		if (DUK_HBUFFER_HAS_DYNAMIC(h) && !DUK_HBUFFER_HAS_EXTERNAL(h)) {
+			bytes += duk__heap_info_block(heap, size_func, DUK_HBUFFER_DYNAMIC_GET_DATA_PTR(heap, (duk_hbuffer_dynamic *) h));
+		}
+		duk__heap_info_add(&info->buffers, bytes);
+	} else if (DUK_HEAPHDR_GET_TYPE(hdr) == DUK_HTYPE_OBJECT) {
+		duk_hobject *h = (duk_hobject *) hdr;
+		bytes += duk__heap_info_block(heap, size_func, DUK_HOBJECT_GET_PROPS(heap, h));
+		if (DUK_HOBJECT_IS_THREAD(h)) {
+			duk_hthread *t = (duk_hthread *) h;
+			duk_activation *act;
+			duk_catcher *cat;
+			bytes += duk__heap_info_block(heap, size_func, (void *) t->valstack);
+			for (act = t->callstack_curr; act != NULL; act = act->parent) {
+				bytes += duk__heap_info_block(heap, size_func, (void *) act);
+				for (cat = act->cat; cat != NULL; cat = cat->parent) {
+					bytes += duk__heap_info_block(heap, size_func, (void *) cat);
+				}
+			}
+			duk__heap_info_add(&info->threads, bytes);
+		} else if (DUK_HOBJECT_IS_BOUNDFUNC(h)) {
+			bytes += duk__heap_info_block(heap, size_func, (void *) ((duk_hboundfunc *) h)->args);
+			duk__heap_info_add(&info->functions, bytes);
+		} else if (DUK_HOBJECT_IS_COMPFUNC(h) || DUK_HOBJECT_IS_NATFUNC(h)) {
+			duk__heap_info_add(&info->functions, bytes);
+		} else {
+			duk__heap_info_add(&info->objects, bytes);
+		}
+	} else {
+		/* strings are not kept in the heap lists */
+		DUK_ASSERT(0);
+	}
+}
+
+DUK_EXTERNAL void duk_get_heap_info(duk_context *ctx, duk_heap_info *info, duk_heap_info_size_function size_func) {
+	duk_hthread *thr = (duk_hthread *) ctx;
+	duk_heap *heap;
+	duk_heaphdr *hdr;
+	duk_uint32_t i;
+
+	DUK_ASSERT_CTX_VALID(ctx);
+	heap = thr->heap;
+
+	DUK_MEMZERO(info, sizeof(*info));
+
+	for (hdr = heap->heap_allocated; hdr != NULL; hdr = DUK_HEAPHDR_GET_NEXT(heap, hdr)) {
+		duk__heap_info_heaphdr(heap, info, size_func, hdr);
+	}
+#if defined(DUK_USE_FINALIZER_SUPPORT)
+	for (hdr = heap->finalize_list; hdr != NULL; hdr = DUK_HEAPHDR_GET_NEXT(heap, hdr)) {
+		duk__heap_info_heaphdr(heap, info, size_func, hdr);
+		info->pending_finalize++;
+	}
+#endif
+
+	info->strtab_size = heap->st_size;
+	for (i = 0; i < heap->st_size; i++) {
+		duk_size_t chain = 0;
+		duk_hstring *h;
+#if defined(DUK_USE_STRTAB_PTRCOMP)
+		h = (duk_hstring *) DUK_USE_HEAPPTR_DEC16(heap->heap_udata, heap->strtable16[i]);
+#else
+		h = heap->strtable[i];
+#endif
+		for (; h != NULL; h = h->hdr.h_next) {
+			duk__heap_info_add(&info->strings, duk__heap_info_block(heap, size_func, (void *) h));
+			chain++;
+		}
+		if (chain > 0) {
+			info->strtab_used++;
+		}
+		if (chain > info->strtab_longest) {
+			info->strtab_longest = chain;
+		}
+	}
+
+	info->freed_refcount = heap->freed_refcount;
+	info->freed_markandsweep = heap->freed_markandsweep;
+}
+#line 1 "duk_callstack.c"
+/*
+ *  Call stack sampling (JavaScript::Duktape::XS addition).
+ *
+ *  Reads the activations of the currently running thread without touching
+ *  the value stack, calling any getters or allocating anything, so it is
+ *  safe to call from the executor interrupt (e.g. the exec timeout check).
+ */
+
+#include "duk_callstack.h"
+
+DUK_LOCAL void duk__callstack_string(duk_heap *heap, duk_hobject *obj, duk_hstring *key, const char **out_str, duk_size_t *out_len) {
+	duk_tval *tv;
+
+	*out_str = NULL;
+	*out_len = 0;
+	if (obj == NULL) {
+		return;
+	}
+	tv = duk_hobject_find_existing_entry_tval_ptr(heap, obj, key);
+	if (tv != NULL && DUK_TVAL_IS_STRING(tv)) {
+		duk_hstring *h = DUK_TVAL_GET_STRING(tv);
+		*out_str = (const char *) DUK_HSTRING_GET_DATA(h);
+		*out_len = (duk_size_t) DUK_HSTRING_GET_BYTELEN(h);
+	}
+}
+
+DUK_EXTERNAL duk_size_t duk_get_callstack(duk_context *ctx, duk_callstack_entry *entries, duk_size_t max_entries) {
+	duk_hthread *thr = (duk_hthread *) ctx;
+	duk_heap *heap = thr->heap;
+	duk_activation *act;
+	duk_size_t count = 0;
+
+	if (heap->curr_thread != NULL) {
+		thr = heap->curr_thread;
+	}
+
+	for (act = thr->callstack_curr; act != NULL && count < max_entries; act = act->parent) {
+		duk_callstack_entry *entry = &entries[count++];
+		duk_hobject *func = DUK_ACT_GET_FUNC(act);
+
+		duk__callstack_string(heap, func, DUK_HTHREAD_STRING_NAME(thr), &entry->name, &entry->name_len);
+		duk__callstack_string(heap, func, DUK_HTHREAD_STRING_FILE_NAME(thr), &entry->file, &entry->file_len);
+		entry->line = 0;
+		entry->native = func == NULL || !DUK_HOBJECT_IS_COMPFUNC(func);
+#if defined(DUK_USE_PC2LINE)
+		if (!entry->native) {
+			duk_tval *tv = duk_hobject_find_existing_entry_tval_ptr(heap, func, DUK_HTHREAD_STRING_INT_PC2LINE(thr));
+			if (tv != NULL && DUK_TVAL_IS_BUFFER(tv)) {
+				duk_hbuffer_fixed *pc2line = (duk_hbuffer_fixed *) DUK_TVAL_GET_BUFFER(tv);
+				entry->line = (duk_uint_t) duk__hobject_pc2line_query_raw(thr, pc2line, duk_hthread_get_act_prev_pc(thr, act));
+			}
+		}
+#endif
+	}
+	return count;
+}
+
+DUK_EXTERNAL void duk_set_interrupt_interval(duk_context *ctx, duk_int_t interval) {
+	duk_hthread *thr = (duk_hthread *) ctx;
+	thr->heap->interrupt_interval = interval;
+}
+#line 1 "duk_jx.c"
+/*
+ *  Native JX encoding (JavaScript::Duktape::XS addition).
+ *
+ *  Same as Duktape.enc('jx', value), for C code that wants to format values
+ *  without the overhead of calling a JS function.
+ */
+
+#include "duk_jx.h"
+
+DUK_EXTERNAL void duk_jx_encode(duk_context *ctx, duk_idx_t idx) {
+	duk_hthread *thr = (duk_hthread *) ctx;
+
+	idx = duk_require_normalize_index(thr, idx);
+#if defined(DUK_USE_JSON_SUPPORT) && defined(DUK_USE_JX)
+	duk_bi_json_stringify_helper(thr,
+	                             idx /*idx_value*/,
+	                             DUK_INVALID_INDEX /*idx_replacer*/,
+	                             DUK_INVALID_INDEX /*idx_space*/,
+	                             DUK_JSON_FLAG_EXT_CUSTOM |
+	                             DUK_JSON_FLAG_ASCII_ONLY |
+	                             DUK_JSON_FLAG_AVOID_KEY_QUOTES /*flags*/);
+#else
+	DUK_ERROR_UNSUPPORTED(thr);
+#endif
+	duk_replace(thr, idx);
+}
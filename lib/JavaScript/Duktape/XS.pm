@@ -11,6 +11,15 @@ XSLoader::load( __PACKAGE__, $VERSION );
 
 our @EXPORT_OK = qw[];
 
+# Each object owns a Duktape heap, which cannot be copied: when a new thread
+# is created, objects are not cloned into it and become undef there.
+sub CLONE_SKIP { 1 }
+
+package JavaScript::Duktape::XS::Workers;
+
+# Same for worker pools, which own their OS threads.
+sub CLONE_SKIP { 1 }
+
 1;
 __END__
 
@@ -36,6 +45,7 @@ Version 0.000073
         save_messages    => 1,
         max_memory_bytes => 256*1024,
         max_timeout_us   => 2*1_000_000,
+        arena_allocator  => 1,
     };
     my $vm = JavaScript::Duktape::XS->new($options);
 
@@ -101,16 +111,144 @@ hashref, where each key represents a "target" for the message (for example,
 C<stdout> or C<stderr>).  You can then retrieve the messages by calling
 C<get_msgs>.
 
+The messages are kept in a bounded buffer; when it fills up, the oldest
+messages are dropped.  See C<max_messages> and C<max_message_bytes>.
+
+=head3 max_messages
+
+When using C<save_messages>, keep at most this many messages; the default is
+10000.
+
+=head3 max_message_bytes
+
+When using C<save_messages>, keep at most this many bytes of messages; the
+default is 4 MB.  A single message longer than this is truncated.
+
+=head3 console_level
+
+Discard messages printed to the JavaScript console that are less severe than
+this level, which can be one of C<debug> (C<console.debug> and
+C<console.trace>), C<info> (C<console.log>, C<console.info> and
+C<console.dir>), C<warn> (C<console.warn>) or C<error> (C<console.error>,
+C<console.exception> and C<console.assert>).  Discarded messages are not even
+formatted, so they are very cheap.  By default, all messages are kept.
+Errors reported when running JavaScript code are never discarded.
+
+=head3 console_buffer_bytes
+
+Instead of writing and flushing each message printed to the JavaScript console
+as soon as it is generated, keep up to this many bytes of output for each
+target (C<stdout> and C<stderr>), and only write them out when the buffer
+fills up, when C<flush_console> is called or when the XS object is destroyed.
+The minimum size is 1 KB.  This saves a system call per message for scripts
+that log a lot.  This option has no effect when C<save_messages> is used.
+
+=head3 module_paths
+
+An arrayref of directories where JavaScript modules are looked up, resolving
+them natively; see L</MODULE SUPPORT>.
+
+=head3 module_bundle
+
+The path to a module bundle created with C<bin/js_bundle.pl>, from which
+modules are loaded before trying any other way; see L</MODULE SUPPORT>.
+
+=head3 module_cache
+
+Keep the bytecode for every module loaded with C<require> in a cache shared by
+all the VMs in the process, keyed by the module id and a hash of its source,
+so that each module is only compiled once; see L</MODULE SUPPORT>.
+
+=head3 module_cache_dir
+
+Like C<module_cache>, but also keep the bytecode in files in this directory,
+so that it can be reused by other processes.  Duktape trusts the bytecode it
+loads, so this directory must only be writable by trusted users.
+
+=head3 share_modules
+
+Like C<module_cache>, but once any VM in the process has loaded a module, use
+its bytecode for the same module id without even calling the loader, so the
+module source is not fetched again; see L</MODULE SUPPORT>.
+
 =head3 max_memory_bytes
 
 Limit the memory dynamically allocated to this many bytes.  If this option is
 not used, there is no limit in place.
 
+=head3 soft_memory_bytes
+
+When the memory dynamically allocated goes over this many bytes, force a full
+garbage collection (which also reclaims reference cycles) before letting the
+allocation go through.  This lets a VM run closer to C<max_memory_bytes>
+without failing allocations that only needed some garbage to be collected.
+If most of the heap survives the collection, the threshold is moved up
+temporarily, by at least half the size of the surviving heap, so that a heap
+that keeps growing is only collected a few times; it never goes over
+C<max_memory_bytes>, so a collection is still tried before hitting that.
+
 =head3 max_timeout_us
 
 Limit the execution runtime of any single JavaScript call to this many
 microseconds.  If this option is not used, there is no limit in place.
 
+=head3 max_cpu_time_us
+
+Limit the CPU time consumed by the current thread during any single JavaScript
+call to this many microseconds.  Unlike C<max_timeout_us>, time during which
+the process is not running does not count against this limit.  If this option
+is not used, there is no limit in place.
+
+=head3 max_instructions
+
+Limit the number of bytecode instructions executed during any single
+JavaScript call to this many.  The count is checked (and reported in the
+stats) in batches of 256K instructions, so the limit is approximate.  If this
+option is not used, there is no limit in place.
+
+When any of the execution limits is exceeded, the call fails with a
+C<RangeError: execution timeout>.
+
+=head3 idle_gc
+
+While the event loop is waiting for a timer to fire, run a light round of the
+garbage collector, with a C<budget_us> (see C<run_gc>) of half of the time it
+would otherwise sleep.  This only happens if the wait is at least 5 ms long,
+and there were some allocations since the previous time.
+
+=head3 profile_interval_us
+
+Turn on the sampling profiler: while JavaScript code runs, record the current
+call stack (function names, file names and line numbers) every this many
+microseconds.  You can then get the results by calling C<profile_report>.
+Note that this makes the VM check the time much more often, so only use it
+when you need it.
+
+=head3 timeout_watchdog
+
+When using C<max_timeout_us>, let a single background thread (shared by all
+VMs in the process) keep track of the deadlines, and flag each VM when its
+time is up.  The periodic timeout check in the VM then only has to read that
+flag, instead of getting the current time.
+
+=head3 arena_allocator
+
+Serve small allocations (up to 1 KB) from a per-VM arena with size classes,
+instead of going to the system allocator for each of them.  Duktape allocates
+huge numbers of tiny strings and property tables, so this is usually faster.
+Memory accounting for C<max_memory_bytes> stays exact.
+
+The arena owns every block allocated for the VM, so when the VM is destroyed
+or C<reset> is called, all its memory is released in bulk, instead of freeing
+each object individually; for big heaps this makes teardown much faster.
+Note that in this mode JavaScript finalizers are not run on teardown.
+
+=head3 arena_madvise
+
+When using C<arena_allocator>, calling C<reset> keeps the arena chunks mapped
+for reuse by the new heap, and gives their pages back to the OS with
+C<madvise(MADV_DONTNEED)>, instead of unmapping them.
+
 =head2 set
 
 Give a value to a given JavaScript variable or object slot.
@@ -169,6 +307,24 @@ method is invoked; in the future this might be split into separate functions.
 
 Any returned values will be treated in the same way as a call to C<get>.
 
+=head2 parallel_map
+
+    my $results = $vm->parallel_map('function(r) { return transform(r); }',
+                                    \@records, { threads => 8 });
+
+Call a JavaScript function, given as source code, on every element of an array,
+using a pool of worker threads (see L</WORKERS>), and return an arrayref with
+the results in the same order.  The function runs in the workers' own heaps,
+not in this VM, so it cannot use any globals or Perl callbacks set up here, and
+elements and results must be plain data.  Elements are sent to the workers in
+chunks; each chunk gets the C<max_timeout_us> of this VM.  If the function
+throws for any element, C<parallel_map> dies with that error.
+
+The options are C<threads> (by default, one per online CPU) and C<chunk_size>
+(by default, enough elements for about four chunks per thread).  Items and
+results are converted to and from JSON in the calling thread, so this pays off
+when the function does more work per element than that conversion.
+
 =head2 dispatch_function_in_event_loop
 
 Run a JavaScript function inside an event loop, and wait until all timers have
@@ -184,29 +340,235 @@ of JavaScript code:
 Return a hashref with the statistics gathered as a result of creating the XS
 object with option C<gather_stats> set to true.
 
+There is one entry for each kind of operation (C<compile>, C<run>, C<get>,
+etc.), with the latency figures for all the times that operation was run:
+
+=over 4
+
+=item * C<count>: how many times the operation was run.
+
+=item * C<sum_us>, C<min_us>, C<max_us> and C<mean_us>: total, minimum,
+maximum and average elapsed time, in microseconds.
+
+=item * C<p50_us>, C<p90_us> and C<p99_us>: elapsed time under which 50%, 90%
+and 99% of the operations finished, in microseconds; these come from the
+histogram, so they are accurate to within 25%.
+
+=item * C<histogram>: a hashref where each key is the upper limit of a bucket,
+in microseconds, and each value the number of operations in that bucket (only
+non-empty buckets are present).  Each power of two is split into four buckets.
+
+=back
+
+And these values for the last such operation:
+
+=over 4
+
+=item * C<elapsed_us>: elapsed wall-clock time, in microseconds.
+
+=item * C<cpu_us>: CPU time used by the current thread, in microseconds.
+
+=item * C<instructions>: bytecode instructions executed, counted in batches
+of 256K instructions.
+
+=item * C<allocated_bytes>: bytes allocated by the JavaScript heap.
+
+=item * C<freed_bytes>: bytes freed by the JavaScript heap.
+
+=item * C<allocations>: number of allocations performed.
+
+=item * C<live_bytes>: bytes in use by the JavaScript heap when the operation
+finished.
+
+=item * C<peak_bytes>: maximum bytes in use by the JavaScript heap at any time
+during the operation.
+
+=item * C<gc_forced>: garbage collections forced by C<soft_memory_bytes>.
+
+=item * C<gc_reclaimed_bytes>: bytes reclaimed by those collections.
+
+=item * C<memory_bytes>: same as C<allocated_bytes>, kept for backwards
+compatibility.
+
+=back
+
+There is also a C<gc> entry, with figures for all the garbage collection
+rounds run by C<run_gc> or the C<idle_gc> option since the stats were reset:
+C<runs>, C<idle_runs>, C<pause_total_us>, C<pause_max_us> and
+C<pause_histogram>, an arrayref where element N counts pauses lasting between
+2^N and 2^(N+1) microseconds.
+
+And a C<boundary> entry, with the traffic between Perl and JavaScript since the
+stats were reset: C<callbacks> (calls from JavaScript into Perl callbacks),
+C<entries> (calls from Perl into JavaScript, such as C<eval>, C<get> or
+C<set>), C<values_to_perl> and C<values_to_js> (values converted in each
+direction, counting every nested element), C<bytes_to_perl> and C<bytes_to_js>
+(string and hash key bytes converted in each direction), and
+C<convert_to_perl_us> and C<convert_to_js_us> (time spent converting, in
+microseconds).  A high count of callbacks or values converted usually points
+to a chatty interface between both languages.
+
+Perl callbacks registered with C<set> get timed as well; there is a
+C<callbacks> entry, with one hashref per callback that was called, keyed by the
+name it was set under, containing C<calls>, C<total_us> (total time spent in
+the callback, in microseconds) and C<self_us> (the same, but excluding the time
+spent in other callbacks called from it).  Callbacks nested inside a data
+structure passed to C<set> are not timed.
+
+With the C<module_cache> or C<module_cache_dir> options, there is a
+C<module_cache> entry, with the number of modules found in memory (C<hits>),
+found on disk (C<disk_hits>), found precompiled in the C<module_bundle>
+(C<bundle_hits>), run without calling the loader because of C<share_modules>
+(C<shared_hits>) and compiled (C<misses>).
+
+All memory figures come from the VM's own allocator, so gathering them is
+cheap and they only reflect the JavaScript heap, not the whole process.
+
+All these figures are kept in C structures while the VM runs, and only turned
+into Perl data when C<get_stats> is called.
+
+=head2 get_stats_raw
+
+Return the main statistics packed in a string, as native doubles, without
+creating any other Perl data; this is meant for cheap periodic scraping.  The
+first value is the version of the layout (currently 1); then come the
+C<count>, C<sum_us>, C<min_us>, C<max_us>, C<p50_us>, C<p90_us> and C<p99_us>
+figures for each kind of operation, and the C<gc> and C<boundary> counters.
+Use C<get_stats_raw_names> to know what each value is:
+
+    my $names = $vm->get_stats_raw_names();
+    my %stats;
+    @stats{@$names} = unpack('d*', $vm->get_stats_raw());
+    print $stats{'run.p99_us'}, "\n";
+
+Operations that were never run have all their figures set to zero.
+
+=head2 get_stats_raw_names
+
+Return an arrayref with the names of the values packed by C<get_stats_raw>,
+such as C<version>, C<run.count> or C<boundary.callbacks>.
+
 =head2 reset_stats
 
 Reset the accumulated statistics, as if the XS object had just been created.
 
+=head2 flush_console
+
+Write out any console output kept because of option C<console_buffer_bytes>.
+
 =head2 get_msgs
 
 Return a hashref with the messages collected as a result of creating the XS
 object with option C<save_messages> set to true.
 
+=head2 get_msgs_detailed
+
+Return a hashref with the messages collected as a result of creating the XS
+object with option C<save_messages> set to true, with more details than
+C<get_msgs>: C<messages> is an arrayref with one hashref for each message, in
+the order they were generated, with keys C<target> (C<stdout> or C<stderr>),
+C<level> (C<debug>, C<info>, C<warn> or C<error>), C<time> (when the message
+was generated, in seconds since the epoch, with decimals) and C<message>; and
+C<dropped> is the number of messages that were discarded because the buffer
+was full.
+
 =head2 reset_msgs
 
 Reset the accumulated messages, as if the XS object had just been created.
 
+=head2 compile_module
+
+Compile the source for a module with the given id, and return the code in the
+format stored in module bundles.  This is used by C<bin/js_bundle.pl>; the code
+can only be loaded by the same version of this module.
+
+=head2 clear_module_cache
+
+Forget the bytecode for all the modules cached in the process by the
+C<module_cache> and C<share_modules> options.  It can be called as a class
+method.
+
 =head2 global_objects
 
 Get an arrayref with the names of all global objects known to JavaScript.
 
 =head2 run_gc
 
-Run at least one round of the JavaScript garbage collector, and return the
-number of rounds that were effectively run.
+Run the JavaScript garbage collector, and return the number of rounds that
+were effectively run; this is at least one, unless C<budget_us> is given.  You can give an optional hashref
+with these options:
+
+=over 4
+
+=item * C<mode>: C<full> (the default) runs two compacting rounds, as the
+Duktape documentation recommends, so that objects with finalizers are also
+freed; C<light> runs a single round without compaction, which gives the
+shortest pause; C<compact> runs a single round with compaction.
+
+=item * C<budget_us>: do not start a round if it would probably take the total
+time over this many microseconds.  Rounds cannot be interrupted, so this is a
+guess, based on the rounds already run or, for the first one, on how long the
+last round in the same mode took; with a budget smaller than that, no rounds
+are run at all.
+
+=back
+
+    my $rounds = $vm->run_gc({ mode => 'light' });
+
+=head2 profile_report
+
+Return a string with the results of the sampling profiler (see option
+C<profile_interval_us>).  There is one line for each distinct call stack that
+was sampled, from the outermost to the innermost function, followed by the
+number of samples for that stack:
 
-The documentation recommends to run two rounds, so that's what we always do.
+    global (busy.js:13);busy (busy.js:8);fib (busy.js:3) 42
+
+This is the "folded stacks" format, which can be fed directly to flame graph
+tools such as C<flamegraph.pl>.
+
+=head2 reset_profile
+
+Forget all the samples taken so far by the profiler.
+
+=head2 heap_info
+
+Walk the JavaScript heap and return a hashref describing what is in it,
+without running the garbage collector:
+
+=over 4
+
+=item * C<objects>, C<functions>, C<threads>, C<strings> and C<buffers>: a
+hashref with the C<count> of elements of that type and the C<bytes> they use,
+including the memory they own (property tables, value stacks, buffer data).
+
+=item * C<string_table>: the C<size> of the string intern table, the number
+of buckets C<used>, the C<longest_chain> in a bucket and the C<load_factor>.
+
+=item * C<freed>: how many elements have been freed since the heap was created
+because their C<refcount> dropped to zero, and how many by
+C<mark_and_sweep> (for example, reference cycles).
+
+=item * C<pending_finalize>: objects waiting for their finalizer to run.
+
+=item * C<total_bytes>: all the memory allocated by the heap, and
+C<other_bytes>, the part of it not used by any of the elements above.
+
+=back
+
+=head1 EVENT LOOP
+
+Every call to C<eval> runs the requested code and then an event loop, which
+only returns once there is nothing left to do.  The usual timer functions
+C<setTimeout>, C<clearTimeout>, C<setInterval> and C<clearInterval> are
+available.
+
+There is also a native job (microtask) queue, exposed as C<queueMicrotask>.
+Queued jobs are always run to completion before any timer is expired, and
+again after each timer callback, so they never wait on a timer or a poll.
+A C<Promise> implementation using this queue is also provided, with
+C<then>, C<catch>, C<finally>, C<Promise.resolve>, C<Promise.reject>,
+C<Promise.all> and C<Promise.race>.
 
 =head1 MODULE SUPPORT
 
@@ -220,6 +582,114 @@ Please see
 L<https://github.com/svaarala/duktape/tree/master/extras/module-node> for more
 details.
 
+Alternatively, modules can be found and loaded from disk without calling into
+Perl, by passing the directories to search with the C<module_paths> option:
+
+    my $vm = JavaScript::Duktape::XS->new({ module_paths => [ 'js/lib', 'js/vendor' ] });
+
+Ids starting with C<./>, C<../> or C</> are resolved relative to the requiring
+module; other ids are looked up in each directory, in order.  For each
+candidate C<X>, the files C<X>, C<X.js> and C<X.json> are tried, and if C<X> is
+a directory, the file named by the C<main> field in C<X/package.json>,
+C<X/index.js> and C<X/index.json>.  JSON files are exported as the decoded
+value.  The result of every filesystem lookup, including the failed ones, is
+cached for the lifetime of the object, so files created after a lookup will not
+be seen.  If a module cannot be found this way and the Perl callbacks above are
+also set, they are used as a fallback.
+
+However modules are loaded, compiling them can take a big part of the time
+spent setting up a new VM.  With the C<module_cache> option, the compiled
+bytecode for each module is kept in memory and shared by all the VMs in the
+process that use the option; a module is compiled again only when its source
+changes.  With the C<module_cache_dir> option, the bytecode is also saved in
+files in that directory, and reused by later processes.
+
+The cache still calls the loader for each module, to check whether its source
+has changed.  If modules do not change while the process runs, the
+C<share_modules> option skips that: when a VM requires a module whose id
+(as returned by the resolver) is already in the cache, its bytecode is run
+directly.  Call C<clear_module_cache> to pick up new versions of the modules.
+
+Finally, a whole tree of modules can be packed into a single bundle file, which
+is mapped into memory by each VM created with the C<module_bundle> option:
+
+    perl bin/js_bundle.pl --bytecode --output modules.bundle js/lib
+    my $vm = JavaScript::Duktape::XS->new({ module_bundle => 'modules.bundle' });
+
+Every C<.js> and C<.json> file under the given directories becomes a module,
+with its path relative to that directory as the id, and is resolved the same
+way as with C<module_paths>, except that C<package.json> files are not used.
+With C<--bytecode>, the modules are also compiled when creating the bundle, and
+the compiled code is used as long as the bundle is loaded by the same version
+of this module; otherwise the source is compiled as usual.  Modules not found
+in the bundle are looked up with C<module_paths> or the Perl callbacks.
+
+=head1 THREADS
+
+Each object keeps all its state, including its timers and pending jobs, in its
+own Duktape heap, so different objects can be used at the same time from
+different threads.  A single object must only be used from the thread that
+created it; objects are not cloned into new Perl threads, where they become
+undefined.  The module caches and the C<timeout_watchdog> thread are shared by
+the whole process, and protected by locks.
+
+=head1 WORKERS
+
+Pure JavaScript work can be moved off the calling thread with a pool of worker
+threads, each one running its own Duktape heap:
+
+    my $workers = JavaScript::Duktape::XS::Workers->new({
+        threads => 4,
+        source  => 'function onmessage(doc) { return render(doc); } ...',
+    });
+    my $id = $workers->post({ text => $markdown });
+    ...
+    foreach my $done ($workers->poll()) {
+        # $done->{id}, and $done->{result} or $done->{error}
+    }
+
+Every worker evaluates C<source> once, and then calls the global function named
+by C<handler> (by default C<onmessage>) with each message posted, returning its
+result.  Messages and results are passed as JSON, so they must be plain data;
+an C<undefined> result comes back as C<undef>.  Workers never call into Perl,
+and only have what Duktape itself provides: there is no console, no timers and
+no C<require>.  If C<source> throws, every job fails with that error.
+
+The options for C<new> are C<source>, C<handler>, C<threads> (by default, one
+per online CPU) and C<max_timeout_us>, which limits the time each job can run.
+
+=head2 post
+
+Queue a message for the workers, and return its id; ids start at 1 and are
+unique for each pool.  Messages are run in the order they are posted, but with
+more than one thread, they can finish in any order.
+
+=head2 poll
+
+Return the jobs finished so far, without waiting, as a list of hashrefs with
+the C<id> of the message and its C<result>, or an C<error> message.
+
+=head2 wait_results
+
+Like C<poll>, but if no jobs have finished yet, wait for at least one, up to the
+given number of microseconds, or forever if not given.  Returns at once if
+there is nothing pending.
+
+=head2 pending
+
+Return the number of messages posted whose results have not been collected.
+
+=head2 fd
+
+Return a file descriptor that becomes readable when jobs finish, to watch with
+C<select> or an event loop before calling C<poll>.  It belongs to the pool, so
+do not close it.
+
+When the pool is destroyed, queued messages are dropped and it waits for the
+jobs already running to finish.  The worker threads only exist in the process
+that created the pool: in a forked child, using the pool dies, and destroying
+it just releases its memory and file descriptors.
+
 =head1 SEE ALSO
 
 =over 4
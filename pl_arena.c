@@ -0,0 +1,289 @@
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "pl_arena.h"
+
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+/*
+ * Size classes are 16 bytes apart up to 128 bytes, and then four classes for
+ * each power of two up to PL_ARENA_MAX_BLOCK_BYTES; this keeps the internal
+ * waste for any block under 25%.
+ */
+#define ARENA_CLASS_COUNT 20
+
+static const size_t arena_class_bytes[ARENA_CLASS_COUNT] = {
+      16,   32,   48,   64,   80,   96,  112,  128,
+     160,  192,  224,  256,
+     320,  384,  448,  512,
+     640,  768,  896, 1024,
+};
+
+/*
+ * Each chunk starts with this header; it is padded so that the blocks carved
+ * out of the chunk keep the same alignment malloc() would give us.
+ */
+typedef struct ArenaChunk {
+    union {
+        struct ArenaChunk* next;
+        double d;
+        char pad[16];
+    } u;
+} ArenaChunk;
+
+/* A free block stores the pointer to the next free block of its class */
+typedef struct ArenaBlock {
+    struct ArenaBlock* next;
+} ArenaBlock;
+
+/*
+ * Large blocks are allocated individually, with this header in front of them,
+ * and kept in a doubly linked list so that they can be released in bulk.
+ */
+typedef struct ArenaLarge {
+    union {
+        struct {
+            struct ArenaLarge* prev;
+            struct ArenaLarge* next;
+        } l;
+        double d;
+        char pad[16];
+    } u;
+} ArenaLarge;
+
+struct Arena {
+    ArenaChunk* chunks;
+    ArenaChunk* spare_chunks;
+    ArenaLarge* large;
+    char* bump_ptr;
+    char* bump_end;
+    ArenaBlock* free_list[ARENA_CLASS_COUNT];
+    size_t chunk_bytes;
+    size_t large_bytes;
+    size_t used_bytes;
+};
+
+static int arena_class(size_t size)
+{
+    if (size <= 128) {
+        return size <= 16 ? 0 : (int) ((size + 15) / 16) - 1;
+    }
+    if (size <= 256) {
+        return  8 + (int) ((size - 128 + 31) / 32) - 1;
+    }
+    if (size <= 512) {
+        return 12 + (int) ((size - 256 + 63) / 64) - 1;
+    }
+    return 16 + (int) ((size - 512 + 127) / 128) - 1;
+}
+
+static int arena_add_chunk(Arena* arena)
+{
+    ArenaChunk* chunk = arena->spare_chunks;
+    if (chunk) {
+        arena->spare_chunks = chunk->u.next;
+    } else {
+        void* mem = mmap(0, PL_ARENA_CHUNK_BYTES, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mem == MAP_FAILED) {
+            return 0;
+        }
+        chunk = (ArenaChunk*) mem;
+        arena->chunk_bytes += PL_ARENA_CHUNK_BYTES;
+    }
+    chunk->u.next = arena->chunks;
+    arena->chunks = chunk;
+    arena->bump_ptr = (char*) (chunk + 1);
+    arena->bump_end = (char*) chunk + PL_ARENA_CHUNK_BYTES;
+    return 1;
+}
+
+static void arena_unmap_chunks(Arena* arena, ArenaChunk* chunk)
+{
+    while (chunk) {
+        ArenaChunk* next = chunk->u.next;
+        munmap((void*) chunk, PL_ARENA_CHUNK_BYTES);
+        arena->chunk_bytes -= PL_ARENA_CHUNK_BYTES;
+        chunk = next;
+    }
+}
+
+static void* arena_alloc_large(Arena* arena, size_t size)
+{
+    ArenaLarge* large = (ArenaLarge*) malloc(size + sizeof(ArenaLarge));
+    if (!large) {
+        return 0;
+    }
+    large->u.l.prev = 0;
+    large->u.l.next = arena->large;
+    if (arena->large) {
+        arena->large->u.l.prev = large;
+    }
+    arena->large = large;
+    arena->large_bytes += size;
+    arena->used_bytes += size;
+    return (void*) (large + 1);
+}
+
+static void arena_unlink_large(Arena* arena, ArenaLarge* large)
+{
+    if (large->u.l.prev) {
+        large->u.l.prev->u.l.next = large->u.l.next;
+    } else {
+        arena->large = large->u.l.next;
+    }
+    if (large->u.l.next) {
+        large->u.l.next->u.l.prev = large->u.l.prev;
+    }
+}
+
+static void arena_link_moved_large(Arena* arena, ArenaLarge* large)
+{
+    if (large->u.l.prev) {
+        large->u.l.prev->u.l.next = large;
+    } else {
+        arena->large = large;
+    }
+    if (large->u.l.next) {
+        large->u.l.next->u.l.prev = large;
+    }
+}
+
+Arena* pl_arena_create(void)
+{
+    Arena* arena = (Arena*) malloc(sizeof(Arena));
+    if (!arena) {
+        return 0;
+    }
+    memset(arena, 0, sizeof(Arena));
+    return arena;
+}
+
+void pl_arena_destroy(Arena* arena)
+{
+    if (!arena) {
+        return;
+    }
+    pl_arena_release(arena, 0);
+    arena_unmap_chunks(arena, arena->spare_chunks);
+    free(arena);
+}
+
+void pl_arena_release(Arena* arena, int keep_chunks)
+{
+    while (arena->large) {
+        ArenaLarge* large = arena->large;
+        arena->large = large->u.l.next;
+        free((void*) large);
+    }
+
+    if (keep_chunks) {
+        while (arena->chunks) {
+            ArenaChunk* chunk = arena->chunks;
+            arena->chunks = chunk->u.next;
+            madvise((void*) chunk, PL_ARENA_CHUNK_BYTES, MADV_DONTNEED);
+            chunk->u.next = arena->spare_chunks;
+            arena->spare_chunks = chunk;
+        }
+    } else {
+        arena_unmap_chunks(arena, arena->chunks);
+        arena->chunks = 0;
+    }
+
+    memset(arena->free_list, 0, sizeof(arena->free_list));
+    arena->bump_ptr = arena->bump_end = 0;
+    arena->large_bytes = 0;
+    arena->used_bytes = 0;
+}
+
+void* pl_arena_alloc(Arena* arena, size_t size)
+{
+    int cls = 0;
+    size_t bytes = 0;
+    ArenaBlock* block = 0;
+
+    if (size > PL_ARENA_MAX_BLOCK_BYTES) {
+        return arena_alloc_large(arena, size);
+    }
+
+    cls = arena_class(size);
+    bytes = arena_class_bytes[cls];
+    block = arena->free_list[cls];
+
+    if (block) {
+        arena->free_list[cls] = block->next;
+    } else {
+        if (arena->bump_ptr + bytes > arena->bump_end && !arena_add_chunk(arena)) {
+            return 0;
+        }
+        block = (ArenaBlock*) arena->bump_ptr;
+        arena->bump_ptr += bytes;
+    }
+    arena->used_bytes += bytes;
+    return block;
+}
+
+void* pl_arena_realloc(Arena* arena, void* ptr, size_t old_size, size_t new_size)
+{
+    void* t = 0;
+
+    if (old_size > PL_ARENA_MAX_BLOCK_BYTES && new_size > PL_ARENA_MAX_BLOCK_BYTES) {
+        ArenaLarge* large = (ArenaLarge*) ptr - 1;
+        large = (ArenaLarge*) realloc((void*) large, new_size + sizeof(ArenaLarge));
+        if (!large) {
+            return 0;
+        }
+        arena_link_moved_large(arena, large);
+        arena->large_bytes = arena->large_bytes - old_size + new_size;
+        arena->used_bytes = arena->used_bytes - old_size + new_size;
+        return (void*) (large + 1);
+    }
+
+    /* small block that still fits in its size class: nothing to do */
+    if (old_size <= PL_ARENA_MAX_BLOCK_BYTES && new_size <= PL_ARENA_MAX_BLOCK_BYTES &&
+        arena_class(old_size) == arena_class(new_size)) {
+        return ptr;
+    }
+
+    /* block moves between size classes, or between small and large */
+    t = pl_arena_alloc(arena, new_size);
+    if (!t) {
+        return 0;
+    }
+    memcpy(t, ptr, old_size < new_size ? old_size : new_size);
+    pl_arena_free(arena, ptr, old_size);
+    return t;
+}
+
+void pl_arena_free(Arena* arena, void* ptr, size_t size)
+{
+    int cls = 0;
+    ArenaBlock* block = 0;
+
+    if (size > PL_ARENA_MAX_BLOCK_BYTES) {
+        ArenaLarge* large = (ArenaLarge*) ptr - 1;
+        arena_unlink_large(arena, large);
+        free((void*) large);
+        arena->large_bytes -= size;
+        arena->used_bytes -= size;
+        return;
+    }
+
+    cls = arena_class(size);
+    block = (ArenaBlock*) ptr;
+    block->next = arena->free_list[cls];
+    arena->free_list[cls] = block;
+    arena->used_bytes -= arena_class_bytes[cls];
+}
+
+size_t pl_arena_reserved_bytes(Arena* arena)
+{
+    return arena->chunk_bytes + arena->large_bytes;
+}
+
+size_t pl_arena_used_bytes(Arena* arena)
+{
+    return arena->used_bytes;
+}
@@ -0,0 +1,43 @@
+#ifndef PL_ARENA_H
+#define PL_ARENA_H
+
+#include <stddef.h>
+
+/*
+ * A per-VM arena that owns every block allocated for a VM.
+ *
+ * Small blocks are carved out of large chunks in a fixed set of size classes;
+ * freed blocks go into a free list for their size class and are reused by
+ * later allocations of the same class.  Blocks bigger than
+ * PL_ARENA_MAX_BLOCK_BYTES are allocated individually, but the arena keeps
+ * track of them too.
+ *
+ * Because the arena knows about all blocks, the whole VM can be thrown away
+ * in one go with pl_arena_release(), which is O(chunks) instead of O(objects).
+ */
+
+#define PL_ARENA_MAX_BLOCK_BYTES   1024
+#define PL_ARENA_CHUNK_BYTES       (64 * 1024)
+
+typedef struct Arena Arena;
+
+Arena* pl_arena_create(void);
+void pl_arena_destroy(Arena* arena);
+
+/* Allocate / resize / free a block that can hold at least size bytes */
+void* pl_arena_alloc(Arena* arena, size_t size);
+void* pl_arena_realloc(Arena* arena, void* ptr, size_t old_size, size_t new_size);
+void pl_arena_free(Arena* arena, void* ptr, size_t size);
+
+/*
+ * Release all blocks at once.  With keep_chunks, chunks are given back to the
+ * OS with madvise(MADV_DONTNEED) but stay mapped, to be reused by the arena;
+ * otherwise they are unmapped.
+ */
+void pl_arena_release(Arena* arena, int keep_chunks);
+
+/* Total bytes reserved in chunks, and bytes currently handed out in blocks */
+size_t pl_arena_reserved_bytes(Arena* arena);
+size_t pl_arena_used_bytes(Arena* arena);
+
+#endif
@@ -0,0 +1,284 @@
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "duk_module_node.h"
+#include "pl_bytecode.h"
+#include "pl_resolver.h"
+#include "pl_bundle.h"
+
+#define BUNDLE_MAGIC        "PLDUKBN1"
+#define BUNDLE_PATH_MAX     4096
+
+typedef struct BundleHeader {
+    char magic[8];
+    uint32_t count;
+    uint32_t reserved;
+} BundleHeader;
+
+typedef struct BundleEntry {
+    uint32_t id_offset;
+    uint32_t id_length;
+    uint32_t source_offset;
+    uint32_t source_length;
+    uint32_t code_offset;
+    uint32_t code_length;
+} BundleEntry;
+
+/* What goes before the bytecode in the code for a module */
+typedef struct BundleCode {
+    uint64_t version;
+    uint64_t source_hash;
+} BundleCode;
+
+struct Bundle {
+    const char* data;
+    size_t size;
+    const BundleEntry* entries;
+    uint32_t count;
+};
+
+static int valid_range(Bundle* bundle, uint32_t offset, uint32_t length)
+{
+    return offset <= bundle->size && length <= bundle->size - offset;
+}
+
+static int compare_id(Bundle* bundle, const BundleEntry* entry, const char* id, size_t len)
+{
+    size_t min = entry->id_length < len ? entry->id_length : len;
+    int cmp = memcmp(bundle->data + entry->id_offset, id, min);
+    if (cmp) {
+        return cmp;
+    }
+    return entry->id_length < len ? -1 : entry->id_length > len ? 1 : 0;
+}
+
+static const BundleEntry* find_entry(Bundle* bundle, const char* id)
+{
+    size_t len = strlen(id);
+    uint32_t lo = 0;
+    uint32_t hi = bundle->count;
+
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        int cmp = compare_id(bundle, &bundle->entries[mid], id, len);
+        if (cmp == 0) {
+            return &bundle->entries[mid];
+        }
+        if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return 0;
+}
+
+static int validate(Bundle* bundle)
+{
+    const BundleHeader* header = (const BundleHeader*) bundle->data;
+    uint32_t j = 0;
+
+    if (bundle->size < sizeof(BundleHeader) ||
+        memcmp(header->magic, BUNDLE_MAGIC, sizeof(header->magic)) != 0 ||
+        header->count > (bundle->size - sizeof(BundleHeader)) / sizeof(BundleEntry)) {
+        return 0;
+    }
+    bundle->count = header->count;
+    bundle->entries = (const BundleEntry*) (bundle->data + sizeof(BundleHeader));
+
+    for (j = 0; j < bundle->count; ++j) {
+        const BundleEntry* entry = &bundle->entries[j];
+        if (!valid_range(bundle, entry->id_offset, entry->id_length) ||
+            !valid_range(bundle, entry->source_offset, entry->source_length) ||
+            !valid_range(bundle, entry->code_offset, entry->code_length)) {
+            return 0;
+        }
+        if (memchr(bundle->data + entry->id_offset, '\0', entry->id_length)) {
+            return 0;
+        }
+        if (j > 0) {
+            const BundleEntry* prev = &bundle->entries[j - 1];
+            size_t min = prev->id_length < entry->id_length ? prev->id_length : entry->id_length;
+            int cmp = memcmp(bundle->data + prev->id_offset, bundle->data + entry->id_offset, min);
+            if (cmp > 0 || (cmp == 0 && prev->id_length >= entry->id_length)) {
+                return 0;  /* not sorted, or duplicated */
+            }
+        }
+    }
+    return 1;
+}
+
+Bundle* pl_bundle_open(const char* path)
+{
+    Bundle* bundle = 0;
+    struct stat st;
+    void* data = 0;
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0) {
+        return 0;
+    }
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return 0;
+    }
+    data = mmap(0, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return 0;
+    }
+
+    bundle = (Bundle*) calloc(1, sizeof(Bundle));
+    if (!bundle) {
+        munmap(data, st.st_size);
+        return 0;
+    }
+    bundle->data = (const char*) data;
+    bundle->size = st.st_size;
+    if (!validate(bundle)) {
+        pl_bundle_close(bundle);
+        return 0;
+    }
+    return bundle;
+}
+
+void pl_bundle_close(Bundle* bundle)
+{
+    if (!bundle) {
+        return;
+    }
+    munmap((void*) bundle->data, bundle->size);
+    free(bundle);
+}
+
+static const char* candidate_suffixes[] = { "", ".js", ".json", "/index.js", "/index.json", 0 };
+
+int pl_bundle_resolve(Bundle* bundle, duk_context* ctx, const char* requested, const char* parent)
+{
+    char base[BUNDLE_PATH_MAX];
+    char path[BUNDLE_PATH_MAX];
+    int j = 0;
+
+    base[0] = '\0';
+    if (strncmp(requested, "./", 2) == 0 || strncmp(requested, "../", 3) == 0) {
+        /* relative to the directory of the requiring module, if it is ours */
+        const char* slash = 0;
+        if (!parent || !parent[0]) {
+            parent = "";  /* top level: relative to the root of the bundle */
+        } else if (!find_entry(bundle, parent)) {
+            return 0;
+        }
+        slash = strrchr(parent, '/');
+        if (slash) {
+            size_t len = slash - parent;
+            if (len >= sizeof(base)) {
+                return 0;
+            }
+            memcpy(base, parent, len);
+            base[len] = '\0';
+        }
+    } else if (requested[0] == '/') {
+        return 0;
+    }
+    if (!pl_resolver_normalize(path, sizeof(path), base, requested)) {
+        return 0;
+    }
+
+    for (j = 0; candidate_suffixes[j]; ++j) {
+        char candidate[BUNDLE_PATH_MAX];
+        const BundleEntry* entry = 0;
+        int written = snprintf(candidate, sizeof(candidate), "%s%s", path, candidate_suffixes[j]);
+        if (written < 0 || (size_t) written >= sizeof(candidate)) {
+            continue;
+        }
+        entry = find_entry(bundle, candidate);
+        if (entry) {
+            duk_push_lstring(ctx, bundle->data + entry->id_offset, entry->id_length);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int pl_bundle_load(Bundle* bundle, duk_context* ctx, const char* id)
+{
+    const BundleEntry* entry = find_entry(bundle, id);
+    if (!entry) {
+        return 0;
+    }
+    duk_push_lstring(ctx, bundle->data + entry->source_offset, entry->source_length);
+    return 1;
+}
+
+int pl_bundle_push_code(Bundle* bundle, duk_context* ctx, const char* id, uint64_t source_hash)
+{
+    const BundleEntry* entry = find_entry(bundle, id);
+    BundleCode code;
+
+    if (!entry || entry->code_length <= sizeof(BundleCode)) {
+        return 0;
+    }
+    memcpy(&code, bundle->data + entry->code_offset, sizeof(BundleCode));
+    if (code.version != DUK_VERSION || code.source_hash != source_hash) {
+        return 0;  /* built for another Duktape, or for another source */
+    }
+    pl_bytecode_push(ctx, bundle->data + entry->code_offset + sizeof(BundleCode),
+                     entry->code_length - sizeof(BundleCode));
+    return 1;
+}
+
+static duk_ret_t compile_module(duk_context* ctx, void* udata)
+{
+    BundleCode code;
+    duk_size_t len = 0;
+    const char* func_src = 0;
+    void* data = 0;
+    duk_size_t size = 0;
+    char* buf = 0;
+
+    /* [ ... source id ] */
+    (void) udata;
+
+    duk_dup(ctx, -2);
+    duk_module_node_wrap_source(ctx);
+    func_src = duk_get_lstring(ctx, -1, &len);
+    code.version = DUK_VERSION;
+    code.source_hash = pl_bytecode_hash(func_src, len);
+
+    /* [ ... source id func_src ] */
+
+    duk_dup(ctx, -2);
+    duk_compile(ctx, DUK_COMPILE_EVAL);
+    duk_dump_function(ctx);
+    data = duk_get_buffer(ctx, -1, &size);
+
+    buf = (char*) duk_push_fixed_buffer(ctx, sizeof(BundleCode) + size);
+    memcpy(buf, &code, sizeof(BundleCode));
+    memcpy(buf + sizeof(BundleCode), data, size);
+    return 1;
+}
+
+SV* pl_bundle_compile(pTHX_ Duk* duk, const char* id, SV* source)
+{
+    duk_context* ctx = duk->ctx;
+    STRLEN len = 0;
+    const char* src = SvPV(source, len);
+    duk_int_t rc = 0;
+    void* data = 0;
+    duk_size_t size = 0;
+    SV* ret = 0;
+
+    duk_push_lstring(ctx, src, len);
+    duk_push_string(ctx, id);
+    rc = duk_safe_call(ctx, compile_module, 0, 2 /*nargs*/, 1 /*nrets*/);
+    if (rc != DUK_EXEC_SUCCESS) {
+        croak("Could not compile module %s: %s\n", id, duk_safe_to_string(ctx, -1));
+    }
+    data = duk_get_buffer(ctx, -1, &size);
+    ret = newSVpvn((const char*) data, size);
+    duk_pop(ctx);
+    return ret;
+}
@@ -0,0 +1,43 @@
+#ifndef PL_BUNDLE_H
+#define PL_BUNDLE_H
+
+#include <stdint.h>
+#include "pl_duk.h"
+
+/*
+ * A module bundle is a single file holding the source, and optionally the
+ * precompiled code, for a set of modules; it is created by bin/js_bundle.pl
+ * and used with the module_bundle option.  The file is mapped into memory and
+ * modules are served straight from it, before trying any other loader.
+ *
+ * All integers are native unsigned 32-bit values:
+ *
+ *   header: magic "PLDUKBN1", number of modules, reserved
+ *   index:  one entry per module, sorted by id: offset and length of the id,
+ *           the source and the code (length 0 if there is no code)
+ *   data:   ids, sources and code, at the offsets given in the index
+ *
+ * Module ids are paths relative to the root of the bundle; they are resolved
+ * like files on disk, trying X, X.js, X.json, X/index.js and X/index.json.
+ */
+
+typedef struct Bundle Bundle;
+
+/* Map a bundle file; returns 0 if it cannot be read or is not valid */
+Bundle* pl_bundle_open(const char* path);
+void pl_bundle_close(Bundle* bundle);
+
+/* Same as pl_resolver_resolve and pl_resolver_load, for the bundle */
+int pl_bundle_resolve(Bundle* bundle, duk_context* ctx, const char* requested, const char* parent);
+int pl_bundle_load(Bundle* bundle, duk_context* ctx, const char* id);
+
+/*
+ * If the bundle has code for a module compiled from a source with the given
+ * hash, push the function and return 1, otherwise return 0.
+ */
+int pl_bundle_push_code(Bundle* bundle, duk_context* ctx, const char* id, uint64_t source_hash);
+
+/* Compile a module source into the code stored in bundles */
+SV* pl_bundle_compile(pTHX_ Duk* duk, const char* id, SV* source);
+
+#endif
@@ -0,0 +1,356 @@
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "pl_bundle.h"
+#include "pl_bytecode.h"
+
+#define BYTECODE_BUCKETS    1021
+#define BYTECODE_PATH_MAX   4096
+#define BYTECODE_MAGIC      "PLDUKBC1"
+
+typedef struct Bytecode {
+    struct Bytecode* next;
+    char* id;
+    uint64_t id_hash;
+    uint64_t source_hash;
+    size_t refs;  /* one for the table, plus one for each VM loading it right now */
+    size_t size;
+    unsigned char data[1];
+} Bytecode;
+
+/* What goes before the bytecode in a cache file */
+typedef struct BytecodeHeader {
+    char magic[8];
+    uint64_t version;
+    uint64_t source_hash;
+    uint64_t size;
+} BytecodeHeader;
+
+/*
+ * The table is protected by bytecode_lock.  Entries are immutable; an entry
+ * replaced by a newer version of the same module is freed when the last VM
+ * loading it lets go of it.
+ */
+static pthread_mutex_t bytecode_lock = PTHREAD_MUTEX_INITIALIZER;
+static Bytecode* bytecode_table[BYTECODE_BUCKETS];
+
+uint64_t pl_bytecode_hash(const void* data, size_t len)
+{
+    const unsigned char* bytes = (const unsigned char*) data;
+    uint64_t hash = 14695981039346656037ULL;  /* FNV-1a */
+    size_t j = 0;
+    for (j = 0; j < len; ++j) {
+        hash = (hash ^ bytes[j]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+static Bytecode* bytecode_create(const char* id, uint64_t id_hash, uint64_t source_hash, size_t size)
+{
+    Bytecode* code = (Bytecode*) malloc(offsetof(Bytecode, data) + size);
+    if (!code) {
+        return 0;
+    }
+    code->id = strdup(id);
+    if (!code->id) {
+        free(code);
+        return 0;
+    }
+    code->next = 0;
+    code->id_hash = id_hash;
+    code->source_hash = source_hash;
+    code->refs = 1;
+    code->size = size;
+    return code;
+}
+
+/* Must be called with bytecode_lock held */
+static void bytecode_release(Bytecode* code)
+{
+    if (--code->refs > 0) {
+        return;
+    }
+    free(code->id);
+    free(code);
+}
+
+static void bytecode_unpin(Bytecode* code)
+{
+    pthread_mutex_lock(&bytecode_lock);
+    bytecode_release(code);
+    pthread_mutex_unlock(&bytecode_lock);
+}
+
+/* Find and pin the entry for this version (or with any_source, any version) of a module */
+static Bytecode* bytecode_find(const char* id, uint64_t id_hash, uint64_t source_hash, int any_source)
+{
+    Bytecode* code = 0;
+
+    pthread_mutex_lock(&bytecode_lock);
+    for (code = bytecode_table[id_hash % BYTECODE_BUCKETS]; code; code = code->next) {
+        if (code->id_hash == id_hash && strcmp(code->id, id) == 0) {
+            if (any_source || code->source_hash == source_hash) {
+                ++code->refs;
+            } else {
+                code = 0;
+            }
+            break;
+        }
+    }
+    pthread_mutex_unlock(&bytecode_lock);
+    return code;
+}
+
+/*
+ * Hand a new entry over to the table, replacing any other version of the same
+ * module, and return it pinned.  If another VM got there first with the same
+ * version, we drop ours and return theirs.
+ */
+static Bytecode* bytecode_insert(Bytecode* code)
+{
+    Bytecode** link = 0;
+
+    pthread_mutex_lock(&bytecode_lock);
+    for (link = &bytecode_table[code->id_hash % BYTECODE_BUCKETS]; *link; link = &(*link)->next) {
+        Bytecode* old = *link;
+        if (old->id_hash != code->id_hash || strcmp(old->id, code->id) != 0) {
+            continue;
+        }
+        if (old->source_hash == code->source_hash) {
+            bytecode_release(code);
+            code = old;
+            ++code->refs;
+            pthread_mutex_unlock(&bytecode_lock);
+            return code;
+        }
+        *link = old->next;
+        bytecode_release(old);
+        break;
+    }
+    code->next = bytecode_table[code->id_hash % BYTECODE_BUCKETS];
+    bytecode_table[code->id_hash % BYTECODE_BUCKETS] = code;
+    ++code->refs;
+    pthread_mutex_unlock(&bytecode_lock);
+    return code;
+}
+
+typedef struct BytecodeView {
+    const void* data;
+    size_t size;
+} BytecodeView;
+
+static duk_ret_t load_bytecode(duk_context* ctx, void* udata)
+{
+    BytecodeView* view = (BytecodeView*) udata;
+    duk_push_external_buffer(ctx);
+    duk_config_buffer(ctx, -1, (void*) view->data, view->size);
+    duk_load_function(ctx);
+    return 1;
+}
+
+static duk_int_t safe_push_bytecode(duk_context* ctx, const void* data, size_t size)
+{
+    BytecodeView view;
+    view.data = data;
+    view.size = size;
+    return duk_safe_call(ctx, load_bytecode, &view, 0 /*nargs*/, 1 /*nrets*/);
+}
+
+void pl_bytecode_push(duk_context* ctx, const void* data, size_t size)
+{
+    if (safe_push_bytecode(ctx, data, size) != DUK_EXEC_SUCCESS) {
+        (void) duk_throw(ctx);
+    }
+}
+
+/* Push the function for a pinned entry, and unpin it */
+static void push_bytecode(duk_context* ctx, Bytecode* code)
+{
+    duk_int_t rc = safe_push_bytecode(ctx, code->data, code->size);
+    bytecode_unpin(code);
+    if (rc != DUK_EXEC_SUCCESS) {
+        (void) duk_throw(ctx);
+    }
+}
+
+static int disk_path(char* path, size_t size, const char* dir, uint64_t id_hash, uint64_t source_hash)
+{
+    int written = snprintf(path, size, "%s/%016llx-%016llx.jsbc", dir,
+                           (unsigned long long) id_hash, (unsigned long long) source_hash);
+    return written > 0 && (size_t) written < size;
+}
+
+/* Read an entry from a cache file, if it is there and it is valid */
+static Bytecode* disk_read(const char* path, const char* id, uint64_t id_hash, uint64_t source_hash)
+{
+    BytecodeHeader header;
+    Bytecode* code = 0;
+    FILE* fp = fopen(path, "rb");
+
+    if (!fp) {
+        return 0;
+    }
+    if (fread(&header, sizeof(header), 1, fp) != 1 ||
+        memcmp(header.magic, BYTECODE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != DUK_VERSION ||
+        header.source_hash != source_hash ||
+        header.size == 0 || header.size > SIZE_MAX - sizeof(Bytecode)) {
+        fclose(fp);
+        return 0;
+    }
+    code = bytecode_create(id, id_hash, source_hash, header.size);
+    if (code && (fread(code->data, 1, code->size, fp) != code->size || fgetc(fp) != EOF)) {
+        free(code->id);
+        free(code);
+        code = 0;
+    }
+    fclose(fp);
+    return code;
+}
+
+/* Write an entry to a cache file; readers only ever see complete files */
+static void disk_write(const char* path, Bytecode* code)
+{
+    char tmp[BYTECODE_PATH_MAX];
+    BytecodeHeader header;
+    FILE* fp = 0;
+    int ok = 0;
+    int written = snprintf(tmp, sizeof(tmp), "%s.%ld.%lx.tmp", path, (long) getpid(), (unsigned long) code);
+
+    if (written < 0 || (size_t) written >= sizeof(tmp)) {
+        return;
+    }
+    fp = fopen(tmp, "wb");
+    if (!fp) {
+        return;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, BYTECODE_MAGIC, sizeof(header.magic));
+    header.version = DUK_VERSION;
+    header.source_hash = code->source_hash;
+    header.size = code->size;
+    ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+         fwrite(code->data, 1, code->size, fp) == code->size;
+    ok = fclose(fp) == 0 && ok;
+    if (!ok || rename(tmp, path) != 0) {
+        unlink(tmp);
+    }
+}
+
+duk_ret_t pl_bytecode_compile(duk_context* ctx)
+{
+    /* Entry stack: [ func_src filename ] */
+
+    Duk* duk = pl_get_duk(ctx);
+    char path[BYTECODE_PATH_MAX];
+    duk_size_t len = 0;
+    const char* source = duk_require_lstring(ctx, 0, &len);
+    const char* id = duk_require_string(ctx, 1);
+    uint64_t id_hash = pl_bytecode_hash(id, strlen(id));
+    uint64_t source_hash = pl_bytecode_hash(source, len);
+    int use_disk = duk->module_cache_dir &&
+                   disk_path(path, sizeof(path), duk->module_cache_dir, id_hash, source_hash);
+    Bytecode* code = 0;
+    void* data = 0;
+    duk_size_t size = 0;
+
+    if (duk->bundle && pl_bundle_push_code(duk->bundle, ctx, id, source_hash)) {
+        ++duk->module_cache.bundle_hits;
+        return 1;
+    }
+    if (!(duk->flags & DUK_OPT_FLAG_MODULE_CACHE)) {
+        duk_compile(ctx, DUK_COMPILE_EVAL);
+        return 1;
+    }
+
+    code = bytecode_find(id, id_hash, source_hash, 0);
+    if (code) {
+        ++duk->module_cache.hits;
+        push_bytecode(ctx, code);
+        return 1;
+    }
+    if (use_disk) {
+        code = disk_read(path, id, id_hash, source_hash);
+        if (code) {
+            ++duk->module_cache.disk_hits;
+            push_bytecode(ctx, bytecode_insert(code));
+            return 1;
+        }
+    }
+
+    ++duk->module_cache.misses;
+    duk_compile(ctx, DUK_COMPILE_EVAL);
+
+    /* [ func ] */
+
+    duk_dup(ctx, -1);
+    duk_dump_function(ctx);
+    data = duk_get_buffer(ctx, -1, &size);
+    code = bytecode_create(id, id_hash, source_hash, size);
+    if (code) {
+        memcpy(code->data, data, size);
+        code = bytecode_insert(code);
+        if (use_disk) {
+            disk_write(path, code);
+        }
+        bytecode_unpin(code);
+    }
+    duk_pop(ctx);
+    return 1;
+}
+
+int pl_bytecode_load_shared(duk_context* ctx)
+{
+    /* Entry stack: [ module_id exports module ] */
+
+    Duk* duk = pl_get_duk(ctx);
+    const char* id = duk_require_string(ctx, 0);
+    Bytecode* code = bytecode_find(id, pl_bytecode_hash(id, strlen(id)), 0, 1);
+
+    if (!code) {
+        return 0;
+    }
+    ++duk->module_cache.shared_hits;
+    push_bytecode(ctx, code);
+    duk_call(ctx, 0);
+
+    /* [ module_id exports module func ]; same as duk__eval_module_source */
+
+    duk_push_string(ctx, "name");
+    duk_push_string(ctx, "main");
+    duk_def_prop(ctx, -3, DUK_DEFPROP_HAVE_VALUE | DUK_DEFPROP_FORCE);
+
+    duk_dup(ctx, 1);                             /* exports */
+    (void) duk_get_prop_string(ctx, 2, "require");
+    duk_dup(ctx, 2);                             /* module */
+    (void) duk_get_prop_string(ctx, 2, "filename");
+    duk_push_undefined(ctx);                     /* __dirname */
+    duk_call(ctx, 5);
+    duk_pop(ctx);
+
+    duk_push_true(ctx);
+    duk_put_prop_string(ctx, 2, "loaded");
+    return 1;
+}
+
+void pl_bytecode_clear(void)
+{
+    size_t j = 0;
+
+    pthread_mutex_lock(&bytecode_lock);
+    for (j = 0; j < BYTECODE_BUCKETS; ++j) {
+        Bytecode* code = bytecode_table[j];
+        bytecode_table[j] = 0;
+        while (code) {
+            Bytecode* next = code->next;
+            bytecode_release(code);
+            code = next;
+        }
+    }
+    pthread_mutex_unlock(&bytecode_lock);
+}
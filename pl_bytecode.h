@@ -0,0 +1,48 @@
+#ifndef PL_BYTECODE_H
+#define PL_BYTECODE_H
+
+#include <stdint.h>
+#include "pl_duk.h"
+
+/*
+ * A per-process cache of compiled module code, used when the module_cache
+ * option is given.  Entries are keyed by the resolved module id and a hash of
+ * the module source, so a module is only compiled again when its source
+ * changes; there is at most one entry for each module id.
+ *
+ * With the module_cache_dir option, the bytecode is also written to (and read
+ * back from) that directory, so it survives across processes.  Duktape does
+ * not validate bytecode, so the directory must only be writable by trusted
+ * users.
+ *
+ * With the share_modules option, a module found in the cache is run without
+ * even calling the loader, whatever its current source; use
+ * pl_bytecode_clear() to forget the modules loaded so far.
+ *
+ * The same callback also serves precompiled code from a module bundle, if the
+ * VM has one, whether the cache is enabled or not.
+ */
+
+/*
+ * Compile callback for duk_module_node.
+ * Entry stack: [ func_src filename ]; pushes the compiled function.
+ */
+duk_ret_t pl_bytecode_compile(duk_context* ctx);
+
+/*
+ * Load callback for duk_module_node, for share_modules.
+ * Entry stack: [ module_id exports module ]; if the module is in the cache,
+ * run it and return 1, otherwise return 0.
+ */
+int pl_bytecode_load_shared(duk_context* ctx);
+
+/* Forget all the modules in the cache */
+void pl_bytecode_clear(void);
+
+/* The hash we use for module sources */
+uint64_t pl_bytecode_hash(const void* data, size_t len);
+
+/* Push the function dumped in data; throws if it cannot be loaded */
+void pl_bytecode_push(duk_context* ctx, const void* data, size_t size);
+
+#endif
@@ -1,4 +1,7 @@
 #include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "duk_console.h"
 #include "pl_util.h"
 #include "pl_console.h"
@@ -10,17 +13,173 @@
 static int print_console_messages(duk_uint_t flags, void* data,
                                   const char* fmt, va_list ap)
 {
-    dTHX;
+    Duk* duk = (Duk*) data;
+    PL_DUK_THX(duk);
     PerlIO* fp = (flags & DUK_CONSOLE_TO_STDERR) ? PerlIO_stderr() : PerlIO_stdout();
     int ret = PerlIO_vprintf(fp, fmt, ap);
 
-    UNUSED_ARG(data);
     if (flags & DUK_CONSOLE_FLUSH) {
         PerlIO_flush(fp);
     }
     return ret;
 }
 
+static void flush_buffer(pTHX_ Duk* duk, int target)
+{
+    ConsoleBuffer* buffer = &duk->console_buffers[target];
+    PerlIO* fp = target == PL_CONSOLE_TARGET_STDERR ? PerlIO_stderr() : PerlIO_stdout();
+
+    if (!buffer->used) {
+        return;
+    }
+    PerlIO_write(fp, buffer->data, buffer->used);
+    PerlIO_flush(fp);
+    buffer->used = 0;
+}
+
+/*
+ * Append each message to a per-target buffer, and only write it out when the
+ * buffer fills up, when asked to flush, or when the message requires it.
+ */
+static int buffer_console_messages(duk_uint_t flags, void* data,
+                                   const char* fmt, va_list ap)
+{
+    Duk* duk = (Duk*) data;
+    PL_DUK_THX(duk);
+    int target = (flags & DUK_CONSOLE_TO_STDERR) ? PL_CONSOLE_TARGET_STDERR : PL_CONSOLE_TARGET_STDOUT;
+    ConsoleBuffer* buffer = &duk->console_buffers[target];
+    size_t size = duk->console_buffer_bytes;
+    int ret = 0;
+    va_list args_copy;
+
+    if (!buffer->data) {
+        buffer->data = (char*) malloc(size);
+        if (!buffer->data) {
+            croak("Could not allocate memory for console buffer\n");
+        }
+    }
+
+    va_copy(args_copy, ap);
+    ret = vsnprintf(buffer->data + buffer->used, size - buffer->used, fmt, args_copy);
+    va_end(args_copy);
+    if (ret >= 0 && (size_t) ret >= size - buffer->used) {
+        /* did not fit: make room and try again, or bypass the buffer */
+        flush_buffer(aTHX_ duk, target);
+        if ((size_t) ret < size) {
+            va_copy(args_copy, ap);
+            ret = vsnprintf(buffer->data, size, fmt, args_copy);
+            va_end(args_copy);
+        } else {
+            PerlIO* fp = target == PL_CONSOLE_TARGET_STDERR ? PerlIO_stderr() : PerlIO_stdout();
+            va_copy(args_copy, ap);
+            ret = PerlIO_vprintf(fp, fmt, args_copy);
+            va_end(args_copy);
+            PerlIO_flush(fp);
+            return ret;
+        }
+    }
+    if (ret > 0) {
+        buffer->used += ret;
+    }
+    if (flags & DUK_CONSOLE_FLUSH) {
+        flush_buffer(aTHX_ duk, target);
+    }
+    return ret;
+}
+
+/*
+ * Saved messages are kept in a ring buffer in C, bounded both in number of
+ * messages and in total bytes; when it is full, the oldest messages are
+ * dropped.  They are only converted to Perl data when they are requested.
+ */
+typedef struct Message {
+    char* text;
+    size_t len;
+    int target;
+    duk_uint_t level;
+    double time_us;
+} Message;
+
+typedef struct MessageRing {
+    Message* entries;
+    size_t allocated;
+    size_t start;
+    size_t count;
+    size_t bytes;
+    size_t dropped;
+} MessageRing;
+
+static const char* target_names[PL_CONSOLE_TARGETS] = { "stdout", "stderr" };
+
+static Message* ring_entry(MessageRing* ring, size_t pos)
+{
+    return &ring->entries[(ring->start + pos) % ring->allocated];
+}
+
+static void ring_drop_oldest(MessageRing* ring)
+{
+    Message* oldest = ring_entry(ring, 0);
+    ring->bytes -= oldest->len;
+    free(oldest->text);
+    oldest->text = 0;
+    ring->start = (ring->start + 1) % ring->allocated;
+    --ring->count;
+    ++ring->dropped;
+}
+
+static int ring_grow(MessageRing* ring, size_t limit)
+{
+    size_t size = ring->allocated ? ring->allocated * 2 : 16;
+    Message* entries = 0;
+    size_t j = 0;
+
+    if (size > limit) {
+        size = limit;
+    }
+    entries = (Message*) malloc(size * sizeof(Message));
+    if (!entries) {
+        return 0;
+    }
+    for (j = 0; j < ring->count; ++j) {
+        entries[j] = *ring_entry(ring, j);
+    }
+    free(ring->entries);
+    ring->entries = entries;
+    ring->allocated = size;
+    ring->start = 0;
+    return 1;
+}
+
+static void ring_add(Duk* duk, Message* message)
+{
+    MessageRing* ring = duk->msg_ring;
+
+    if (!ring) {
+        ring = duk->msg_ring = (MessageRing*) calloc(1, sizeof(MessageRing));
+        if (!ring) {
+            croak("Could not allocate memory for console messages\n");
+        }
+    }
+
+    while (ring->count && (ring->count >= duk->max_messages ||
+                           ring->bytes + message->len > duk->max_message_bytes)) {
+        ring_drop_oldest(ring);
+    }
+    if (ring->count == ring->allocated && !ring_grow(ring, duk->max_messages)) {
+        croak("Could not allocate memory for console messages\n");
+    }
+
+    *ring_entry(ring, ring->count++) = *message;
+    ring->bytes += message->len;
+}
+
+static void ring_clear(MessageRing* ring)
+{
+    while (ring->count) {
+        ring_drop_oldest(ring);
+    }
+    ring->dropped = 0;
+}
 
 static void save_msg(pTHX_ Duk* duk, const char* target, SV* message)
 {
@@ -59,28 +218,147 @@ static void save_msg(pTHX_ Duk* duk, const char* target, SV* message)
 static int save_console_messages(duk_uint_t flags, void* data,
                                  const char* fmt, va_list ap)
 {
-    dTHX;
     Duk* duk = (Duk*) data;
-    const char* target = (flags & DUK_CONSOLE_TO_STDERR) ? "stderr" : "stdout";
-    SV* message = newSVpvs("");
+    Message message;
+    char small[256];
+    int ret = 0;
     va_list args_copy;
+
     va_copy(args_copy, ap);
-    Perl_sv_vcatpvf(aTHX_ message, fmt, &args_copy);
-    save_msg(aTHX_ duk, target, message);
-    return SvCUR(message);
+    ret = vsnprintf(small, sizeof(small), fmt, args_copy);
+    va_end(args_copy);
+    if (ret < 0) {
+        return ret;
+    }
+
+    message.len = ret;
+    message.text = (char*) malloc(message.len + 1);
+    if (!message.text) {
+        croak("Could not allocate memory for console message\n");
+    }
+    if (message.len < sizeof(small)) {
+        memcpy(message.text, small, message.len + 1);
+    } else {
+        va_copy(args_copy, ap);
+        vsnprintf(message.text, message.len + 1, fmt, args_copy);
+        va_end(args_copy);
+    }
+    if (message.len > duk->max_message_bytes) {
+        message.len = duk->max_message_bytes;  /* keep the beginning */
+    }
+    message.target = (flags & DUK_CONSOLE_TO_STDERR) ? PL_CONSOLE_TARGET_STDERR : PL_CONSOLE_TARGET_STDOUT;
+    message.level = DUK_CONSOLE_LEVEL(flags);
+    message.time_us = now_us();
+
+    ring_add(duk, &message);
+    return ret;
+}
+
+static const char* level_name(duk_uint_t level)
+{
+    switch (level) {
+        case DUK_CONSOLE_LEVEL_DEBUG:
+            return "debug";
+        case DUK_CONSOLE_LEVEL_WARN:
+            return "warn";
+        case DUK_CONSOLE_LEVEL_ERROR:
+            return "error";
+        default:
+            return "info";
+    }
 }
 
 int pl_console_init(Duk* duk)
 {
+    duk_uint_t flags = DUK_CONSOLE_PROXY_WRAPPER;
+
+    /* when buffering, we flush when the buffer fills up */
+    if (!duk->console_buffer_bytes) {
+        flags |= DUK_CONSOLE_FLUSH;
+    }
+
     /* initialize console object */
-    duk_console_init(duk->ctx, DUK_CONSOLE_PROXY_WRAPPER | DUK_CONSOLE_FLUSH);
+    duk_console_init(duk->ctx, flags);
+    duk_console_set_min_level(duk->ctx, duk->console_level);
 
     if (duk->flags & DUK_OPT_FLAG_SAVE_MESSAGES) {
-        duk_console_register_handler(save_console_messages, duk);
+        duk_console_register_handler(duk->ctx, save_console_messages, duk);
+    }
+    else if (duk->console_buffer_bytes) {
+        duk_console_register_handler(duk->ctx, buffer_console_messages, duk);
     }
     else {
-        duk_console_register_handler(print_console_messages, duk);
+        duk_console_register_handler(duk->ctx, print_console_messages, duk);
     }
 
     return 0;
 }
+
+void pl_console_flush(Duk* duk)
+{
+    PL_DUK_THX(duk);
+    int target = 0;
+    for (target = 0; target < PL_CONSOLE_TARGETS; ++target) {
+        flush_buffer(aTHX_ duk, target);
+    }
+}
+
+void pl_console_save_msgs(pTHX_ Duk* duk)
+{
+    MessageRing* ring = duk->msg_ring;
+    size_t j = 0;
+
+    hv_clear(duk->msgs);
+    for (j = 0; ring && j < ring->count; ++j) {
+        Message* message = ring_entry(ring, j);
+        SV* text = newSVpvn(message->text, message->len);
+        save_msg(aTHX_ duk, target_names[message->target], text);
+    }
+}
+
+SV* pl_console_msgs_detailed(pTHX_ Duk* duk)
+{
+    MessageRing* ring = duk->msg_ring;
+    HV* detailed = newHV();
+    AV* messages = newAV();
+    size_t j = 0;
+
+    for (j = 0; ring && j < ring->count; ++j) {
+        Message* message = ring_entry(ring, j);
+        HV* entry = newHV();
+        const char* target = target_names[message->target];
+        const char* level = level_name(message->level);
+        hv_store(entry, "target", 6, newSVpv(target, 0), 0);
+        hv_store(entry, "level", 5, newSVpv(level, 0), 0);
+        hv_store(entry, "time", 4, newSVnv(message->time_us / 1000000.0), 0);
+        hv_store(entry, "message", 7, newSVpvn(message->text, message->len), 0);
+        av_push(messages, newRV_noinc((SV*) entry));
+    }
+    hv_store(detailed, "messages", 8, newRV_noinc((SV*) messages), 0);
+    hv_store(detailed, "dropped", 7, newSVuv(ring ? ring->dropped : 0), 0);
+    return newRV_noinc((SV*) detailed);
+}
+
+void pl_console_reset_msgs(Duk* duk)
+{
+    if (duk->msg_ring) {
+        ring_clear(duk->msg_ring);
+    }
+}
+
+void pl_console_destroy(Duk* duk)
+{
+    int target = 0;
+    for (target = 0; target < PL_CONSOLE_TARGETS; ++target) {
+        free(duk->console_buffers[target].data);
+        duk->console_buffers[target].data = 0;
+        duk->console_buffers[target].used = 0;
+    }
+
+    if (duk->msg_ring) {
+        ring_clear(duk->msg_ring);
+        free(duk->msg_ring->entries);
+        free(duk->msg_ring);
+        duk->msg_ring = 0;
+    }
+}
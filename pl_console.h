@@ -3,6 +3,25 @@
 
 #include "pl_duk.h"
 
+/* Default limits for the messages kept with save_messages */
+#define PL_CONSOLE_MAX_MESSAGES       10000
+#define PL_CONSOLE_MAX_MESSAGE_BYTES  (4 * 1024 * 1024)
+
 int pl_console_init(Duk* duk);
 
+/* Write out any buffered console output */
+void pl_console_flush(Duk* duk);
+
+/* Store the saved messages in duk->msgs, as arrayrefs per target */
+void pl_console_save_msgs(pTHX_ Duk* duk);
+
+/* Return a hashref with the saved messages and how many were dropped */
+SV* pl_console_msgs_detailed(pTHX_ Duk* duk);
+
+/* Forget all the saved messages */
+void pl_console_reset_msgs(Duk* duk);
+
+/* Release the memory used for buffering and saving console output */
+void pl_console_destroy(Duk* duk);
+
 #endif
@@ -13,9 +13,23 @@
 
 static duk_ret_t perl_caller(duk_context* ctx);
 
-static SV* pl_duk_to_perl_impl(pTHX_ duk_context* ctx, int pos, HV* seen)
+/* How much data a conversion moved across the boundary */
+typedef struct Volume {
+    size_t values;
+    size_t bytes;
+} Volume;
+
+Duk* pl_get_duk(duk_context* ctx)
+{
+    duk_memory_functions funcs;
+    duk_get_memory_functions(ctx, &funcs);
+    return (Duk*) funcs.udata;
+}
+
+static SV* pl_duk_to_perl_impl(pTHX_ duk_context* ctx, int pos, HV* seen, Volume* volume)
 {
     SV* ret = &PL_sv_undef; /* return undef by default */
+    ++volume->values;
     switch (duk_get_type(ctx, pos)) {
         case DUK_TYPE_NONE:
         case DUK_TYPE_UNDEFINED:
@@ -38,6 +52,7 @@ static SV* pl_duk_to_perl_impl(pTHX_ duk_context* ctx, int pos, HV* seen)
             const char* cstr = duk_get_lstring(ctx, pos, &clen);
             ret = newSVpvn(cstr, clen);
             SvUTF8_on(ret); /* yes, always */
+            volume->bytes += clen;
             break;
         }
         case DUK_TYPE_OBJECT: {
@@ -72,7 +87,7 @@ static SV* pl_duk_to_perl_impl(pTHX_ duk_context* ctx, int pos, HV* seen)
                         if (!duk_get_prop_index(ctx, pos, j)) {
                             continue; /* index doesn't exist => end of array */
                         }
-                        nested = sv_2mortal(pl_duk_to_perl_impl(aTHX_ ctx, -1, seen));
+                        nested = sv_2mortal(pl_duk_to_perl_impl(aTHX_ ctx, -1, seen, volume));
                         duk_pop(ctx); /* value in current pos */
                         if (!nested) {
                             croak("Could not create Perl SV for array\n");
@@ -102,8 +117,9 @@ static SV* pl_duk_to_perl_impl(pTHX_ duk_context* ctx, int pos, HV* seen)
                     while (duk_next(ctx, -1, 1)) { /* get key and value */
                         duk_size_t klen = 0;
                         const char* kstr = duk_get_lstring(ctx, -2, &klen);
-                        SV* nested = sv_2mortal(pl_duk_to_perl_impl(aTHX_ ctx, -1, seen));
+                        SV* nested = sv_2mortal(pl_duk_to_perl_impl(aTHX_ ctx, -1, seen, volume));
                         duk_pop_2(ctx); /* key and value */
+                        volume->bytes += klen;
                         if (!nested) {
                             croak("Could not create Perl SV for hash\n");
                         }
@@ -135,9 +151,10 @@ static SV* pl_duk_to_perl_impl(pTHX_ duk_context* ctx, int pos, HV* seen)
     return ret;
 }
 
-static int pl_perl_to_duk_impl(pTHX_ SV* value, duk_context* ctx, HV* seen)
+static int pl_perl_to_duk_impl(pTHX_ SV* value, duk_context* ctx, HV* seen, Volume* volume)
 {
     int ret = 1;
+    ++volume->values;
     if (!SvOK(value)) {
         duk_push_null(ctx);
     } else if (sv_isa(value, PL_JSON_BOOLEAN_CLASS)) {
@@ -153,6 +170,7 @@ static int pl_perl_to_duk_impl(pTHX_ SV* value, duk_context* ctx, HV* seen)
         STRLEN vlen = 0;
         const char* vstr = SvPV_const(value, vlen);
         duk_push_lstring(ctx, vstr, vlen);
+        volume->bytes += vlen;
     } else if (SvROK(value)) {
         SV* ref = SvRV(value);
         int type = SvTYPE(ref);
@@ -181,7 +199,7 @@ static int pl_perl_to_duk_impl(pTHX_ SV* value, duk_context* ctx, HV* seen)
                     if (!elem || !*elem) {
                         break; /* could not get element */
                     }
-                    if (!pl_perl_to_duk_impl(aTHX_ *elem, ctx, seen)) {
+                    if (!pl_perl_to_duk_impl(aTHX_ *elem, ctx, seen, volume)) {
                         croak("Could not create JS element for array\n");
                     }
                     if (!duk_put_prop_index(ctx, array_pos, count)) {
@@ -232,9 +250,10 @@ static int pl_perl_to_duk_impl(pTHX_ SV* value, duk_context* ctx, HV* seen)
                     }
                     SvUTF8_on(value); /* yes, always */
 
-                    if (!pl_perl_to_duk_impl(aTHX_ value, ctx, seen)) {
+                    if (!pl_perl_to_duk_impl(aTHX_ value, ctx, seen, volume)) {
                         croak("Could not create JS element for hash\n");
                     }
+                    volume->bytes += klen;
                     if (! duk_put_prop_lstring(ctx, hash_pos, kstr, klen)) {
                         croak("Could not push JS element for hash\n");
                     }
@@ -265,17 +284,35 @@ static int pl_perl_to_duk_impl(pTHX_ SV* value, duk_context* ctx, HV* seen)
 
 SV* pl_duk_to_perl(pTHX_ duk_context* ctx, int pos)
 {
+    Duk* duk = pl_get_duk(ctx);
+    int gather = duk->flags & DUK_OPT_FLAG_GATHER_STATS;
+    double t0 = gather ? now_us() : 0;
+    Volume volume = { 0, 0 };
     HV* seen = newHV();
-    SV* ret = pl_duk_to_perl_impl(aTHX_ ctx, pos, seen);
+    SV* ret = pl_duk_to_perl_impl(aTHX_ ctx, pos, seen, &volume);
     hv_undef(seen);
+    if (gather) {
+        duk->boundary.values_to_perl += volume.values;
+        duk->boundary.bytes_to_perl += volume.bytes;
+        duk->boundary.convert_to_perl_us += now_us() - t0;
+    }
     return ret;
 }
 
 int pl_perl_to_duk(pTHX_ SV* value, duk_context* ctx)
 {
+    Duk* duk = pl_get_duk(ctx);
+    int gather = duk->flags & DUK_OPT_FLAG_GATHER_STATS;
+    double t0 = gather ? now_us() : 0;
+    Volume volume = { 0, 0 };
     HV* seen = newHV();
-    int ret = pl_perl_to_duk_impl(aTHX_ value, ctx, seen);
+    int ret = pl_perl_to_duk_impl(aTHX_ value, ctx, seen, &volume);
     hv_undef(seen);
+    if (gather) {
+        duk->boundary.values_to_js += volume.values;
+        duk->boundary.bytes_to_js += volume.bytes;
+        duk->boundary.convert_to_js_us += now_us() - t0;
+    }
     return ret;
 }
 
@@ -342,10 +379,14 @@ int pl_call_perl_sv(duk_context* ctx, SV* func)
     duk_idx_t j = 0;
     duk_idx_t nargs = 0;
     SV* ret = 0;
+    Duk* duk = pl_get_duk(ctx);
 
     /* prepare Perl environment for calling the CV */
-    dTHX;
+    PL_DUK_THX(duk);
     dSP;
+    if (duk->flags & DUK_OPT_FLAG_GATHER_STATS) {
+        ++duk->boundary.callbacks;
+    }
     ENTER;
     SAVETMPS;
     PUSHMARK(SP);
@@ -461,9 +502,15 @@ int pl_set_global_or_property(pTHX_ duk_context* ctx, const char* name, SV* valu
 {
     int len = 0;
     int last_dot = 0;
+    Duk* duk = pl_get_duk(ctx);
     if (!pl_perl_to_duk(aTHX_ value, ctx)) {
         return 0;
     }
+    if ((duk->flags & DUK_OPT_FLAG_GATHER_STATS) && SvROK(value) && SvTYPE(SvRV(value)) == SVt_PVCV) {
+        /* remember under which name this callback was set, for its stats */
+        duk_push_uint(ctx, pl_stats_callback_slot(duk, name));
+        duk_put_prop_lstring(ctx, -2, PL_SLOT_CALLBACK_STATS, sizeof(PL_SLOT_CALLBACK_STATS) - 1);
+    }
     last_dot = find_last_dot(name, &len);
     if (last_dot < 0) {
         if (!duk_put_global_lstring(ctx, name, len)) {
@@ -523,10 +570,10 @@ SV* pl_eval(pTHX_ Duk* duk, const char* js, const char* file)
             duk_push_string(ctx, file);
             rc = duk_pcompile_string_filename(ctx, flags, js);
         }
-        pl_stats_stop(aTHX_ duk, &stats, "compile");
+        pl_stats_stop(aTHX_ duk, &stats, PL_STATS_OP_COMPILE);
         if (rc != DUK_EXEC_SUCCESS) {
             /* Only for an error this early we print something out and bail out */
-            duk_console_log(DUK_CONSOLE_FLUSH | DUK_CONSOLE_TO_STDERR,
+            duk_console_log(ctx, DUK_CONSOLE_FLUSH | DUK_CONSOLE_TO_STDERR | DUK_CONSOLE_LEVEL_ERROR,
                             "JS could not compile code: %s\n",
                             duk_safe_to_string(ctx, -1));
             break;
@@ -535,7 +582,7 @@ SV* pl_eval(pTHX_ Duk* duk, const char* js, const char* file)
         /* Run the requested code and check for possible errors*/
         pl_stats_start(aTHX_ duk, &stats);
         rc = duk_pcall(ctx, 0);
-        pl_stats_stop(aTHX_ duk, &stats, "run");
+        pl_stats_stop(aTHX_ duk, &stats, PL_STATS_OP_RUN);
         check_duktape_call_for_errors(rc, ctx);
 
         /* Convert returned value to Perl and pop it off the stack */
@@ -551,9 +598,13 @@ SV* pl_eval(pTHX_ Duk* duk, const char* js, const char* file)
     return ret;
 }
 
-int pl_run_gc(Duk* duk)
+int pl_run_gc(Duk* duk, int mode, double budget_us)
 {
     int j = 0;
+    int runs = mode == PL_GC_MODE_FULL ? PL_GC_RUNS : 1;
+    duk_uint_t flags = mode == PL_GC_MODE_LIGHT ? 0 : DUK_GC_COMPACT;
+    double t0 = now_us();
+    double last = t0;
 
     /*
      * From docs in http://duktape.org/api.html#duk_gc
@@ -565,11 +616,27 @@ int pl_run_gc(Duk* duk)
      * unreachable after finalization and then frees the object.
      */
     duk_context* ctx = duk->ctx;
-    for (j = 0; j < PL_GC_RUNS; ++j) {
+    for (j = 0; j < runs; ++j) {
+        double now = 0;
+
+        /*
+         * A pass cannot be interrupted, so guess how long it will take from
+         * the ones we already ran, or for the first one, from the last pass
+         * we ran in this mode.
+         */
+        double estimate = j > 0 ? (last - t0) / j : duk->gc_pass_us[mode];
+        if (budget_us > 0 && (last - t0) + estimate > budget_us) {
+            break;
+        }
+
         /* DUK_GC_COMPACT: Force object property table compaction */
-        duk_gc(ctx, DUK_GC_COMPACT);
+        duk_gc(ctx, flags);
+        now = now_us();
+        pl_stats_gc_pause(duk, now - last);
+        duk->gc_pass_us[mode] = now - last;
+        last = now;
     }
-    return PL_GC_RUNS;
+    return j;
 }
 
 SV* pl_global_objects(pTHX_ duk_context* ctx)
@@ -597,6 +664,12 @@ SV* pl_global_objects(pTHX_ duk_context* ctx)
 static duk_ret_t perl_caller(duk_context* ctx)
 {
     SV* func = 0;
+    Duk* duk = pl_get_duk(ctx);
+    size_t slot = 0;
+    double t0 = 0;
+    double outer_child_us = 0;
+    double total_us = 0;
+    duk_ret_t ret = 0;
 
     /* get actual Perl CV stored as a function property */
     duk_push_current_function(ctx);
@@ -605,10 +678,31 @@ static duk_ret_t perl_caller(duk_context* ctx)
     }
 
     func = (SV*) duk_get_pointer(ctx, -1);
-    duk_pop_2(ctx);  /* pop pointer and function */
+    duk_pop(ctx);  /* pop pointer */
+    if (!(duk->flags & DUK_OPT_FLAG_GATHER_STATS)) {
+        duk_pop(ctx);  /* pop function */
+        if (func == 0) {
+            croak("Could not get value for property %s\n", PL_SLOT_GENERIC_CALLBACK);
+        }
+        return pl_call_perl_sv(ctx, func);
+    }
+
+    /* the slot for the stats of this callback, if it was given a name */
+    if (duk_get_prop_lstring(ctx, -1, PL_SLOT_CALLBACK_STATS, sizeof(PL_SLOT_CALLBACK_STATS) - 1)) {
+        slot = duk_get_uint(ctx, -1);
+    }
+    duk_pop_2(ctx);  /* pop slot and function */
     if (func == 0) {
         croak("Could not get value for property %s\n", PL_SLOT_GENERIC_CALLBACK);
     }
 
-    return pl_call_perl_sv(ctx, func);
+    /* time spent in nested callbacks is not part of our self time */
+    outer_child_us = duk->callback_child_us;
+    duk->callback_child_us = 0;
+    t0 = now_us();
+    ret = pl_call_perl_sv(ctx, func);
+    total_us = now_us() - t0;
+    pl_stats_callback(duk, slot, total_us, total_us - duk->callback_child_us);
+    duk->callback_child_us = outer_child_us + total_us;
+    return ret;
 }
@@ -10,34 +10,163 @@
 #define DUK_OPT_NAME_SAVE_MESSAGES     "save_messages"
 #define DUK_OPT_NAME_MAX_MEMORY_BYTES  "max_memory_bytes"
 #define DUK_OPT_NAME_MAX_TIMEOUT_US    "max_timeout_us"
+#define DUK_OPT_NAME_ARENA_ALLOCATOR   "arena_allocator"
+#define DUK_OPT_NAME_ARENA_MADVISE     "arena_madvise"
+#define DUK_OPT_NAME_TIMEOUT_WATCHDOG  "timeout_watchdog"
+#define DUK_OPT_NAME_MAX_CPU_TIME_US   "max_cpu_time_us"
+#define DUK_OPT_NAME_MAX_INSTRUCTIONS  "max_instructions"
+#define DUK_OPT_NAME_SOFT_MEMORY_BYTES "soft_memory_bytes"
+#define DUK_OPT_NAME_IDLE_GC           "idle_gc"
+#define DUK_OPT_NAME_PROFILE_INTERVAL_US "profile_interval_us"
+#define DUK_OPT_NAME_CONSOLE_BUFFER_BYTES "console_buffer_bytes"
+#define DUK_OPT_NAME_MAX_MESSAGES      "max_messages"
+#define DUK_OPT_NAME_MAX_MESSAGE_BYTES "max_message_bytes"
+#define DUK_OPT_NAME_CONSOLE_LEVEL     "console_level"
+#define DUK_OPT_NAME_MODULE_PATHS      "module_paths"
+#define DUK_OPT_NAME_MODULE_CACHE      "module_cache"
+#define DUK_OPT_NAME_MODULE_CACHE_DIR  "module_cache_dir"
+#define DUK_OPT_NAME_MODULE_BUNDLE     "module_bundle"
+#define DUK_OPT_NAME_SHARE_MODULES     "share_modules"
 
 #define DUK_OPT_FLAG_GATHER_STATS      0x01
 #define DUK_OPT_FLAG_SAVE_MESSAGES     0x02
 #define DUK_OPT_FLAG_MAX_MEMORY_BYTES  0x04
 #define DUK_OPT_FLAG_MAX_TIMEOUT_US    0x08
+#define DUK_OPT_FLAG_ARENA_ALLOCATOR   0x10
+#define DUK_OPT_FLAG_ARENA_MADVISE     0x20
+#define DUK_OPT_FLAG_TIMEOUT_WATCHDOG  0x40
+#define DUK_OPT_FLAG_IDLE_GC           0x80
+#define DUK_OPT_FLAG_MODULE_CACHE      0x100
+#define DUK_OPT_FLAG_SHARE_MODULES     0x200
+
+#define PL_GC_MODE_FULL       0  /* two compacting passes, so objects with finalizers get freed too */
+#define PL_GC_MODE_LIGHT      1  /* a single non-compacting pass */
+#define PL_GC_MODE_COMPACT    2  /* a single compacting pass */
+#define PL_GC_MODES           3
+
+#define PL_GC_PAUSE_BUCKETS  24  /* bucket N counts pauses between 2^N and 2^(N+1) us */
 
 #define PL_NAME_ROOT              "_perl_"
 #define PL_NAME_GENERIC_CALLBACK  "generic_callback"
+#define PL_NAME_CALLBACK_STATS    "callback_stats"
 
 #define PL_SLOT_CREATE(name)      (PL_NAME_ROOT "." #name)
 
 #define PL_SLOT_GENERIC_CALLBACK  PL_SLOT_CREATE(PL_NAME_GENERIC_CALLBACK)
+#define PL_SLOT_CALLBACK_STATS    PL_SLOT_CREATE(PL_NAME_CALLBACK_STATS)
+
+/*
+ * Declare the Perl context for code called back from duktape, using the
+ * interpreter saved in our Duk instead of looking it up in thread-local
+ * storage with dTHX.
+ */
+#define PL_DUK_THX(duk) dTHXa((duk)->perl)
 
 /*
  * This is our internal data structure.  For now it only contains a pointer to
  * a duktape context.  We will add other stuff here.
  */
+struct Arena;
+struct OpStats;
+struct CallbackStats;
+struct Profile;
+struct MessageRing;
+struct Resolver;
+struct Bundle;
+
+/* Pause times for the GC passes we run, whether explicitly or while idle */
+typedef struct GcPauses {
+    size_t runs;
+    size_t idle_runs;
+    double total_us;
+    double max_us;
+    size_t histogram[PL_GC_PAUSE_BUCKETS];
+} GcPauses;
+
+/* Traffic across the Perl / JS boundary; only updated when gathering stats */
+typedef struct Boundary {
+    size_t callbacks;          /* calls from JS into Perl */
+    size_t entries;            /* calls from Perl into JS */
+    size_t values_to_perl;     /* values converted from JS to Perl */
+    size_t values_to_js;       /* values converted from Perl to JS */
+    size_t bytes_to_perl;      /* string bytes converted from JS to Perl */
+    size_t bytes_to_js;        /* string bytes converted from Perl to JS */
+    double convert_to_perl_us;
+    double convert_to_js_us;
+} Boundary;
+
+/* Lookups in the module bytecode cache */
+typedef struct ModuleCache {
+    size_t hits;         /* found in memory */
+    size_t disk_hits;    /* found in module_cache_dir */
+    size_t bundle_hits;  /* found in the module bundle */
+    size_t shared_hits;  /* run without calling the loader, with share_modules */
+    size_t misses;       /* had to compile the module */
+} ModuleCache;
+
+/* Console output waiting to be written out, for one target */
+typedef struct ConsoleBuffer {
+    char* data;
+    size_t used;
+} ConsoleBuffer;
+
+#define PL_CONSOLE_TARGET_STDOUT 0
+#define PL_CONSOLE_TARGET_STDERR 1
+#define PL_CONSOLE_TARGETS       2
+
 typedef struct Duk {
     int inited;
     duk_context* ctx;
-    int pagesize_bytes;
+    PerlInterpreter* perl;  /* the Perl interpreter that owns us; see PL_DUK_THX */
     unsigned long flags;
     HV* stats;
+    struct OpStats* op_stats;
     HV* msgs;
+    struct MessageRing* msg_ring;
+    size_t max_messages;
+    size_t max_message_bytes;
+    size_t console_buffer_bytes;
+    duk_uint_t console_level;
+    ConsoleBuffer console_buffers[PL_CONSOLE_TARGETS];
     size_t total_allocated_bytes;
     size_t max_allocated_bytes;
+    size_t peak_allocated_bytes;
+    size_t cumulative_allocated_bytes;
+    size_t cumulative_freed_bytes;
+    size_t allocation_count;
+    size_t soft_allocated_bytes;
+    size_t soft_trigger_bytes;
+    size_t soft_gc_start_bytes;
+    int soft_gc_pending;
+    size_t gc_forced_count;
+    size_t gc_reclaimed_bytes;
+    size_t gc_idle_allocations;
+    GcPauses gc_pauses;
+    double gc_pass_us[PL_GC_MODES];  /* how long the last pass in each mode took */
+    Boundary boundary;
+    struct CallbackStats* callback_stats;
+    size_t callback_count;
+    double callback_child_us;
+    struct Profile* profile;
+    struct Arena* arena;
+    struct Resolver* resolver;
+    struct Bundle* bundle;
+    char* module_cache_dir;
+    ModuleCache module_cache;
     double max_timeout_us;;
     double eval_start_us;
+    double max_cpu_time_us;
+    double eval_start_cpu_us;
+    double max_instructions;
+    double instruction_count;
+    double instructions_per_check;
+    double eval_start_instructions;
+    int exec_expired;  /* a limit was hit in the current call; stop counting */
+    double timeout_deadline_us;
+    int timeout_expired;
+    int watchdog_listed;
+    struct Duk* watchdog_prev;
+    struct Duk* watchdog_next;
 } Duk;
 
 /*
@@ -56,6 +185,12 @@ typedef struct Duk {
 SV* pl_duk_to_perl(pTHX_ duk_context* ctx, int pos);
 int pl_perl_to_duk(pTHX_ SV* value, duk_context* ctx);
 
+/*
+ * Get our Duk from any context in its heap; it is the udata for the heap
+ * allocation functions.
+ */
+Duk* pl_get_duk(duk_context* ctx);
+
 /*
  * Return a Perl string with the type of the duktape variable
  */
@@ -75,8 +210,12 @@ int pl_set_global_or_property(pTHX_ duk_context* ctx, const char* name, SV* valu
 int pl_del_global_or_property(pTHX_ duk_context* ctx, const char* name);
 SV* pl_eval(pTHX_ Duk* duk, const char* js, const char* file);
 
-/* Run the Duktape GC */
-int pl_run_gc(Duk* duk);
+/*
+ * Run the Duktape GC in one of the PL_GC_MODE_* modes; with a non-zero budget,
+ * stop before a pass that would probably take us over it.  Returns the number
+ * of passes run.
+ */
+int pl_run_gc(Duk* duk, int mode, double budget_us);
 
 SV* pl_global_objects(pTHX_ duk_context* ctx);
 
@@ -1,6 +1,10 @@
 #include <stdio.h>
 #include "pl_eventloop.h"
 #include "c_eventloop.h"
+#include "pl_util.h"
+
+/* Don't bother running the GC while idle if we would sleep less than this */
+#define IDLE_GC_MIN_WAIT_MS 5
 
 int pl_register_eventloop(Duk* duk)
 {
@@ -34,3 +38,27 @@ int pl_run_function_in_event_loop(Duk* duk, const char* func)
 
     return 0;
 }
+
+void eventloop_idle(duk_context* ctx, void* udata, int timeout)
+{
+    Duk* duk = (Duk*) udata;
+    int runs = 0;
+    UNUSED_ARG(ctx);
+
+    if (!(duk->flags & DUK_OPT_FLAG_IDLE_GC) || timeout < IDLE_GC_MIN_WAIT_MS) {
+        return;
+    }
+
+    /* if nothing was allocated since the last time, there is nothing to collect */
+    if (duk->allocation_count == duk->gc_idle_allocations) {
+        return;
+    }
+
+    /* use at most half the time we would otherwise sleep; if the pass would
+     * not fit, try again on a longer wait */
+    runs = pl_run_gc(duk, PL_GC_MODE_LIGHT, timeout * 1000.0 / 2);
+    if (runs > 0) {
+        duk->gc_pauses.idle_runs += runs;
+        duk->gc_idle_allocations = duk->allocation_count;
+    }
+}
@@ -103,13 +103,226 @@ static struct {
         "    EventLoop.deleteTimer(timer_id);\n"
         "}\n"
         "\n"
+        "/*\n"
+        " *  Job API\n"
+        " */\n"
+        "\n"
+        "function queueMicrotask(func) {\n"
+        "    if (typeof func !== 'function') {\n"
+        "        throw new TypeError('callback is not a function');\n"
+        "    }\n"
+        "    EventLoop.enqueueJob(func);\n"
+        "}\n"
+        "\n"
+    },
+    {
+        "promise.js",
+
+        "/*\n"
+        " *  Minimal Promises/A+ implementation; all reactions are run as jobs queued\n"
+        " *  with queueMicrotask(), so they never go through the timer list.\n"
+        " *\n"
+        " *  https://developer.mozilla.org/en-US/docs/Web/JavaScript/Reference/Global_Objects/Promise\n"
+        " */\n"
+        "\n"
+        "(function (global) {\n"
+        "    var PENDING = 0;\n"
+        "    var FULFILLED = 1;\n"
+        "    var REJECTED = 2;\n"
+        "\n"
+        "    if (typeof global.Promise === 'function') {\n"
+        "        return;\n"
+        "    }\n"
+        "\n"
+        "    function Promise(executor) {\n"
+        "        var fns;\n"
+        "\n"
+        "        if (!(this instanceof Promise)) {\n"
+        "            throw new TypeError('Promise must be called with new');\n"
+        "        }\n"
+        "        if (typeof executor !== 'function') {\n"
+        "            throw new TypeError('Promise executor is not a function');\n"
+        "        }\n"
+        "\n"
+        "        Object.defineProperties(this, {\n"
+        "            _state: { value: PENDING, writable: true },\n"
+        "            _value: { value: undefined, writable: true },\n"
+        "            _reactions: { value: [], writable: true }\n"
+        "        });\n"
+        "\n"
+        "        fns = createResolvingFunctions(this);\n"
+        "        try {\n"
+        "            executor(fns.resolve, fns.reject);\n"
+        "        } catch (e) {\n"
+        "            fns.reject(e);\n"
+        "        }\n"
+        "    }\n"
+        "\n"
+        "    function createResolvingFunctions(promise) {\n"
+        "        var done = false;\n"
+        "        return {\n"
+        "            resolve: function (value) {\n"
+        "                if (done) {\n"
+        "                    return;\n"
+        "                }\n"
+        "                done = true;\n"
+        "                resolvePromise(promise, value);\n"
+        "            },\n"
+        "            reject: function (reason) {\n"
+        "                if (done) {\n"
+        "                    return;\n"
+        "                }\n"
+        "                done = true;\n"
+        "                settlePromise(promise, REJECTED, reason);\n"
+        "            }\n"
+        "        };\n"
+        "    }\n"
+        "\n"
+        "    function resolvePromise(promise, value) {\n"
+        "        var then;\n"
+        "        var fns;\n"
+        "\n"
+        "        if (value === promise) {\n"
+        "            settlePromise(promise, REJECTED, new TypeError('Promise resolved with itself'));\n"
+        "            return;\n"
+        "        }\n"
+        "        if (value !== null && (typeof value === 'object' || typeof value === 'function')) {\n"
+        "            try {\n"
+        "                then = value.then;\n"
+        "            } catch (e) {\n"
+        "                settlePromise(promise, REJECTED, e);\n"
+        "                return;\n"
+        "            }\n"
+        "            if (typeof then === 'function') {\n"
+        "                fns = createResolvingFunctions(promise);\n"
+        "                queueMicrotask(function () {\n"
+        "                    try {\n"
+        "                        then.call(value, fns.resolve, fns.reject);\n"
+        "                    } catch (e) {\n"
+        "                        fns.reject(e);\n"
+        "                    }\n"
+        "                });\n"
+        "                return;\n"
+        "            }\n"
+        "        }\n"
+        "        settlePromise(promise, FULFILLED, value);\n"
+        "    }\n"
+        "\n"
+        "    function settlePromise(promise, state, value) {\n"
+        "        var reactions = promise._reactions;\n"
+        "        var j;\n"
+        "\n"
+        "        promise._state = state;\n"
+        "        promise._value = value;\n"
+        "        promise._reactions = undefined;\n"
+        "        for (j = 0; j < reactions.length; ++j) {\n"
+        "            scheduleReaction(promise, reactions[j]);\n"
+        "        }\n"
+        "    }\n"
+        "\n"
+        "    function scheduleReaction(promise, reaction) {\n"
+        "        queueMicrotask(function () {\n"
+        "            var fulfilled = promise._state === FULFILLED;\n"
+        "            var handler = fulfilled ? reaction.onFulfilled : reaction.onRejected;\n"
+        "            var result;\n"
+        "\n"
+        "            if (typeof handler !== 'function') {\n"
+        "                if (fulfilled) {\n"
+        "                    reaction.resolve(promise._value);\n"
+        "                } else {\n"
+        "                    reaction.reject(promise._value);\n"
+        "                }\n"
+        "                return;\n"
+        "            }\n"
+        "            try {\n"
+        "                result = handler(promise._value);\n"
+        "            } catch (e) {\n"
+        "                reaction.reject(e);\n"
+        "                return;\n"
+        "            }\n"
+        "            reaction.resolve(result);\n"
+        "        });\n"
+        "    }\n"
+        "\n"
+        "    Promise.prototype.then = function (onFulfilled, onRejected) {\n"
+        "        var reaction = { onFulfilled: onFulfilled, onRejected: onRejected };\n"
+        "        var derived = new Promise(function (resolve, reject) {\n"
+        "            reaction.resolve = resolve;\n"
+        "            reaction.reject = reject;\n"
+        "        });\n"
+        "\n"
+        "        if (this._state === PENDING) {\n"
+        "            this._reactions.push(reaction);\n"
+        "        } else {\n"
+        "            scheduleReaction(this, reaction);\n"
+        "        }\n"
+        "        return derived;\n"
+        "    };\n"
+        "\n"
+        "    Promise.prototype['catch'] = function (onRejected) {\n"
+        "        return this.then(undefined, onRejected);\n"
+        "    };\n"
+        "\n"
+        "    Promise.prototype['finally'] = function (onFinally) {\n"
+        "        if (typeof onFinally !== 'function') {\n"
+        "            return this.then(onFinally, onFinally);\n"
+        "        }\n"
+        "        return this.then(function (value) {\n"
+        "            return Promise.resolve(onFinally()).then(function () { return value; });\n"
+        "        }, function (reason) {\n"
+        "            return Promise.resolve(onFinally()).then(function () { throw reason; });\n"
+        "        });\n"
+        "    };\n"
+        "\n"
+        "    Promise.resolve = function (value) {\n"
+        "        if (value instanceof Promise) {\n"
+        "            return value;\n"
+        "        }\n"
+        "        return new Promise(function (resolve) { resolve(value); });\n"
+        "    };\n"
+        "\n"
+        "    Promise.reject = function (reason) {\n"
+        "        return new Promise(function (resolve, reject) { reject(reason); });\n"
+        "    };\n"
+        "\n"
+        "    Promise.all = function (values) {\n"
+        "        return new Promise(function (resolve, reject) {\n"
+        "            var items = Array.prototype.slice.call(values);\n"
+        "            var results = new Array(items.length);\n"
+        "            var remaining = items.length;\n"
+        "\n"
+        "            if (remaining === 0) {\n"
+        "                resolve(results);\n"
+        "                return;\n"
+        "            }\n"
+        "            items.forEach(function (item, index) {\n"
+        "                Promise.resolve(item).then(function (value) {\n"
+        "                    results[index] = value;\n"
+        "                    if (--remaining === 0) {\n"
+        "                        resolve(results);\n"
+        "                    }\n"
+        "                }, reject);\n"
+        "            });\n"
+        "        });\n"
+        "    };\n"
+        "\n"
+        "    Promise.race = function (values) {\n"
+        "        return new Promise(function (resolve, reject) {\n"
+        "            Array.prototype.slice.call(values).forEach(function (item) {\n"
+        "                Promise.resolve(item).then(resolve, reject);\n"
+        "            });\n"
+        "        });\n"
+        "    };\n"
+        "\n"
+        "    global.Promise = Promise;\n"
+        "})(this);\n"
     },
 };
 
 void pl_register_inlined_functions(Duk* duk)
 {
     size_t j = 0;
-    dTHX;
+    PL_DUK_THX(duk);
     for (j = 0; j < sizeof(js_inlined) / sizeof(js_inlined[0]); ++j) {
         pl_eval(aTHX_ duk, js_inlined[j].source, js_inlined[j].file_name);
     }
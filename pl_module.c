@@ -1,4 +1,7 @@
 #include "duk_module_node.h"
+#include "pl_bundle.h"
+#include "pl_bytecode.h"
+#include "pl_resolver.h"
 #include "pl_module.h"
 
 static duk_ret_t module_resolve(duk_context *ctx);
@@ -27,10 +30,31 @@ static duk_ret_t module_cb(duk_context *ctx, const char* func_name)
     /* (void) duk_type_error(ctx, "cannot find module: %s", module_id); */
 }
 
+static int has_perl_handler(duk_context *ctx, const char* func_name)
+{
+    int found = duk_get_global_string(ctx, func_name);
+    duk_pop(ctx);
+    return found;
+}
+
 static duk_ret_t module_resolve(duk_context *ctx)
 {
     /* Entry stack: [ requested_id parent_id ] */
 
+    Duk* duk = pl_get_duk(ctx);
+    if (duk->bundle || duk->resolver) {
+        const char* requested = duk_require_string(ctx, 0);
+        const char* parent = duk_get_string(ctx, 1);
+        if (duk->bundle && pl_bundle_resolve(duk->bundle, ctx, requested, parent)) {
+            return 1;
+        }
+        if (duk->resolver && pl_resolver_resolve(duk->resolver, ctx, requested, parent)) {
+            return 1;
+        }
+        if (!has_perl_handler(ctx, "perl_module_resolve")) {
+            return duk_error(ctx, DUK_ERR_ERROR, "cannot find module: %s", requested);
+        }
+    }
     return module_cb(ctx, "perl_module_resolve");
 }
 
@@ -38,6 +62,22 @@ static duk_ret_t module_load(duk_context *ctx)
 {
     /* Entry stack: [ module_id exports module ] */
 
+    Duk* duk = pl_get_duk(ctx);
+    if ((duk->flags & DUK_OPT_FLAG_SHARE_MODULES) && pl_bytecode_load_shared(ctx)) {
+        return 0;  /* already run, module.exports is all set */
+    }
+    if (duk->bundle || duk->resolver) {
+        const char* id = duk_require_string(ctx, 0);
+        if (duk->bundle && pl_bundle_load(duk->bundle, ctx, id)) {
+            return 1;
+        }
+        if (duk->resolver && pl_resolver_load(duk->resolver, ctx, id)) {
+            return 1;
+        }
+        if (!has_perl_handler(ctx, "perl_module_load")) {
+            return duk_error(ctx, DUK_ERR_ERROR, "cannot load module: %s", id);
+        }
+    }
     return module_cb(ctx, "perl_module_load");
 }
 
@@ -49,5 +89,9 @@ void pl_register_module_functions(Duk* duk)
     duk_put_prop_string(ctx, -2, "resolve");
     duk_push_c_function(ctx, module_load, DUK_VARARGS);
     duk_put_prop_string(ctx, -2, "load");
+    if ((duk->flags & DUK_OPT_FLAG_MODULE_CACHE) || duk->bundle) {
+        duk_push_c_function(ctx, pl_bytecode_compile, 2);
+        duk_put_prop_string(ctx, -2, "compile");
+    }
     duk_module_node_init(ctx);
 }
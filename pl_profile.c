@@ -0,0 +1,234 @@
+#include <stdlib.h>
+#include <string.h>
+#include "duk_callstack.h"
+#include "pl_util.h"
+#include "pl_profile.h"
+
+#define PROFILE_MAX_FRAMES   128        /* deeper stacks get truncated at the root */
+#define PROFILE_KEY_BYTES    (16 * 1024)
+#define PROFILE_INITIAL_SIZE 256        /* must be a power of two */
+
+/* One distinct call stack, in folded format, and how many times we saw it */
+typedef struct ProfileStack {
+    char* key;
+    size_t len;
+    unsigned long hash;
+    size_t count;
+} ProfileStack;
+
+struct Profile {
+    double interval_us;
+    double last_us;
+    int paused;
+    ProfileStack* table;                /* open addressing, linear probing */
+    size_t size;
+    size_t used;
+    duk_callstack_entry frames[PROFILE_MAX_FRAMES];
+    char key[PROFILE_KEY_BYTES];
+};
+
+static unsigned long profile_hash(const char* str, size_t len)
+{
+    unsigned long hash = 5381;
+    size_t j = 0;
+    for (j = 0; j < len; ++j) {
+        hash = hash * 33 + (unsigned char) str[j];
+    }
+    return hash;
+}
+
+static int profile_grow(struct Profile* profile)
+{
+    size_t size = profile->size ? profile->size * 2 : PROFILE_INITIAL_SIZE;
+    ProfileStack* table = (ProfileStack*) calloc(size, sizeof(ProfileStack));
+    size_t j = 0;
+
+    if (!table) {
+        return 0;
+    }
+    for (j = 0; j < profile->size; ++j) {
+        ProfileStack* stack = &profile->table[j];
+        size_t pos = 0;
+        if (!stack->key) {
+            continue;
+        }
+        for (pos = stack->hash & (size - 1); table[pos].key; pos = (pos + 1) & (size - 1)) {
+        }
+        table[pos] = *stack;
+    }
+    free(profile->table);
+    profile->table = table;
+    profile->size = size;
+    return 1;
+}
+
+static void profile_add(struct Profile* profile, const char* key, size_t len)
+{
+    unsigned long hash = profile_hash(key, len);
+    size_t pos = 0;
+
+    /* keep the load factor under 1/2 */
+    if ((profile->used + 1) * 2 > profile->size && !profile_grow(profile)) {
+        return;
+    }
+    for (pos = hash & (profile->size - 1); profile->table[pos].key; pos = (pos + 1) & (profile->size - 1)) {
+        ProfileStack* stack = &profile->table[pos];
+        if (stack->hash == hash && stack->len == len && memcmp(stack->key, key, len) == 0) {
+            ++stack->count;
+            return;
+        }
+    }
+    profile->table[pos].key = (char*) malloc(len);
+    if (!profile->table[pos].key) {
+        return;
+    }
+    memcpy(profile->table[pos].key, key, len);
+    profile->table[pos].len = len;
+    profile->table[pos].hash = hash;
+    profile->table[pos].count = 1;
+    ++profile->used;
+}
+
+/* Append a string, replacing the characters that have a meaning in the folded format */
+static size_t profile_append(char* key, size_t pos, const char* str, size_t len)
+{
+    size_t j = 0;
+    for (j = 0; j < len && pos < PROFILE_KEY_BYTES - 32; ++j) {
+        char c = str[j];
+        key[pos++] = (c == ';' || c == '\n' || c == '\r') ? '_' : c;
+    }
+    return pos;
+}
+
+static void profile_sample(Duk* duk, struct Profile* profile)
+{
+    size_t count = duk_get_callstack(duk->ctx, profile->frames, PROFILE_MAX_FRAMES);
+    size_t pos = 0;
+    size_t j = 0;
+
+    if (!count) {
+        return;
+    }
+    if (count == PROFILE_MAX_FRAMES) {
+        pos = profile_append(profile->key, pos, "(truncated);", 12);
+    }
+
+    /* folded stacks go from the root to the leaf */
+    for (j = count; j > 0; --j) {
+        duk_callstack_entry* frame = &profile->frames[j - 1];
+        if (frame->name && frame->name_len) {
+            pos = profile_append(profile->key, pos, frame->name, frame->name_len);
+        } else {
+            pos = profile_append(profile->key, pos, "(anonymous)", 11);
+        }
+        if (frame->native) {
+            pos = profile_append(profile->key, pos, " [native]", 9);
+        } else {
+            char line[32];
+            int len = snprintf(line, sizeof(line), ":%u)", (unsigned int) frame->line);
+            pos = profile_append(profile->key, pos, " (", 2);
+            if (frame->file) {
+                pos = profile_append(profile->key, pos, frame->file, frame->file_len);
+            }
+            pos = profile_append(profile->key, pos, line, len);
+        }
+        if (j > 1) {
+            profile->key[pos++] = ';';
+        }
+    }
+    profile_add(profile, profile->key, pos);
+}
+
+struct Profile* pl_profile_create(double interval_us)
+{
+    struct Profile* profile = (struct Profile*) calloc(1, sizeof(struct Profile));
+    if (!profile) {
+        return 0;
+    }
+    profile->interval_us = interval_us;
+    profile->last_us = now_us();
+    return profile;
+}
+
+void pl_profile_destroy(struct Profile* profile)
+{
+    if (!profile) {
+        return;
+    }
+    pl_profile_reset(profile);
+    free(profile->table);
+    free(profile);
+}
+
+void pl_profile_reset(struct Profile* profile)
+{
+    size_t j = 0;
+    for (j = 0; j < profile->size; ++j) {
+        free(profile->table[j].key);
+    }
+    if (profile->table) {
+        memset(profile->table, 0, profile->size * sizeof(ProfileStack));
+    }
+    profile->used = 0;
+    profile->last_us = now_us();
+}
+
+void pl_profile_pause(struct Profile* profile, int paused)
+{
+    profile->paused = paused;
+}
+
+void pl_profile_tick(Duk* duk)
+{
+    struct Profile* profile = duk->profile;
+    double now = 0;
+    if (profile->paused) {
+        return;
+    }
+    now = now_us();
+    if (now - profile->last_us < profile->interval_us) {
+        return;
+    }
+    profile->last_us = now;
+    profile_sample(duk, profile);
+}
+
+static int profile_compare(const void* a, const void* b)
+{
+    const ProfileStack* sa = *(const ProfileStack**) a;
+    const ProfileStack* sb = *(const ProfileStack**) b;
+    size_t len = sa->len < sb->len ? sa->len : sb->len;
+    int cmp = memcmp(sa->key, sb->key, len);
+    if (cmp) {
+        return cmp;
+    }
+    return sa->len < sb->len ? -1 : sa->len > sb->len;
+}
+
+SV* pl_profile_report(pTHX_ struct Profile* profile)
+{
+    SV* report = newSVpvs("");
+    ProfileStack** stacks = 0;
+    size_t count = 0;
+    size_t j = 0;
+
+    if (!profile || !profile->used) {
+        return report;
+    }
+
+    /* sort the stacks, so that the report is stable */
+    Newx(stacks, profile->used, ProfileStack*);
+    for (j = 0; j < profile->size; ++j) {
+        if (profile->table[j].key) {
+            stacks[count++] = &profile->table[j];
+        }
+    }
+    qsort(stacks, count, sizeof(ProfileStack*), profile_compare);
+
+    for (j = 0; j < count; ++j) {
+        sv_catpvn(report, stacks[j]->key, stacks[j]->len);
+        sv_catpvf(report, " %lu\n", (unsigned long) stacks[j]->count);
+    }
+    Safefree(stacks);
+    return report;
+}
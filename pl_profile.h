@@ -0,0 +1,33 @@
+#ifndef PL_PROFILE_H
+#define PL_PROFILE_H
+
+#include "pl_duk.h"
+
+/*
+ * A sampling profiler: every so often, while JS code is running, we record
+ * the current call stack; identical stacks are aggregated, and the result can
+ * be exported as folded stacks, as used by flame graph tools.
+ */
+
+/* While profiling, the exec timeout check runs every this many instructions */
+#define PL_PROFILE_INSTRUCTIONS_PER_CHECK 1024
+
+struct Profile;
+
+/* Create / destroy a profile, sampling every interval_us microseconds */
+struct Profile* pl_profile_create(double interval_us);
+void pl_profile_destroy(struct Profile* profile);
+
+/* Forget all samples taken so far */
+void pl_profile_reset(struct Profile* profile);
+
+/* While paused (as when setting up a VM), ticks take no samples */
+void pl_profile_pause(struct Profile* profile, int paused);
+
+/* Called periodically while running JS code; takes a sample when it is time */
+void pl_profile_tick(Duk* duk);
+
+/* Return a string with one line per stack: "frame;frame;frame count" */
+SV* pl_profile_report(pTHX_ struct Profile* profile);
+
+#endif
@@ -0,0 +1,386 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "pl_resolver.h"
+
+#define RESOLVER_PATH_MAX       4096
+#define RESOLVER_INITIAL_SIZE   64
+
+/* What we found at a given path */
+enum {
+    RESOLVER_KIND_NONE,
+    RESOLVER_KIND_FILE,
+    RESOLVER_KIND_DIR,
+};
+
+typedef struct ResolverEntry {
+    struct ResolverEntry* next;
+    unsigned long hash;
+    char* path;
+    int kind;
+    int resolved;      /* we handed out this path as a resolved module id */
+    int main_checked;  /* for directories: we already looked at package.json */
+    char* main;        /* for directories: the "main" field in package.json */
+} ResolverEntry;
+
+struct Resolver {
+    char** paths;
+    size_t path_count;
+    ResolverEntry** buckets;
+    size_t size;
+    size_t count;
+};
+
+static unsigned long hash_path(const char* path)
+{
+    unsigned long hash = 2166136261UL;  /* FNV-1a */
+    for (; *path; ++path) {
+        hash = (hash ^ (unsigned char) *path) * 16777619UL;
+    }
+    return hash;
+}
+
+static ResolverEntry* find_entry(Resolver* resolver, const char* path, unsigned long hash)
+{
+    ResolverEntry* entry = 0;
+    if (!resolver->size) {
+        return 0;
+    }
+    for (entry = resolver->buckets[hash % resolver->size]; entry; entry = entry->next) {
+        if (entry->hash == hash && strcmp(entry->path, path) == 0) {
+            return entry;
+        }
+    }
+    return 0;
+}
+
+static int grow_table(Resolver* resolver)
+{
+    size_t size = resolver->size ? resolver->size * 2 : RESOLVER_INITIAL_SIZE;
+    ResolverEntry** buckets = (ResolverEntry**) calloc(size, sizeof(ResolverEntry*));
+    size_t j = 0;
+
+    if (!buckets) {
+        return 0;
+    }
+    for (j = 0; j < resolver->size; ++j) {
+        ResolverEntry* entry = resolver->buckets[j];
+        while (entry) {
+            ResolverEntry* next = entry->next;
+            entry->next = buckets[entry->hash % size];
+            buckets[entry->hash % size] = entry;
+            entry = next;
+        }
+    }
+    free(resolver->buckets);
+    resolver->buckets = buckets;
+    resolver->size = size;
+    return 1;
+}
+
+/* Get the cached entry for a path, doing the stat() the first time */
+static ResolverEntry* lookup(Resolver* resolver, const char* path)
+{
+    unsigned long hash = hash_path(path);
+    ResolverEntry* entry = find_entry(resolver, path, hash);
+    struct stat st;
+
+    if (entry) {
+        return entry;
+    }
+    if (resolver->count >= resolver->size && !grow_table(resolver)) {
+        return 0;
+    }
+
+    entry = (ResolverEntry*) calloc(1, sizeof(ResolverEntry));
+    if (!entry) {
+        return 0;
+    }
+    entry->path = strdup(path);
+    if (!entry->path) {
+        free(entry);
+        return 0;
+    }
+    entry->hash = hash;
+    entry->kind = RESOLVER_KIND_NONE;
+    if (stat(path, &st) == 0) {
+        if (S_ISREG(st.st_mode)) {
+            entry->kind = RESOLVER_KIND_FILE;
+        } else if (S_ISDIR(st.st_mode)) {
+            entry->kind = RESOLVER_KIND_DIR;
+        }
+    }
+
+    entry->next = resolver->buckets[hash % resolver->size];
+    resolver->buckets[hash % resolver->size] = entry;
+    ++resolver->count;
+    return entry;
+}
+
+int pl_resolver_normalize(char* out, size_t size, const char* base, const char* rel)
+{
+    char joined[RESOLVER_PATH_MAX];
+    size_t len = 0;
+    char* segment = 0;
+    char* saveptr = 0;
+    int absolute = 0;
+    int written = 0;
+
+    if (rel[0] == '/' || !base || !base[0]) {
+        written = snprintf(joined, sizeof(joined), "%s", rel);
+    } else {
+        written = snprintf(joined, sizeof(joined), "%s/%s", base, rel);
+    }
+    if (written < 0 || (size_t) written >= sizeof(joined)) {
+        return 0;
+    }
+
+    absolute = joined[0] == '/';
+    out[0] = '\0';
+    for (segment = strtok_r(joined, "/", &saveptr); segment; segment = strtok_r(0, "/", &saveptr)) {
+        if (strcmp(segment, ".") == 0) {
+            continue;
+        }
+        if (strcmp(segment, "..") == 0) {
+            char* last = strrchr(out, '/');
+            const char* tail = last ? last + 1 : out;
+            if (len > 0 && strcmp(tail, "..") != 0) {
+                len = last ? (size_t) (last - out) : 0;
+                out[len] = '\0';
+                continue;
+            }
+            if (absolute) {
+                continue;  /* cannot go above the root */
+            }
+        }
+        written = snprintf(out + len, size - len, "%s%s", len > 0 ? "/" : "", segment);
+        if (written < 0 || (size_t) written >= size - len) {
+            return 0;
+        }
+        len += written;
+    }
+
+    if (absolute) {
+        if (len + 2 > size) {
+            return 0;
+        }
+        memmove(out + 1, out, len + 1);
+        out[0] = '/';
+    } else if (len == 0) {
+        snprintf(out, size, ".");
+    }
+    return 1;
+}
+
+static duk_ret_t decode_package_main(duk_context* ctx, void* udata)
+{
+    (void) udata;
+    duk_json_decode(ctx, -1);
+    duk_get_prop_string(ctx, -1, "main");
+    return 1;
+}
+
+/* Push the contents of a file as a string, or return 0 */
+static int push_file(duk_context* ctx, const char* path)
+{
+    FILE* fp = fopen(path, "rb");
+    long size = 0;
+    void* data = 0;
+
+    if (!fp) {
+        return 0;
+    }
+    if (fseek(fp, 0, SEEK_END) != 0 || (size = ftell(fp)) < 0 || fseek(fp, 0, SEEK_SET) != 0) {
+        fclose(fp);
+        return 0;
+    }
+    data = duk_push_fixed_buffer(ctx, size);
+    if (size > 0 && fread(data, 1, size, fp) != (size_t) size) {
+        fclose(fp);
+        duk_pop(ctx);
+        return 0;
+    }
+    fclose(fp);
+    duk_buffer_to_string(ctx, -1);
+    return 1;
+}
+
+/* The "main" field in dir/package.json, if any; cached in the entry */
+static const char* package_main(Resolver* resolver, duk_context* ctx, ResolverEntry* dir)
+{
+    char path[RESOLVER_PATH_MAX];
+    ResolverEntry* entry = 0;
+
+    if (dir->main_checked) {
+        return dir->main;
+    }
+    dir->main_checked = 1;
+
+    if (!pl_resolver_normalize(path, sizeof(path), dir->path, "package.json")) {
+        return 0;
+    }
+    entry = lookup(resolver, path);
+    if (!entry || entry->kind != RESOLVER_KIND_FILE || !push_file(ctx, path)) {
+        return 0;
+    }
+    if (duk_safe_call(ctx, decode_package_main, 0, 1 /*nargs*/, 1 /*nrets*/) == DUK_EXEC_SUCCESS &&
+        duk_is_string(ctx, -1)) {
+        dir->main = strdup(duk_get_string(ctx, -1));
+    }
+    duk_pop(ctx);
+    return dir->main;
+}
+
+/* If path, with one of the suffixes, is a file, push it and return 1 */
+static int try_file(Resolver* resolver, duk_context* ctx, const char* path, const char** suffixes)
+{
+    char candidate[RESOLVER_PATH_MAX];
+    int j = 0;
+
+    for (j = 0; suffixes[j]; ++j) {
+        ResolverEntry* entry = 0;
+        int written = snprintf(candidate, sizeof(candidate), "%s%s", path, suffixes[j]);
+        if (written < 0 || (size_t) written >= sizeof(candidate)) {
+            continue;
+        }
+        entry = lookup(resolver, candidate);
+        if (entry && entry->kind == RESOLVER_KIND_FILE) {
+            entry->resolved = 1;
+            duk_push_string(ctx, entry->path);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static const char* file_suffixes[] = { "", ".js", ".json", 0 };
+static const char* index_suffixes[] = { "/index.js", "/index.json", 0 };
+
+static int try_candidate(Resolver* resolver, duk_context* ctx, const char* path)
+{
+    ResolverEntry* entry = 0;
+    const char* main = 0;
+
+    if (try_file(resolver, ctx, path, file_suffixes)) {
+        return 1;
+    }
+
+    entry = lookup(resolver, path);
+    if (!entry || entry->kind != RESOLVER_KIND_DIR) {
+        return 0;
+    }
+    main = package_main(resolver, ctx, entry);
+    if (main) {
+        char main_path[RESOLVER_PATH_MAX];
+        if (pl_resolver_normalize(main_path, sizeof(main_path), path, main) &&
+            (try_file(resolver, ctx, main_path, file_suffixes) ||
+             try_file(resolver, ctx, main_path, index_suffixes))) {
+            return 1;
+        }
+    }
+    return try_file(resolver, ctx, path, index_suffixes);
+}
+
+Resolver* pl_resolver_create(void)
+{
+    return (Resolver*) calloc(1, sizeof(Resolver));
+}
+
+void pl_resolver_destroy(Resolver* resolver)
+{
+    size_t j = 0;
+
+    if (!resolver) {
+        return;
+    }
+    for (j = 0; j < resolver->path_count; ++j) {
+        free(resolver->paths[j]);
+    }
+    free(resolver->paths);
+    for (j = 0; j < resolver->size; ++j) {
+        ResolverEntry* entry = resolver->buckets[j];
+        while (entry) {
+            ResolverEntry* next = entry->next;
+            free(entry->path);
+            free(entry->main);
+            free(entry);
+            entry = next;
+        }
+    }
+    free(resolver->buckets);
+    free(resolver);
+}
+
+int pl_resolver_add_path(Resolver* resolver, const char* path)
+{
+    char** paths = (char**) realloc(resolver->paths, (resolver->path_count + 1) * sizeof(char*));
+    if (!paths) {
+        return 0;
+    }
+    resolver->paths = paths;
+    resolver->paths[resolver->path_count] = strdup(path);
+    if (!resolver->paths[resolver->path_count]) {
+        return 0;
+    }
+    ++resolver->path_count;
+    return 1;
+}
+
+int pl_resolver_resolve(Resolver* resolver, duk_context* ctx, const char* requested, const char* parent)
+{
+    char path[RESOLVER_PATH_MAX];
+    size_t j = 0;
+
+    if (requested[0] == '/' ||
+        strncmp(requested, "./", 2) == 0 ||
+        strncmp(requested, "../", 3) == 0) {
+        /* relative to the directory of the requiring module */
+        char base[RESOLVER_PATH_MAX];
+        const char* slash = parent ? strrchr(parent, '/') : 0;
+        if (slash) {
+            size_t len = slash - parent;
+            if (len >= sizeof(base)) {
+                return 0;
+            }
+            memcpy(base, parent, len);
+            base[len] = '\0';
+            if (len == 0) {
+                snprintf(base, sizeof(base), "/");
+            }
+        } else {
+            snprintf(base, sizeof(base), ".");
+        }
+        return pl_resolver_normalize(path, sizeof(path), base, requested) &&
+               try_candidate(resolver, ctx, path);
+    }
+
+    for (j = 0; j < resolver->path_count; ++j) {
+        if (pl_resolver_normalize(path, sizeof(path), resolver->paths[j], requested) &&
+            try_candidate(resolver, ctx, path)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int pl_resolver_load(Resolver* resolver, duk_context* ctx, const char* id)
+{
+    ResolverEntry* entry = find_entry(resolver, id, hash_path(id));
+    size_t len = strlen(id);
+
+    if (!entry || !entry->resolved) {
+        return 0;
+    }
+    if (!push_file(ctx, id)) {
+        (void) duk_error(ctx, DUK_ERR_ERROR, "cannot read module: %s", id);
+        return 0;
+    }
+    if (len > 5 && strcmp(id + len - 5, ".json") == 0) {
+        duk_push_string(ctx, "module.exports = ");
+        duk_insert(ctx, -2);
+        duk_push_string(ctx, ";");
+        duk_concat(ctx, 3);
+    }
+    return 1;
+}
@@ -0,0 +1,46 @@
+#ifndef PL_RESOLVER_H
+#define PL_RESOLVER_H
+
+#include "duktape.h"
+
+/*
+ * A native module resolver, used instead of the Perl callbacks when the
+ * module_paths option is given.
+ *
+ * Resolution follows node.js: ids starting with './', '../' or '/' are
+ * looked up relative to the requiring module, any other id is looked up in
+ * each of the search paths, in order.  For each candidate X we try the file
+ * X, X.js, X.json, and if X is a directory, the file named by the "main"
+ * field in X/package.json, X/index.js and X/index.json.
+ *
+ * Every filesystem lookup is cached for the lifetime of the resolver, so each
+ * path is stat()ed at most once.
+ */
+
+typedef struct Resolver Resolver;
+
+Resolver* pl_resolver_create(void);
+void pl_resolver_destroy(Resolver* resolver);
+
+/* Add a directory to the list of search paths */
+int pl_resolver_add_path(Resolver* resolver, const char* path);
+
+/*
+ * Resolve the requested id from the module with the given parent id; if it
+ * can be resolved, push the resolved id and return 1, otherwise return 0.
+ */
+int pl_resolver_resolve(Resolver* resolver, duk_context* ctx, const char* requested, const char* parent);
+
+/*
+ * If the id was resolved by us, push the module source and return 1,
+ * otherwise return 0.  Throws if the file cannot be read.
+ */
+int pl_resolver_load(Resolver* resolver, duk_context* ctx, const char* id);
+
+/*
+ * Join base and rel (unless rel is absolute) into out, getting rid of empty,
+ * '.' and '..' segments; returns 0 if the result does not fit.
+ */
+int pl_resolver_normalize(char* out, size_t size, const char* base, const char* rel);
+
+#endif
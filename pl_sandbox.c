@@ -1,5 +1,8 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include "pl_arena.h"
+#include "pl_watchdog.h"
+#include "pl_profile.h"
 #include "pl_util.h"
 #include "pl_sandbox.h"
 
@@ -19,8 +22,9 @@
 #endif
 
 /*
- * Memory allocator which backs to standard library memory functions but keeps
- * a small header to track current allocation size.
+ * Memory allocator which backs to standard library memory functions (or, for
+ * small blocks, to a per-VM arena with size classes) but keeps a small header
+ * to track current allocation size.
  */
 
 typedef struct {
@@ -35,17 +39,124 @@ typedef struct {
     } u;
 } alloc_hdr;
 
-static void sandbox_error(size_t size, const char* func)
+static void sandbox_error(Duk* duk, size_t size, const char* func)
 {
-    dTHX;
+    PL_DUK_THX(duk);
     PerlIO_printf(PerlIO_stderr(), "duktape sandbox maximum allocation size reached, %ld requested in %s\n",
                   (long) size, func);
 }
 
+/*
+ * These get / release the raw memory for a block, including its header.  When
+ * the VM has an arena, all blocks come from it; otherwise they come from the
+ * standard library.
+ */
+static alloc_hdr* sandbox_raw_alloc(Duk* duk, size_t size)
+{
+    size_t total = size + sizeof(alloc_hdr);
+    if (duk->arena) {
+        return (alloc_hdr*) pl_arena_alloc(duk->arena, total);
+    }
+    return (alloc_hdr*) malloc(total);
+}
+
+static void sandbox_raw_free(Duk* duk, alloc_hdr* hdr)
+{
+    if (duk->arena) {
+        pl_arena_free(duk->arena, hdr, hdr->u.sz + sizeof(alloc_hdr));
+        return;
+    }
+    free((void*) hdr);
+}
+
+static alloc_hdr* sandbox_raw_realloc(Duk* duk, alloc_hdr* hdr, size_t size)
+{
+    size_t total = size + sizeof(alloc_hdr);
+    if (duk->arena) {
+        return (alloc_hdr*) pl_arena_realloc(duk->arena, hdr, hdr->u.sz + sizeof(alloc_hdr), total);
+    }
+    return (alloc_hdr*) realloc((void*) hdr, total);
+}
+
+/*
+ * Keep track of live, peak and cumulative allocated bytes; these counters are
+ * what the stats are computed from.
+ */
+static void sandbox_account_alloc(Duk* duk, size_t size)
+{
+    duk->total_allocated_bytes += size;
+    duk->cumulative_allocated_bytes += size;
+    ++duk->allocation_count;
+    if (duk->peak_allocated_bytes < duk->total_allocated_bytes) {
+        duk->peak_allocated_bytes = duk->total_allocated_bytes;
+    }
+}
+
+static void sandbox_account_free(Duk* duk, size_t size)
+{
+    duk->total_allocated_bytes -= size;
+    duk->cumulative_freed_bytes += size;
+}
+
+/*
+ * Called on the first allocation after we forced a GC: account for the memory
+ * the GC reclaimed, and move the soft trigger up if most of the heap is still
+ * live, so that we don't keep forcing useless collections.  The headroom grows
+ * with the live heap, so a growing heap is collected a logarithmic number of
+ * times instead of once every few bytes; but we never let the trigger go over
+ * the hard limit, so we still collect before failing an allocation.
+ */
+static void sandbox_soft_gc_done(Duk* duk)
+{
+    size_t live = duk->total_allocated_bytes;
+    size_t headroom = duk->soft_allocated_bytes / 4;
+    size_t trigger = 0;
+
+    duk->soft_gc_pending = 0;
+    if (duk->soft_gc_start_bytes > live) {
+        duk->gc_reclaimed_bytes += duk->soft_gc_start_bytes - live;
+    }
+    if (headroom < live / 2) {
+        headroom = live / 2;
+    }
+    trigger = live + headroom > duk->soft_allocated_bytes ? live + headroom : duk->soft_allocated_bytes;
+    if (duk->max_allocated_bytes > 0 && trigger > duk->max_allocated_bytes) {
+        trigger = duk->max_allocated_bytes;
+    }
+    duk->soft_trigger_bytes = trigger;
+}
+
+/*
+ * Check whether the heap can go from holding a block of old_size bytes to
+ * holding one of size bytes.  Going over the soft limit fails one allocation,
+ * silently; Duktape reacts to that by running a mark-and-sweep (which also
+ * reclaims reference cycles) and retrying, which we then let through.  Going
+ * over the hard limit is an error.
+ */
+static int sandbox_allowed(Duk* duk, size_t old_size, size_t size, const char* func)
+{
+    size_t total = duk->total_allocated_bytes - old_size + size;
+
+    if (duk->soft_gc_pending) {
+        sandbox_soft_gc_done(duk);
+    } else if (duk->soft_trigger_bytes > 0 && size > old_size && total > duk->soft_trigger_bytes) {
+        duk->soft_gc_pending = 1;
+        duk->soft_gc_start_bytes = duk->total_allocated_bytes;
+        ++duk->gc_forced_count;
+        return 0;
+    }
+
+    if (duk->max_allocated_bytes > 0 && total > duk->max_allocated_bytes) {
+        sandbox_error(duk, size, func);
+        return 0;
+    }
+    return 1;
+}
+
 #if defined(SANDBOX_DEBUG_MEMORY) && SANDBOX_DEBUG_MEMORY > 0
 static void sandbox_dump_memstate(Duk* duk)
 {
-    dTHX;
+    PL_DUK_THX(duk);
     PerlIO_printf(PerlIO_stderr(), "duktape total allocated: %ld\n",
                   (long) duk->total_allocated_bytes);
 }
@@ -54,9 +165,9 @@ static void sandbox_dump_memstate(Duk* duk)
 #if defined(SANDBOX_DEBUG_RUNTIME) && SANDBOX_DEBUG_RUNTIME > 0
 static void sandbox_dump_timestate(Duk* duk)
 {
-    dTHX;
-    PerlIO_printf(PerlIO_stderr(), "duktape timeout has happened, limit is %f us\n",
-                  duk->max_timeout_us);
+    PL_DUK_THX(duk);
+    PerlIO_printf(PerlIO_stderr(), "duktape timeout has happened, limits are %f us, %f cpu us, %f instructions\n",
+                  duk->max_timeout_us, duk->max_cpu_time_us, duk->max_instructions);
 }
 #endif
 
@@ -70,18 +181,16 @@ void* pl_sandbox_alloc(void* udata, duk_size_t size)
         return NULL;
     }
 
-    if (duk->max_allocated_bytes > 0 &&
-        duk->total_allocated_bytes + size > duk->max_allocated_bytes) {
-        sandbox_error(size, "pl_sandbox_alloc");
+    if (!sandbox_allowed(duk, 0, size, "pl_sandbox_alloc")) {
         return NULL;
     }
 
-    hdr = (alloc_hdr*) malloc(size + sizeof(alloc_hdr));
+    hdr = sandbox_raw_alloc(duk, size);
     if (!hdr) {
         return NULL;
     }
     hdr->u.sz = size;
-    duk->total_allocated_bytes += size;
+    sandbox_account_alloc(duk, size);
     SANDBOX_DUMP_MEMORY(duk);
     return (void*) (hdr + 1);
 }
@@ -99,24 +208,22 @@ void* pl_sandbox_realloc(void* udata, void* ptr, duk_size_t size)
         old_size = hdr->u.sz;
 
         if (size == 0) {
-            duk->total_allocated_bytes -= old_size;
-            free((void*) hdr);
+            sandbox_account_free(duk, old_size);
+            sandbox_raw_free(duk, hdr);
             SANDBOX_DUMP_MEMORY(duk);
             return NULL;
         } else {
-            if (duk->max_allocated_bytes > 0 &&
-                duk->total_allocated_bytes - old_size + size > duk->max_allocated_bytes) {
-                sandbox_error(size, "pl_sandbox_realloc");
+            if (!sandbox_allowed(duk, old_size, size, "pl_sandbox_realloc")) {
                 return NULL;
             }
 
-            t = realloc((void*) hdr, size + sizeof(alloc_hdr));
+            t = sandbox_raw_realloc(duk, hdr, size);
             if (!t) {
                 return NULL;
             }
             hdr = (alloc_hdr*) t;
-            duk->total_allocated_bytes -= old_size;
-            duk->total_allocated_bytes += size;
+            sandbox_account_free(duk, old_size);
+            sandbox_account_alloc(duk, size);
             hdr->u.sz = size;
             SANDBOX_DUMP_MEMORY(duk);
             return (void*) (hdr + 1);
@@ -124,18 +231,16 @@ void* pl_sandbox_realloc(void* udata, void* ptr, duk_size_t size)
     } else if (size == 0) {
         return NULL;
     } else {
-        if (duk->max_allocated_bytes > 0 &&
-            duk->total_allocated_bytes + size > duk->max_allocated_bytes) {
-            sandbox_error(size, "pl_sandbox_realloc");
+        if (!sandbox_allowed(duk, 0, size, "pl_sandbox_realloc")) {
             return NULL;
         }
 
-        hdr = (alloc_hdr*) malloc(size + sizeof(alloc_hdr));
+        hdr = sandbox_raw_alloc(duk, size);
         if (!hdr) {
             return NULL;
         }
         hdr->u.sz = size;
-        duk->total_allocated_bytes += size;
+        sandbox_account_alloc(duk, size);
         SANDBOX_DUMP_MEMORY(duk);
         return (void*) (hdr + 1);
     }
@@ -151,24 +256,65 @@ void pl_sandbox_free(void* udata, void* ptr)
         return;
     }
     hdr = (alloc_hdr*) (((char*) ptr) - sizeof(alloc_hdr));
-    duk->total_allocated_bytes -= hdr->u.sz;
-    free((void*) hdr);
+    sandbox_account_free(duk, hdr->u.sz);
+    sandbox_raw_free(duk, hdr);
     SANDBOX_DUMP_MEMORY(duk);
 }
 
-int pl_exec_timeout(void *udata)
+static int sandbox_exec_expired(Duk* duk)
 {
-    Duk* duk = (Duk*) udata;
-    double elapsed_us = 0;
+    if (duk->max_instructions > 0 &&
+        duk->instruction_count - duk->eval_start_instructions > duk->max_instructions) {
+        return 1;
+    }
+
+    if (duk->max_cpu_time_us > 0 &&
+        cpu_now_us() - duk->eval_start_cpu_us > duk->max_cpu_time_us) {
+        return 1;
+    }
+
     if (duk->max_timeout_us <= 0) {
         return 0;
     }
 
-    elapsed_us = now_us() - duk->eval_start_us;
-    if (elapsed_us <= duk->max_timeout_us) {
+    if (duk->flags & DUK_OPT_FLAG_TIMEOUT_WATCHDOG) {
+        return pl_watchdog_expired(duk);
+    }
+
+    return now_us() - duk->eval_start_us > duk->max_timeout_us;
+}
+
+duk_size_t pl_sandbox_block_size(void* udata, void* ptr)
+{
+    alloc_hdr* hdr = (alloc_hdr*) (((char*) ptr) - sizeof(alloc_hdr));
+    UNUSED_ARG(udata);
+    return hdr->u.sz;
+}
+
+int pl_exec_timeout(void *udata)
+{
+    Duk* duk = (Duk*) udata;
+
+    /*
+     * Once we said the call is over, duktape calls us again at each catchpoint
+     * while the error unwinds, without running any instructions in between.
+     */
+    if (duk->exec_expired) {
+        return 1;
+    }
+
+    /* we get called once per batch of instructions, so count them here */
+    duk->instruction_count += duk->instructions_per_check;
+
+    if (duk->profile) {
+        pl_profile_tick(duk);
+    }
+
+    if (!sandbox_exec_expired(duk)) {
         return 0;
     }
 
+    duk->exec_expired = 1;
     SANDBOX_DUMP_RUNTIME(duk);
     return 1;
 }
@@ -3,10 +3,20 @@
 
 #include "pl_duk.h"
 
+/*
+ * By default, Duktape calls our execution timeout check once every this many
+ * bytecode instructions (DUK_HTHREAD_INTCTR_DEFAULT); this is the granularity
+ * for the instruction count and budget.
+ */
+#define PL_SANDBOX_INSTRUCTIONS_PER_CHECK (256L * 1024L)
+
 void* pl_sandbox_alloc(void* udata, duk_size_t size);
 void* pl_sandbox_realloc(void* udata, void* ptr, duk_size_t size);
 void pl_sandbox_free(void* udata, void* ptr);
 
 int pl_exec_timeout(void *udata);
 
+/* Size of a block allocated with pl_sandbox_alloc / pl_sandbox_realloc */
+duk_size_t pl_sandbox_block_size(void* udata, void* ptr);
+
 #endif
@@ -1,6 +1,23 @@
+#include "duk_heap_info.h"
+#include "pl_sandbox.h"
 #include "pl_util.h"
 #include "pl_stats.h"
 
+/* Must be kept in sync with the PL_STATS_OP_* values */
+static const char* op_names[PL_STATS_OP_COUNT] = {
+    "compile",
+    "run",
+    "get",
+    "exists",
+    "typeof",
+    "instanceof",
+    "set",
+    "remove",
+    "dispatch",
+    "run_gc",
+    "global_objects",
+};
+
 static void save_stat(pTHX_ Duk* duk, const char* category, const char* name, double value)
 {
     STRLEN clen = strlen(category);
@@ -43,17 +60,497 @@ void pl_stats_start(pTHX_ Duk* duk, Stats* stats)
         return;
     }
     stats->t0 = now_us();
-    stats->m0 = total_memory_pages() * duk->pagesize_bytes;
+    stats->cpu0 = cpu_now_us();
+    stats->instructions0 = duk->instruction_count;
+    stats->allocated0 = duk->cumulative_allocated_bytes;
+    stats->freed0 = duk->cumulative_freed_bytes;
+    stats->allocations0 = duk->allocation_count;
+    stats->gc_forced0 = duk->gc_forced_count;
+    stats->gc_reclaimed0 = duk->gc_reclaimed_bytes;
+
+    /* track the peak for this operation, but remember the outer one */
+    stats->peak0 = duk->peak_allocated_bytes;
+    duk->peak_allocated_bytes = duk->total_allocated_bytes;
+}
+
+static int latency_bucket(double us)
+{
+    int power = 0;
+    double base = 1.0;
+
+    if (us < 1.0) {
+        return 0;
+    }
+    while (power < 31 && us >= base * 2.0) {
+        ++power;
+        base *= 2.0;
+    }
+    if (us >= base * 2.0) {
+        return PL_STATS_LATENCY_BUCKETS - 1;
+    }
+    return 1 + power * PL_STATS_SUB_BUCKETS + (int) ((us - base) * PL_STATS_SUB_BUCKETS / base);
+}
+
+static double latency_bucket_limit(int bucket)
+{
+    double base = 1.0;
+    int power = 0;
+
+    if (bucket == 0) {
+        return 1.0;
+    }
+    for (power = (bucket - 1) / PL_STATS_SUB_BUCKETS; power > 0; --power) {
+        base *= 2.0;
+    }
+    return base + base * ((bucket - 1) % PL_STATS_SUB_BUCKETS + 1) / PL_STATS_SUB_BUCKETS;
+}
+
+/* Upper limit for the latency of the given fraction of the operations */
+static double latency_percentile(OpStats* op, double fraction)
+{
+    double wanted = fraction * op->count;
+    double seen = 0;
+    int j = 0;
+
+    for (j = 0; j < PL_STATS_LATENCY_BUCKETS; ++j) {
+        seen += op->histogram[j];
+        if (seen >= wanted) {
+            double limit = latency_bucket_limit(j);
+            return limit < op->max_us ? limit : op->max_us;
+        }
+    }
+    return op->max_us;
 }
 
-void pl_stats_stop(pTHX_ Duk* duk, Stats* stats, const char* name)
+void pl_stats_stop(pTHX_ Duk* duk, Stats* stats, int op)
 {
+    OpStats* data = 0;
+    double elapsed_us = 0;
+    size_t allocated = 0;
+    size_t peak = 0;
+
     if (!(duk->flags & DUK_OPT_FLAG_GATHER_STATS)) {
         return;
     }
+    if (!duk->op_stats) {
+        duk->op_stats = (OpStats*) calloc(PL_STATS_OP_COUNT, sizeof(OpStats));
+        if (!duk->op_stats) {
+            croak("Could not allocate memory for stats\n");
+        }
+    }
+
     stats->t1 = now_us();
-    stats->m1 = total_memory_pages() * duk->pagesize_bytes;
+    elapsed_us = stats->t1 - stats->t0;
+    allocated = duk->cumulative_allocated_bytes - stats->allocated0;
+    peak = duk->peak_allocated_bytes;
+    if (duk->peak_allocated_bytes < stats->peak0) {
+        duk->peak_allocated_bytes = stats->peak0;
+    }
+
+    data = &duk->op_stats[op];
+    if (!data->count || data->min_us > elapsed_us) {
+        data->min_us = elapsed_us;
+    }
+    if (data->max_us < elapsed_us) {
+        data->max_us = elapsed_us;
+    }
+    ++data->count;
+    data->sum_us += elapsed_us;
+    ++data->histogram[latency_bucket(elapsed_us)];
+
+    data->elapsed_us = elapsed_us;
+    data->cpu_us = cpu_now_us() - stats->cpu0;
+    data->instructions = duk->instruction_count - stats->instructions0;
+    data->allocated_bytes = allocated;
+    data->freed_bytes = duk->cumulative_freed_bytes - stats->freed0;
+    data->allocations = duk->allocation_count - stats->allocations0;
+    data->live_bytes = duk->total_allocated_bytes;
+    data->peak_bytes = peak;
+    data->gc_forced = duk->gc_forced_count - stats->gc_forced0;
+    data->gc_reclaimed_bytes = duk->gc_reclaimed_bytes - stats->gc_reclaimed0;
+
+    /* compiling and collecting garbage do not run any JS code */
+    if (op != PL_STATS_OP_COMPILE && op != PL_STATS_OP_RUN_GC) {
+        ++duk->boundary.entries;
+    }
+}
+
+static void save_op_histogram(pTHX_ Duk* duk, const char* name, OpStats* data)
+{
+    SV** found = hv_fetch(duk->stats, name, strlen(name), 0);
+    HV* histogram = newHV();
+    SV* ref = newRV_noinc((SV*) histogram);
+    int j = 0;
+
+    /* keyed by the upper limit of each bucket, in us; only non-empty buckets */
+    for (j = 0; j < PL_STATS_LATENCY_BUCKETS; ++j) {
+        char key[32];
+        int klen = 0;
+        if (!data->histogram[j]) {
+            continue;
+        }
+        klen = snprintf(key, sizeof(key), "%g", latency_bucket_limit(j));
+        hv_store(histogram, key, klen, newSVuv(data->histogram[j]), 0);
+    }
+    if (!found || !hv_store((HV*) SvRV(*found), "histogram", 9, ref, 0)) {
+        SvREFCNT_dec(ref);
+        croak("Could not create entry histogram for category %s in stats\n", name);
+    }
+}
+
+static void save_gc_stats(pTHX_ Duk* duk)
+{
+    GcPauses* pauses = &duk->gc_pauses;
+    AV* histogram = 0;
+    SV* ref = 0;
+    SV** found = 0;
+    int j = 0;
+
+    if (!pauses->runs) {
+        return;
+    }
+    save_stat(aTHX_ duk, "gc", "runs", pauses->runs);
+    save_stat(aTHX_ duk, "gc", "idle_runs", pauses->idle_runs);
+    save_stat(aTHX_ duk, "gc", "pause_total_us", pauses->total_us);
+    save_stat(aTHX_ duk, "gc", "pause_max_us", pauses->max_us);
+
+    histogram = newAV();
+    for (j = 0; j < PL_GC_PAUSE_BUCKETS; ++j) {
+        av_push(histogram, newSVuv(pauses->histogram[j]));
+    }
+    ref = newRV_noinc((SV*) histogram);
+    found = hv_fetch(duk->stats, "gc", 2, 0);
+    if (!found || !hv_store((HV*) SvRV(*found), "pause_histogram", 15, ref, 0)) {
+        SvREFCNT_dec(ref);
+        croak("Could not create entry pause_histogram for category gc in stats\n");
+    }
+}
+
+static void save_boundary_stats(pTHX_ Duk* duk)
+{
+    Boundary* boundary = &duk->boundary;
+
+    save_stat(aTHX_ duk, "boundary", "callbacks", boundary->callbacks);
+    save_stat(aTHX_ duk, "boundary", "entries", boundary->entries);
+    save_stat(aTHX_ duk, "boundary", "values_to_perl", boundary->values_to_perl);
+    save_stat(aTHX_ duk, "boundary", "values_to_js", boundary->values_to_js);
+    save_stat(aTHX_ duk, "boundary", "bytes_to_perl", boundary->bytes_to_perl);
+    save_stat(aTHX_ duk, "boundary", "bytes_to_js", boundary->bytes_to_js);
+    save_stat(aTHX_ duk, "boundary", "convert_to_perl_us", boundary->convert_to_perl_us);
+    save_stat(aTHX_ duk, "boundary", "convert_to_js_us", boundary->convert_to_js_us);
+}
+
+static void save_module_cache_stats(pTHX_ Duk* duk)
+{
+    ModuleCache* cache = &duk->module_cache;
+
+    if (!(duk->flags & DUK_OPT_FLAG_MODULE_CACHE) && !duk->bundle) {
+        return;
+    }
+    save_stat(aTHX_ duk, "module_cache", "hits", cache->hits);
+    save_stat(aTHX_ duk, "module_cache", "disk_hits", cache->disk_hits);
+    save_stat(aTHX_ duk, "module_cache", "bundle_hits", cache->bundle_hits);
+    save_stat(aTHX_ duk, "module_cache", "shared_hits", cache->shared_hits);
+    save_stat(aTHX_ duk, "module_cache", "misses", cache->misses);
+}
+
+static void save_callback_stats(pTHX_ Duk* duk)
+{
+    HV* callbacks = 0;
+    SV* ref = 0;
+    size_t j = 0;
+
+    for (j = 0; j < duk->callback_count; ++j) {
+        CallbackStats* data = &duk->callback_stats[j];
+        HV* entry = 0;
+        if (!data->calls) {
+            continue;
+        }
+        if (!callbacks) {
+            callbacks = newHV();
+        }
+        entry = newHV();
+        hv_store(entry, "calls", 5, newSVuv(data->calls), 0);
+        hv_store(entry, "total_us", 8, newSVnv(data->total_us), 0);
+        hv_store(entry, "self_us", 7, newSVnv(data->self_us), 0);
+        hv_store(callbacks, data->name, strlen(data->name), newRV_noinc((SV*) entry), 0);
+    }
+    if (!callbacks) {
+        return;
+    }
+    ref = newRV_noinc((SV*) callbacks);
+    if (!hv_store(duk->stats, "callbacks", 9, ref, 0)) {
+        SvREFCNT_dec(ref);
+        croak("Could not create category callbacks in stats\n");
+    }
+}
+
+void pl_stats_save(pTHX_ Duk* duk)
+{
+    int op = 0;
+
+    if (!(duk->flags & DUK_OPT_FLAG_GATHER_STATS)) {
+        return;
+    }
+
+    for (op = 0; duk->op_stats && op < PL_STATS_OP_COUNT; ++op) {
+        OpStats* data = &duk->op_stats[op];
+        const char* name = op_names[op];
+        if (!data->count) {
+            continue;
+        }
+        save_stat(aTHX_ duk, name, "count", data->count);
+        save_stat(aTHX_ duk, name, "sum_us", data->sum_us);
+        save_stat(aTHX_ duk, name, "min_us", data->min_us);
+        save_stat(aTHX_ duk, name, "max_us", data->max_us);
+        save_stat(aTHX_ duk, name, "mean_us", data->sum_us / data->count);
+        save_stat(aTHX_ duk, name, "p50_us", latency_percentile(data, 0.50));
+        save_stat(aTHX_ duk, name, "p90_us", latency_percentile(data, 0.90));
+        save_stat(aTHX_ duk, name, "p99_us", latency_percentile(data, 0.99));
+        save_op_histogram(aTHX_ duk, name, data);
+
+        save_stat(aTHX_ duk, name, "elapsed_us", data->elapsed_us);
+        save_stat(aTHX_ duk, name, "cpu_us", data->cpu_us);
+        save_stat(aTHX_ duk, name, "instructions", data->instructions);
+        save_stat(aTHX_ duk, name, "memory_bytes", data->allocated_bytes);
+        save_stat(aTHX_ duk, name, "allocated_bytes", data->allocated_bytes);
+        save_stat(aTHX_ duk, name, "freed_bytes", data->freed_bytes);
+        save_stat(aTHX_ duk, name, "allocations", data->allocations);
+        save_stat(aTHX_ duk, name, "live_bytes", data->live_bytes);
+        save_stat(aTHX_ duk, name, "peak_bytes", data->peak_bytes);
+        save_stat(aTHX_ duk, name, "gc_forced", data->gc_forced);
+        save_stat(aTHX_ duk, name, "gc_reclaimed_bytes", data->gc_reclaimed_bytes);
+    }
+
+    save_gc_stats(aTHX_ duk);
+    save_boundary_stats(aTHX_ duk);
+    save_callback_stats(aTHX_ duk);
+    save_module_cache_stats(aTHX_ duk);
+}
+
+/* Fields for each operation in pl_stats_raw() */
+static const char* raw_op_fields[] = {
+    "count", "sum_us", "min_us", "max_us", "p50_us", "p90_us", "p99_us",
+};
+#define RAW_OP_FIELDS (sizeof(raw_op_fields) / sizeof(raw_op_fields[0]))
+
+static const char* raw_other_fields[] = {
+    "gc.runs", "gc.idle_runs", "gc.pause_total_us", "gc.pause_max_us",
+    "boundary.callbacks", "boundary.entries",
+    "boundary.values_to_perl", "boundary.values_to_js",
+    "boundary.bytes_to_perl", "boundary.bytes_to_js",
+    "boundary.convert_to_perl_us", "boundary.convert_to_js_us",
+};
+#define RAW_OTHER_FIELDS (sizeof(raw_other_fields) / sizeof(raw_other_fields[0]))
+
+#define RAW_FIELDS (1 + PL_STATS_OP_COUNT * RAW_OP_FIELDS + RAW_OTHER_FIELDS)
+
+SV* pl_stats_raw(pTHX_ Duk* duk)
+{
+    double values[RAW_FIELDS];
+    double* value = values;
+    int op = 0;
+
+    memset(values, 0, sizeof(values));
+    *value++ = PL_STATS_RAW_VERSION;
+    for (op = 0; op < PL_STATS_OP_COUNT; ++op) {
+        OpStats* data = duk->op_stats ? &duk->op_stats[op] : 0;
+        if (data && data->count) {
+            value[0] = data->count;
+            value[1] = data->sum_us;
+            value[2] = data->min_us;
+            value[3] = data->max_us;
+            value[4] = latency_percentile(data, 0.50);
+            value[5] = latency_percentile(data, 0.90);
+            value[6] = latency_percentile(data, 0.99);
+        }
+        value += RAW_OP_FIELDS;
+    }
+
+    /* must be kept in sync with raw_other_fields */
+    *value++ = duk->gc_pauses.runs;
+    *value++ = duk->gc_pauses.idle_runs;
+    *value++ = duk->gc_pauses.total_us;
+    *value++ = duk->gc_pauses.max_us;
+    *value++ = duk->boundary.callbacks;
+    *value++ = duk->boundary.entries;
+    *value++ = duk->boundary.values_to_perl;
+    *value++ = duk->boundary.values_to_js;
+    *value++ = duk->boundary.bytes_to_perl;
+    *value++ = duk->boundary.bytes_to_js;
+    *value++ = duk->boundary.convert_to_perl_us;
+    *value++ = duk->boundary.convert_to_js_us;
+
+    return newSVpvn((const char*) values, sizeof(values));
+}
+
+SV* pl_stats_raw_names(pTHX)
+{
+    AV* names = newAV();
+    char name[100];
+    int op = 0;
+    size_t j = 0;
+
+    av_push(names, newSVpvs("version"));
+    for (op = 0; op < PL_STATS_OP_COUNT; ++op) {
+        for (j = 0; j < RAW_OP_FIELDS; ++j) {
+            int len = snprintf(name, sizeof(name), "%s.%s", op_names[op], raw_op_fields[j]);
+            av_push(names, newSVpvn(name, len));
+        }
+    }
+    for (j = 0; j < RAW_OTHER_FIELDS; ++j) {
+        av_push(names, newSVpv(raw_other_fields[j], 0));
+    }
+    return newRV_noinc((SV*) names);
+}
+
+void pl_stats_reset(Duk* duk)
+{
+    size_t j = 0;
+
+    if (duk->op_stats) {
+        memset(duk->op_stats, 0, PL_STATS_OP_COUNT * sizeof(OpStats));
+    }
+    memset(&duk->gc_pauses, 0, sizeof(GcPauses));
+    memset(&duk->boundary, 0, sizeof(Boundary));
+    memset(&duk->module_cache, 0, sizeof(ModuleCache));
+
+    /* keep the names, the JS functions still refer to their slots */
+    for (j = 0; j < duk->callback_count; ++j) {
+        CallbackStats* data = &duk->callback_stats[j];
+        data->calls = 0;
+        data->total_us = data->self_us = 0;
+    }
+}
+
+void pl_stats_destroy(Duk* duk)
+{
+    size_t j = 0;
+
+    free(duk->op_stats);
+    duk->op_stats = 0;
+
+    for (j = 0; j < duk->callback_count; ++j) {
+        free(duk->callback_stats[j].name);
+    }
+    free(duk->callback_stats);
+    duk->callback_stats = 0;
+    duk->callback_count = 0;
+}
+
+size_t pl_stats_callback_slot(Duk* duk, const char* name)
+{
+    CallbackStats* data = 0;
+    size_t j = 0;
+
+    for (j = 0; j < duk->callback_count; ++j) {
+        if (strcmp(duk->callback_stats[j].name, name) == 0) {
+            return j + 1;
+        }
+    }
+
+    data = (CallbackStats*) realloc(duk->callback_stats, (duk->callback_count + 1) * sizeof(CallbackStats));
+    if (!data) {
+        croak("Could not allocate memory for callback stats\n");
+    }
+    duk->callback_stats = data;
+    data = &duk->callback_stats[duk->callback_count];
+    memset(data, 0, sizeof(CallbackStats));
+    data->name = strdup(name);
+    if (!data->name) {
+        croak("Could not allocate memory for callback stats\n");
+    }
+    return ++duk->callback_count;
+}
+
+void pl_stats_callback(Duk* duk, size_t slot, double total_us, double self_us)
+{
+    CallbackStats* data = 0;
+
+    if (slot < 1 || slot > duk->callback_count) {
+        return;
+    }
+    data = &duk->callback_stats[slot - 1];
+    ++data->calls;
+    data->total_us += total_us;
+    data->self_us += self_us;
+}
+
+void pl_stats_gc_pause(Duk* duk, double pause_us)
+{
+    GcPauses* pauses = &duk->gc_pauses;
+    int bucket = 0;
+    double limit = 2.0;
+
+    while (bucket < PL_GC_PAUSE_BUCKETS - 1 && pause_us >= limit) {
+        ++bucket;
+        limit *= 2.0;
+    }
+    ++pauses->histogram[bucket];
+    ++pauses->runs;
+    pauses->total_us += pause_us;
+    if (pauses->max_us < pause_us) {
+        pauses->max_us = pause_us;
+    }
+}
+
+static void heap_info_store(pTHX_ HV* data, const char* name, double value)
+{
+    SV* pvalue = newSVnv(value);
+    if (!hv_store(data, name, strlen(name), pvalue, 0)) {
+        SvREFCNT_dec(pvalue);
+        croak("Could not create entry %s in heap info\n", name);
+    }
+}
+
+static HV* heap_info_category(pTHX_ HV* info, const char* name)
+{
+    HV* data = newHV();
+    SV* ref = newRV_noinc((SV*) data);
+    if (!hv_store(info, name, strlen(name), ref, 0)) {
+        SvREFCNT_dec(ref);
+        croak("Could not create category %s in heap info\n", name);
+    }
+    return data;
+}
+
+static void heap_info_entry(pTHX_ HV* info, const char* name, duk_heap_info_entry* entry)
+{
+    HV* data = heap_info_category(aTHX_ info, name);
+    heap_info_store(aTHX_ data, "count", entry->count);
+    heap_info_store(aTHX_ data, "bytes", entry->bytes);
+}
+
+SV* pl_heap_info(pTHX_ Duk* duk)
+{
+    duk_heap_info hi;
+    HV* info = newHV();
+    HV* data = 0;
+    size_t accounted = 0;
+
+    duk_get_heap_info(duk->ctx, &hi, pl_sandbox_block_size);
+
+    heap_info_entry(aTHX_ info, "objects", &hi.objects);
+    heap_info_entry(aTHX_ info, "functions", &hi.functions);
+    heap_info_entry(aTHX_ info, "threads", &hi.threads);
+    heap_info_entry(aTHX_ info, "strings", &hi.strings);
+    heap_info_entry(aTHX_ info, "buffers", &hi.buffers);
+
+    data = heap_info_category(aTHX_ info, "string_table");
+    heap_info_store(aTHX_ data, "size", hi.strtab_size);
+    heap_info_store(aTHX_ data, "used", hi.strtab_used);
+    heap_info_store(aTHX_ data, "longest_chain", hi.strtab_longest);
+    heap_info_store(aTHX_ data, "load_factor", hi.strtab_size ? (double) hi.strings.count / hi.strtab_size : 0);
+
+    data = heap_info_category(aTHX_ info, "freed");
+    heap_info_store(aTHX_ data, "refcount", hi.freed_refcount);
+    heap_info_store(aTHX_ data, "mark_and_sweep", hi.freed_markandsweep);
+
+    /* whatever is not in a heap element: the heap itself, string table, caches... */
+    accounted = hi.objects.bytes + hi.functions.bytes + hi.threads.bytes + hi.strings.bytes + hi.buffers.bytes;
+    heap_info_store(aTHX_ info, "pending_finalize", hi.pending_finalize);
+    heap_info_store(aTHX_ info, "total_bytes", duk->total_allocated_bytes);
+    heap_info_store(aTHX_ info, "other_bytes", duk->total_allocated_bytes > accounted ? duk->total_allocated_bytes - accounted : 0);
 
-    save_stat(aTHX_ duk, name, "elapsed_us", stats->t1 - stats->t0);
-    save_stat(aTHX_ duk, name, "memory_bytes", stats->m1 - stats->m0);
+    return newRV_noinc((SV*) info);
 }
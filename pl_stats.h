@@ -3,12 +3,120 @@
 
 #include "pl_duk.h"
 
+/* The operations we keep stats for */
+enum {
+    PL_STATS_OP_COMPILE,
+    PL_STATS_OP_RUN,
+    PL_STATS_OP_GET,
+    PL_STATS_OP_EXISTS,
+    PL_STATS_OP_TYPEOF,
+    PL_STATS_OP_INSTANCEOF,
+    PL_STATS_OP_SET,
+    PL_STATS_OP_REMOVE,
+    PL_STATS_OP_DISPATCH,
+    PL_STATS_OP_RUN_GC,
+    PL_STATS_OP_GLOBAL_OBJECTS,
+    PL_STATS_OP_COUNT
+};
+
+/*
+ * Latency histogram buckets: one for anything under 1 us, and then each power
+ * of two from 1 us up to 2^32 us is split into 4 linear sub-buckets, which
+ * keeps the relative error of any percentile under 25%.
+ */
+#define PL_STATS_SUB_BUCKETS      4
+#define PL_STATS_LATENCY_BUCKETS  (1 + 32 * PL_STATS_SUB_BUCKETS)
+
+/*
+ * Everything we know about one kind of operation: aggregates over all the
+ * times it was run, and the figures for the last run.  This is kept in C and
+ * only converted to Perl data when the stats are requested.
+ */
+typedef struct OpStats {
+    size_t count;
+    double sum_us;
+    double min_us;
+    double max_us;
+    unsigned int histogram[PL_STATS_LATENCY_BUCKETS];
+
+    double elapsed_us;
+    double cpu_us;
+    double instructions;
+    size_t allocated_bytes;
+    size_t freed_bytes;
+    size_t allocations;
+    size_t live_bytes;
+    size_t peak_bytes;
+    size_t gc_forced;
+    size_t gc_reclaimed_bytes;
+} OpStats;
+
+/*
+ * Snapshot of the VM counters taken when an operation starts; memory figures
+ * come from the sandbox allocator, so gathering them does no I/O at all.
+ */
 typedef struct Stats {
     double t0, t1;
-    double m0, m1;
+    double cpu0;
+    double instructions0;
+    size_t allocated0;
+    size_t freed0;
+    size_t allocations0;
+    size_t peak0;
+    size_t gc_forced0;
+    size_t gc_reclaimed0;
 } Stats;
 
+/*
+ * Timing for a Perl callback registered with set(), keyed by the name it was
+ * set under.  Self time excludes the time spent in nested callbacks.
+ */
+typedef struct CallbackStats {
+    char* name;
+    size_t calls;
+    double total_us;
+    double self_us;
+} CallbackStats;
+
 void pl_stats_start(pTHX_ Duk* duk, Stats* stats);
-void pl_stats_stop(pTHX_ Duk* duk, Stats* stats, const char* name);
+void pl_stats_stop(pTHX_ Duk* duk, Stats* stats, int op);
+
+/* Store all the stats gathered so far in duk->stats */
+void pl_stats_save(pTHX_ Duk* duk);
+
+/*
+ * Version of the layout used by pl_stats_raw(); bump it whenever the fields
+ * change, so that scrapers can tell.
+ */
+#define PL_STATS_RAW_VERSION 1
+
+/*
+ * Return a string with the stats gathered so far packed as native doubles,
+ * without creating any other Perl data; pl_stats_raw_names() returns an
+ * arrayref with the name of each of those doubles.
+ */
+SV* pl_stats_raw(pTHX_ Duk* duk);
+SV* pl_stats_raw_names(pTHX);
+
+/* Forget all the stats gathered so far */
+void pl_stats_reset(Duk* duk);
+
+/* Release the memory used for the stats */
+void pl_stats_destroy(Duk* duk);
+
+/*
+ * Get the slot for the callback with the given name, creating it if needed.
+ * Slots are numbered from 1, so that 0 can mean 'no slot'.
+ */
+size_t pl_stats_callback_slot(Duk* duk, const char* name);
+
+/* Record one call to the callback in the given slot */
+void pl_stats_callback(Duk* duk, size_t slot, double total_us, double self_us);
+
+/* Record the pause caused by one GC pass */
+void pl_stats_gc_pause(Duk* duk, double pause_us);
+
+/* Walk the heap and return a hashref with counts and sizes */
+SV* pl_heap_info(pTHX_ Duk* duk);
 
 #endif
@@ -1,10 +1,9 @@
 #include <stdio.h>
 #include <sys/time.h>
+#include <time.h>
 #include "duk_console.h"
 #include "pl_util.h"
 
-#define FILE_MEMORY_STATUS "/proc/self/statm"
-
 double now_us(void)
 {
     struct timeval tv;
@@ -16,45 +15,15 @@ double now_us(void)
     return now;
 }
 
-long total_memory_pages(void)
+double cpu_now_us(void)
 {
-    long pages = 0;
-
-    /*
-     * /proc/[pid]/statm
-     *        Provides information about memory usage, measured in pages.
-     *            size       total program size
-     *                       (same as VmSize in /proc/[pid]/status)
-     *            resident   resident set size
-     *                       (same as VmRSS in /proc/[pid]/status)
-     *            share      shared pages (from shared mappings)
-     *            text       text (code)
-     *            lib        library (unused in Linux 2.6)
-     *            data       data + stack
-     *            dirty      dirty pages (unused in Linux 2.6)
-     */
-    FILE* fp = 0;
-    do {
-        long size, resident, share, text, lib, data, dirty;
-        int nread;
-        fp = fopen(FILE_MEMORY_STATUS, "r");
-        if (!fp) {
-            /* silently ignore, some OSs do not have this file */
-            break;
-        }
-        nread = fscanf(fp, "%ld %ld %ld %ld %ld %ld %ld",
-                       &size, &resident, &share, &text, &lib, &data, &dirty);
-        if (nread != 7) {
-            /* silently ignore, avoid noisy errors */
-            break;
-        }
-        pages = size;
-    } while (0);
-    if (fp) {
-        fclose(fp);
-        fp = 0;
+    struct timespec ts;
+    double now = 0.0;
+    int rc = clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    if (rc == 0) {
+        now = 1000000.0 * ts.tv_sec + ts.tv_nsec / 1000.0;
     }
-    return pages;
+    return now;
 }
 
 int check_duktape_call_for_errors(int rc, duk_context* ctx)
@@ -71,7 +40,7 @@ int check_duktape_call_for_errors(int rc, duk_context* ctx)
          * access in a duk_safe_call() if it matters.
          */
         duk_get_prop_string(ctx, -1, "stack");
-        duk_console_log(DUK_CONSOLE_FLUSH | DUK_CONSOLE_TO_STDERR,
+        duk_console_log(ctx, DUK_CONSOLE_FLUSH | DUK_CONSOLE_TO_STDERR | DUK_CONSOLE_LEVEL_ERROR,
                         "error: %s\n", duk_safe_to_string(ctx, -1));
         duk_pop(ctx);
         return 0;
@@ -81,7 +50,7 @@ int check_duktape_call_for_errors(int rc, duk_context* ctx)
      * Error without a stack trace.
      * Non-Error value, coerce safely to string.
      */
-    duk_console_log(DUK_CONSOLE_FLUSH | DUK_CONSOLE_TO_STDERR,
+    duk_console_log(ctx, DUK_CONSOLE_FLUSH | DUK_CONSOLE_TO_STDERR | DUK_CONSOLE_LEVEL_ERROR,
                     "error: %s\n", duk_safe_to_string(ctx, -1));
     return 1;
 }
@@ -8,8 +8,8 @@
 /* Get 'now' timestamp (microseconds since 1970) */
 double now_us(void);
 
-/* Get how many memory pages are currently in use */
-long total_memory_pages(void);
+/* Get CPU time consumed so far by the calling thread, in microseconds */
+double cpu_now_us(void);
 
 /* Check for errors after running JS code in duktape */
 int check_duktape_call_for_errors(int rc, duk_context* ctx);
@@ -0,0 +1,159 @@
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include "pl_util.h"
+#include "pl_watchdog.h"
+
+/*
+ * All the state below is protected by watchdog_lock.  The VMs being watched
+ * are kept in a doubly linked list; the thread wakes up at the earliest
+ * deadline, flags every VM whose deadline has passed and takes it out of the
+ * list.  The timeout_expired flag itself is accessed with atomic operations,
+ * because it is read by the VM without taking the lock.
+ */
+static pthread_mutex_t watchdog_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t watchdog_cond = PTHREAD_COND_INITIALIZER;
+static int watchdog_started = 0;
+static int watchdog_atfork = 0;
+static double watchdog_wakeup_us = 0;  /* when the thread will wake up; 0 = never */
+static Duk* watchdog_list = 0;
+
+static void watchdog_unlink(Duk* duk)
+{
+    if (duk->watchdog_prev) {
+        duk->watchdog_prev->watchdog_next = duk->watchdog_next;
+    } else {
+        watchdog_list = duk->watchdog_next;
+    }
+    if (duk->watchdog_next) {
+        duk->watchdog_next->watchdog_prev = duk->watchdog_prev;
+    }
+    duk->watchdog_prev = duk->watchdog_next = 0;
+    duk->watchdog_listed = 0;
+}
+
+static void* watchdog_run(void* arg)
+{
+    UNUSED_ARG(arg);
+
+    pthread_mutex_lock(&watchdog_lock);
+    for (;;) {
+        double now = now_us();
+        double next = 0;
+        Duk* duk = watchdog_list;
+        while (duk) {
+            Duk* following = duk->watchdog_next;
+            if (duk->timeout_deadline_us <= now) {
+                __atomic_store_n(&duk->timeout_expired, 1, __ATOMIC_RELEASE);
+                watchdog_unlink(duk);
+            } else if (next == 0 || duk->timeout_deadline_us < next) {
+                next = duk->timeout_deadline_us;
+            }
+            duk = following;
+        }
+
+        watchdog_wakeup_us = next;
+        if (next == 0) {
+            pthread_cond_wait(&watchdog_cond, &watchdog_lock);
+        } else {
+            struct timespec ts;
+            ts.tv_sec = (time_t) (next / 1000000.0);
+            ts.tv_nsec = (long) ((next - ts.tv_sec * 1000000.0) * 1000.0);
+            pthread_cond_timedwait(&watchdog_cond, &watchdog_lock, &ts);
+        }
+    }
+    return 0;
+}
+
+/* The thread does not survive a fork(), so the child starts its own */
+static void watchdog_prepare(void)
+{
+    pthread_mutex_lock(&watchdog_lock);
+}
+
+static void watchdog_parent(void)
+{
+    pthread_mutex_unlock(&watchdog_lock);
+}
+
+static void watchdog_child(void)
+{
+    pthread_mutex_init(&watchdog_lock, 0);
+    pthread_cond_init(&watchdog_cond, 0);
+    watchdog_started = 0;
+    watchdog_wakeup_us = 0;
+}
+
+/* Must be called with watchdog_lock held */
+static int watchdog_start(void)
+{
+    pthread_t thread;
+    pthread_attr_t attr;
+    sigset_t all, old;
+    int rc = 0;
+
+    if (!watchdog_atfork) {
+        pthread_atfork(watchdog_prepare, watchdog_parent, watchdog_child);
+        watchdog_atfork = 1;
+    }
+
+    /* the thread must never handle signals meant for the Perl interpreter */
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    rc = pthread_create(&thread, &attr, watchdog_run, 0);
+    pthread_attr_destroy(&attr);
+    pthread_sigmask(SIG_SETMASK, &old, 0);
+
+    watchdog_started = rc == 0;
+    return watchdog_started;
+}
+
+void pl_watchdog_arm(Duk* duk)
+{
+    double deadline = now_us() + duk->max_timeout_us;
+
+    pthread_mutex_lock(&watchdog_lock);
+    if (!watchdog_started && !watchdog_start()) {
+        /* no thread, pl_watchdog_expired() will check the time itself */
+        pthread_mutex_unlock(&watchdog_lock);
+        return;
+    }
+
+    __atomic_store_n(&duk->timeout_expired, 0, __ATOMIC_RELEASE);
+    duk->timeout_deadline_us = deadline;
+    if (!duk->watchdog_listed) {
+        duk->watchdog_prev = 0;
+        duk->watchdog_next = watchdog_list;
+        if (watchdog_list) {
+            watchdog_list->watchdog_prev = duk;
+        }
+        watchdog_list = duk;
+        duk->watchdog_listed = 1;
+    }
+
+    /* only wake up the thread if it would otherwise sleep past our deadline */
+    if (watchdog_wakeup_us == 0 || deadline < watchdog_wakeup_us) {
+        watchdog_wakeup_us = deadline;
+        pthread_cond_signal(&watchdog_cond);
+    }
+    pthread_mutex_unlock(&watchdog_lock);
+}
+
+void pl_watchdog_disarm(Duk* duk)
+{
+    pthread_mutex_lock(&watchdog_lock);
+    if (duk->watchdog_listed) {
+        watchdog_unlink(duk);
+    }
+    pthread_mutex_unlock(&watchdog_lock);
+}
+
+int pl_watchdog_expired(Duk* duk)
+{
+    if (!watchdog_started) {
+        return now_us() - duk->eval_start_us > duk->max_timeout_us;
+    }
+    return __atomic_load_n(&duk->timeout_expired, __ATOMIC_ACQUIRE);
+}
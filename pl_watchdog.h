@@ -0,0 +1,22 @@
+#ifndef PL_WATCHDOG_H
+#define PL_WATCHDOG_H
+
+#include "pl_duk.h"
+
+/*
+ * A single per-process thread that keeps track of execution deadlines for all
+ * VMs using the timeout_watchdog option.  When a VM's deadline passes, the
+ * thread sets the VM's timeout_expired flag, so that the execution timeout
+ * check only has to read that flag, instead of getting the current time.
+ */
+
+/* Set a new deadline for a VM, max_timeout_us from now; clears the flag */
+void pl_watchdog_arm(Duk* duk);
+
+/* Stop watching a VM */
+void pl_watchdog_disarm(Duk* duk);
+
+/* Check whether the deadline for a VM has already passed */
+int pl_watchdog_expired(Duk* duk);
+
+#endif
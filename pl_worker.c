@@ -0,0 +1,573 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+#include "pl_util.h"
+#include "pl_worker.h"
+
+#define WORKER_MAX_THREADS 256
+#define WORKER_MAP_CHUNKS_PER_THREAD 4
+
+/* The handler we use for pl_worker_map, applying the function to a chunk */
+#define WORKER_MAP_HANDLER "__pl_map_chunk"
+#define WORKER_MAP_SOURCE_HEAD "var __pl_map_func = ("
+#define WORKER_MAP_SOURCE_TAIL \
+    "\n);\n" \
+    "if (typeof __pl_map_func !== 'function') {\n" \
+    "    throw new TypeError('parallel_map needs a function');\n" \
+    "}\n" \
+    "function " WORKER_MAP_HANDLER "(items) {\n" \
+    "    var results = new Array(items.length);\n" \
+    "    for (var j = 0; j < items.length; ++j) {\n" \
+    "        results[j] = __pl_map_func(items[j]);\n" \
+    "    }\n" \
+    "    return results;\n" \
+    "}\n"
+
+/* A message on its way to a worker, and later its result on the way back */
+typedef struct WorkerJob {
+    struct WorkerJob* next;
+    UV id;
+    int failed;   /* data holds an error message instead of a JSON result */
+    char* data;
+    size_t size;
+} WorkerJob;
+
+struct WorkerPool {
+    pthread_mutex_t lock;
+    pthread_cond_t work_cond;  /* signalled when jobs are queued or on shutdown */
+    pthread_cond_t done_cond;  /* signalled when jobs finish */
+    pthread_t* threads;
+    int thread_count;
+    int shutdown;
+    WorkerJob* queue_head;
+    WorkerJob* queue_tail;
+    WorkerJob* done_head;
+    WorkerJob* done_tail;
+    UV next_id;
+    UV pending;
+    int fds[2];
+    char* source;
+    char* handler;
+    double max_timeout_us;
+    Duk* duk;  /* heap used to convert messages, only from the Perl thread */
+    pid_t pid; /* the process that started the threads */
+};
+
+/* What a worker needs to run a job inside a safe call */
+typedef struct WorkerCall {
+    const char* handler;
+    WorkerJob* job;
+} WorkerCall;
+
+static void worker_fatal_error_handler(void* udata, const char* msg)
+{
+    /* there is no Perl interpreter we could use in a worker thread */
+    (void) udata;
+    fprintf(stderr, "duktape worker fatal error, aborting: %s\n", msg ? msg : "*NONE*");
+    abort();
+}
+
+/*
+ * Every heap needs a Duk as its udata, since the execution timeout check
+ * looks at it; workers only use the timeout fields.
+ */
+static Duk* create_heap(double max_timeout_us)
+{
+    Duk* duk = (Duk*) calloc(1, sizeof(Duk));
+    if (!duk) {
+        return 0;
+    }
+    duk->max_timeout_us = max_timeout_us;
+    duk->ctx = duk_create_heap(0, 0, 0, duk, worker_fatal_error_handler);
+    if (!duk->ctx) {
+        free(duk);
+        return 0;
+    }
+    return duk;
+}
+
+static void destroy_heap(Duk* duk)
+{
+    if (!duk) {
+        return;
+    }
+    duk_destroy_heap(duk->ctx);
+    free(duk);
+}
+
+static void free_jobs(WorkerJob* job)
+{
+    while (job) {
+        WorkerJob* next = job->next;
+        free(job->data);
+        free(job);
+        job = next;
+    }
+}
+
+/* Replace the data in a job with a copy of the given string */
+static void set_job_data(WorkerJob* job, const char* data, size_t size, int failed)
+{
+    free(job->data);
+    job->data = (char*) malloc(size + 1);
+    job->size = 0;
+    job->failed = failed;
+    if (job->data) {
+        memcpy(job->data, data, size);
+        job->data[size] = '\0';
+        job->size = size;
+    }
+}
+
+static duk_ret_t run_job(duk_context* ctx, void* udata)
+{
+    WorkerCall* call = (WorkerCall*) udata;
+
+    duk_get_global_string(ctx, call->handler);
+    duk_push_lstring(ctx, call->job->data, call->job->size);
+    duk_json_decode(ctx, -1);
+    duk_call(ctx, 1);
+    if (duk_is_undefined(ctx, -1)) {
+        duk_pop(ctx);
+        duk_push_null(ctx);
+    }
+    duk_json_encode(ctx, -1);
+    return 1;
+}
+
+static void* worker_main(void* arg)
+{
+    WorkerPool* pool = (WorkerPool*) arg;
+    Duk* duk = create_heap(pool->max_timeout_us);
+    char* init_error = 0;
+
+    if (!duk) {
+        init_error = strdup("Error: could not create worker heap");
+    } else {
+        duk->eval_start_us = now_us();
+        if (duk_peval_string(duk->ctx, pool->source) != 0) {
+            init_error = strdup(duk_safe_to_string(duk->ctx, -1));
+        }
+        duk_pop(duk->ctx);
+    }
+
+    for (;;) {
+        WorkerJob* job = 0;
+
+        pthread_mutex_lock(&pool->lock);
+        while (!pool->queue_head && !pool->shutdown) {
+            pthread_cond_wait(&pool->work_cond, &pool->lock);
+        }
+        if (pool->shutdown) {
+            pthread_mutex_unlock(&pool->lock);
+            break;
+        }
+        job = pool->queue_head;
+        pool->queue_head = job->next;
+        if (!pool->queue_head) {
+            pool->queue_tail = 0;
+        }
+        job->next = 0;
+        pthread_mutex_unlock(&pool->lock);
+
+        if (init_error) {
+            set_job_data(job, init_error, strlen(init_error), 1);
+        } else {
+            duk_context* ctx = duk->ctx;
+            WorkerCall call;
+            const char* data = 0;
+            duk_size_t size = 0;
+            int failed = 0;
+
+            call.handler = pool->handler;
+            call.job = job;
+            duk->eval_start_us = now_us();
+            duk->exec_expired = 0;
+            if (duk_safe_call(ctx, run_job, &call, 0 /*nargs*/, 1 /*nrets*/) == DUK_EXEC_SUCCESS) {
+                data = duk_get_lstring(ctx, -1, &size);
+                if (!data) {
+                    data = "null";  /* the result cannot be expressed in JSON */
+                    size = 4;
+                }
+            } else {
+                data = duk_safe_to_lstring(ctx, -1, &size);
+                failed = 1;
+            }
+            set_job_data(job, data, size, failed);
+            duk_pop(ctx);
+        }
+
+        /* write the byte while holding the lock, so collect can drain exactly what it takes */
+        pthread_mutex_lock(&pool->lock);
+        if (pool->done_tail) {
+            pool->done_tail->next = job;
+        } else {
+            pool->done_head = job;
+        }
+        pool->done_tail = job;
+        if (write(pool->fds[1], "", 1) < 0) {
+            /* the pipe is full, so it is readable anyway */
+        }
+        pthread_cond_broadcast(&pool->done_cond);
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    free(init_error);
+    destroy_heap(duk);
+    return 0;
+}
+
+static int set_fd_flags(int fd)
+{
+    int flags = fcntl(fd, F_GETFL);
+    return flags >= 0 &&
+           fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0 &&
+           fcntl(fd, F_SETFD, FD_CLOEXEC) == 0;
+}
+
+static int thread_count(int threads)
+{
+    if (threads <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? (int) cpus : 1;
+    }
+    return threads > WORKER_MAX_THREADS ? WORKER_MAX_THREADS : threads;
+}
+
+WorkerPool* pl_worker_create(pTHX_ const char* source, const char* handler,
+                             int threads, double max_timeout_us)
+{
+    WorkerPool* pool = 0;
+    int j = 0;
+
+    threads = thread_count(threads);
+
+    pool = (WorkerPool*) calloc(1, sizeof(WorkerPool));
+    if (!pool) {
+        croak("Could not allocate worker pool\n");
+    }
+    pool->fds[0] = pool->fds[1] = -1;
+    pool->pid = getpid();
+    pthread_mutex_init(&pool->lock, 0);
+    pthread_cond_init(&pool->work_cond, 0);
+    pthread_cond_init(&pool->done_cond, 0);
+    pool->max_timeout_us = max_timeout_us;
+    pool->source = strdup(source);
+    pool->handler = strdup(handler);
+    pool->threads = (pthread_t*) calloc(threads, sizeof(pthread_t));
+    pool->duk = create_heap(0);
+    if (!pool->source || !pool->handler || !pool->threads || !pool->duk) {
+        pl_worker_destroy(pool);
+        croak("Could not allocate worker pool\n");
+    }
+    pool->duk->perl = (PerlInterpreter*) PERL_GET_THX;
+
+    if (pipe(pool->fds) != 0 || !set_fd_flags(pool->fds[0]) || !set_fd_flags(pool->fds[1])) {
+        int error = errno;
+        pl_worker_destroy(pool);
+        croak("Could not create worker pipe: %s\n", strerror(error));
+    }
+
+    for (j = 0; j < threads; ++j) {
+        int rc = pthread_create(&pool->threads[j], 0, worker_main, pool);
+        if (rc != 0) {
+            pl_worker_destroy(pool);
+            croak("Could not start worker thread: %s\n", strerror(rc));
+        }
+        ++pool->thread_count;
+    }
+    return pool;
+}
+
+void pl_worker_destroy(WorkerPool* pool)
+{
+    int j = 0;
+
+    if (!pool) {
+        return;
+    }
+
+    if (pool->pid == getpid()) {
+        pthread_mutex_lock(&pool->lock);
+        pool->shutdown = 1;
+        pthread_cond_broadcast(&pool->work_cond);
+        pthread_mutex_unlock(&pool->lock);
+        for (j = 0; j < pool->thread_count; ++j) {
+            pthread_join(pool->threads[j], 0);
+        }
+
+        free_jobs(pool->queue_head);
+        free_jobs(pool->done_head);
+        pthread_cond_destroy(&pool->done_cond);
+        pthread_cond_destroy(&pool->work_cond);
+        pthread_mutex_destroy(&pool->lock);
+    }
+    /*
+     * Otherwise this is a forked child, where the worker threads do not
+     * exist: there is nobody to join, and one of them may have been holding
+     * the lock, or changing the job lists, when we forked; leave those alone.
+     */
+
+    for (j = 0; j < 2; ++j) {
+        if (pool->fds[j] >= 0) {
+            close(pool->fds[j]);
+        }
+    }
+    destroy_heap(pool->duk);
+    free(pool->threads);
+    free(pool->handler);
+    free(pool->source);
+    free(pool);
+}
+
+/* The worker threads only run in the process that created the pool */
+static void check_pid(pTHX_ WorkerPool* pool)
+{
+    if (pool->pid != getpid()) {
+        croak("Worker pool cannot be used in a forked process\n");
+    }
+}
+
+static duk_ret_t encode_message(duk_context* ctx, void* udata)
+{
+    (void) udata;
+    duk_json_encode(ctx, -1);
+    return 1;
+}
+
+static duk_ret_t decode_result(duk_context* ctx, void* udata)
+{
+    (void) udata;
+    duk_json_decode(ctx, -1);
+    return 1;
+}
+
+UV pl_worker_post(pTHX_ WorkerPool* pool, SV* message)
+{
+    duk_context* ctx = pool->duk->ctx;
+    WorkerJob* job = 0;
+    const char* data = 0;
+    duk_size_t size = 0;
+
+    check_pid(aTHX_ pool);
+    duk_set_top(ctx, 0);
+    if (!pl_perl_to_duk(aTHX_ message, ctx)) {
+        croak("Could not convert worker message\n");
+    }
+    if (duk_safe_call(ctx, encode_message, 0, 1 /*nargs*/, 1 /*nrets*/) != DUK_EXEC_SUCCESS) {
+        croak("Could not encode worker message: %s\n", duk_safe_to_string(ctx, -1));
+    }
+    data = duk_get_lstring(ctx, -1, &size);
+    if (!data) {
+        data = "null";
+        size = 4;
+    }
+
+    job = (WorkerJob*) calloc(1, sizeof(WorkerJob));
+    if (!job) {
+        croak("Could not allocate worker job\n");
+    }
+    set_job_data(job, data, size, 0);
+    duk_pop(ctx);
+    if (!job->data) {
+        free(job);
+        croak("Could not allocate worker job\n");
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    job->id = ++pool->next_id;
+    if (pool->queue_tail) {
+        pool->queue_tail->next = job;
+    } else {
+        pool->queue_head = job;
+    }
+    pool->queue_tail = job;
+    ++pool->pending;
+    pthread_cond_signal(&pool->work_cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    return job->id;
+}
+
+/* Wait for finished jobs, with the lock held */
+static void wait_for_jobs(WorkerPool* pool, double timeout_us)
+{
+    struct timespec deadline;
+
+    if (pool->done_head || pool->pending == 0 || timeout_us == 0) {
+        return;
+    }
+    if (timeout_us < 0) {
+        while (!pool->done_head) {
+            pthread_cond_wait(&pool->done_cond, &pool->lock);
+        }
+        return;
+    }
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += (time_t) (timeout_us / 1000000);
+    deadline.tv_nsec += (long) ((long long) timeout_us % 1000000) * 1000;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec += 1;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    while (!pool->done_head) {
+        if (pthread_cond_timedwait(&pool->done_cond, &pool->lock, &deadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+}
+
+int pl_worker_collect(pTHX_ WorkerPool* pool, double timeout_us, AV* results)
+{
+    duk_context* ctx = pool->duk->ctx;
+    WorkerJob* done = 0;
+    WorkerJob* job = 0;
+    char drain[256];
+    int count = 0;
+
+    check_pid(aTHX_ pool);
+    pthread_mutex_lock(&pool->lock);
+    wait_for_jobs(pool, timeout_us);
+    done = pool->done_head;
+    pool->done_head = pool->done_tail = 0;
+    while (read(pool->fds[0], drain, sizeof(drain)) > 0) {
+        /* one byte per job we are taking */
+    }
+    for (job = done; job; job = job->next) {
+        --pool->pending;
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    for (job = done; job; job = job->next) {
+        HV* result = newHV();
+        hv_stores(result, "id", newSVuv(job->id));
+        if (!job->data) {
+            hv_stores(result, "error", newSVpvs("Error: could not allocate worker result"));
+        } else if (job->failed) {
+            SV* error = newSVpvn(job->data, job->size);
+            SvUTF8_on(error);
+            hv_stores(result, "error", error);
+        } else {
+            duk_set_top(ctx, 0);
+            duk_push_lstring(ctx, job->data, job->size);
+            if (duk_safe_call(ctx, decode_result, 0, 1 /*nargs*/, 1 /*nrets*/) == DUK_EXEC_SUCCESS) {
+                hv_stores(result, "result", pl_duk_to_perl(aTHX_ ctx, -1));
+            } else {
+                hv_stores(result, "error", newSVpv(duk_safe_to_string(ctx, -1), 0));
+            }
+            duk_pop(ctx);
+        }
+        av_push(results, newRV_noinc((SV*) result));
+        ++count;
+    }
+    free_jobs(done);
+    return count;
+}
+
+UV pl_worker_pending(pTHX_ WorkerPool* pool)
+{
+    UV pending = 0;
+
+    check_pid(aTHX_ pool);
+    pthread_mutex_lock(&pool->lock);
+    pending = pool->pending;
+    pthread_mutex_unlock(&pool->lock);
+    return pending;
+}
+
+int pl_worker_fd(WorkerPool* pool)
+{
+    return pool->fds[0];
+}
+
+static void destroy_pool(pTHX_ void* pool)
+{
+    pl_worker_destroy((WorkerPool*) pool);
+}
+
+SV* pl_worker_map(pTHX_ Duk* duk, const char* func, AV* items, int threads, size_t chunk_size)
+{
+    SSize_t count = av_top_index(items) + 1;
+    AV* output = newAV();
+    SV* ret = sv_2mortal(newRV_noinc((SV*) output));
+    AV* results = 0;
+    SV* source = 0;
+    WorkerPool* pool = 0;
+    size_t chunks = 0;
+    size_t posted = 0;
+    SSize_t j = 0;
+
+    if (count == 0) {
+        return SvREFCNT_inc(ret);
+    }
+
+    threads = thread_count(threads);
+    if (chunk_size == 0) {
+        chunk_size = (count + threads * WORKER_MAP_CHUNKS_PER_THREAD - 1) / (threads * WORKER_MAP_CHUNKS_PER_THREAD);
+    }
+    chunks = (count + chunk_size - 1) / chunk_size;
+    if ((size_t) threads > chunks) {
+        threads = (int) chunks;
+    }
+
+    ENTER;
+    SAVETMPS;
+
+    source = sv_2mortal(newSVpvs(WORKER_MAP_SOURCE_HEAD));
+    sv_catpv(source, func);
+    sv_catpvs(source, WORKER_MAP_SOURCE_TAIL);
+    pool = pl_worker_create(aTHX_ SvPV_nolen(source), WORKER_MAP_HANDLER, threads, duk->max_timeout_us);
+    SAVEDESTRUCTOR_X(destroy_pool, pool);  /* also stops the workers if we croak */
+
+    /* ids start at 1, so chunk N gets id N + 1 */
+    for (posted = 0; posted < chunks; ++posted) {
+        AV* chunk = newAV();
+        SV* ref = sv_2mortal(newRV_noinc((SV*) chunk));
+        SSize_t first = posted * chunk_size;
+        SSize_t last = first + (SSize_t) chunk_size < count ? first + (SSize_t) chunk_size : count;
+        av_extend(chunk, last - first - 1);
+        for (j = first; j < last; ++j) {
+            SV** item = av_fetch(items, j, 0);
+            av_push(chunk, item ? SvREFCNT_inc(*item) : newSV(0));
+        }
+        pl_worker_post(aTHX_ pool, ref);
+    }
+
+    av_extend(output, count - 1);
+    results = (AV*) sv_2mortal((SV*) newAV());
+    while (pl_worker_pending(aTHX_ pool) > 0) {
+        av_clear(results);
+        pl_worker_collect(aTHX_ pool, -1, results);
+        for (j = 0; j <= av_top_index(results); ++j) {
+            HV* result = (HV*) SvRV(*av_fetch(results, j, 0));
+            SSize_t index = (SSize_t) (SvUV(*hv_fetchs(result, "id", 0)) - 1) * chunk_size;
+            SV** error = hv_fetchs(result, "error", 0);
+            SV** values = hv_fetchs(result, "result", 0);
+            AV* chunk = 0;
+            SSize_t k = 0;
+
+            if (error) {
+                croak("Could not run parallel_map: %s\n", SvPV_nolen(*error));
+            }
+            if (!values || !SvROK(*values) || SvTYPE(SvRV(*values)) != SVt_PVAV) {
+                croak("Could not run parallel_map: invalid result from worker\n");
+            }
+            chunk = (AV*) SvRV(*values);
+            for (k = 0; k <= av_top_index(chunk) && index + k < count; ++k) {
+                SV** value = av_fetch(chunk, k, 0);
+                av_store(output, index + k, value ? SvREFCNT_inc(*value) : newSV(0));
+            }
+        }
+    }
+
+    FREETMPS;
+    LEAVE;
+    return SvREFCNT_inc(ret);
+}
@@ -0,0 +1,63 @@
+#ifndef PL_WORKER_H
+#define PL_WORKER_H
+
+#include "pl_duk.h"
+
+/*
+ * A pool of OS threads, each one owning a private Duktape heap, that run pure
+ * JS code in the background.  Each worker evaluates the same source once, and
+ * then calls the global handler function with every message it takes off the
+ * queue; the return value is sent back as the result for that message.
+ *
+ * Messages and results cross between threads as JSON text, so they must be
+ * plain data.  Workers never call into Perl and get a bare Duktape
+ * environment: no console, timers, require or Perl callbacks.
+ *
+ * Every finished job writes one byte to a pipe, so the read end can be watched
+ * with select / poll / an event loop to know when to collect results.
+ */
+
+typedef struct WorkerPool WorkerPool;
+
+/*
+ * Start a pool; with threads <= 0 we use one thread per online CPU.  Each job
+ * gets max_timeout_us (if > 0) to run; croaks if the pool cannot be started.
+ */
+WorkerPool* pl_worker_create(pTHX_ const char* source, const char* handler,
+                             int threads, double max_timeout_us);
+
+/*
+ * Stop all threads, dropping jobs not yet run, and free the pool; in a forked
+ * child, where the threads do not exist, only free what is safe to free.
+ * Using the pool in a forked child croaks.
+ */
+void pl_worker_destroy(WorkerPool* pool);
+
+/* Queue a message for the workers; returns its id, ids start at 1 */
+UV pl_worker_post(pTHX_ WorkerPool* pool, SV* message);
+
+/*
+ * Append to results a hashref for every finished job, with its id and either
+ * the result or the error message.  If there are none yet, wait up to
+ * timeout_us for at least one (forever if negative, not at all if zero).
+ * Returns the number of results appended.
+ */
+int pl_worker_collect(pTHX_ WorkerPool* pool, double timeout_us, AV* results);
+
+/* Posted messages whose results have not been collected yet */
+UV pl_worker_pending(pTHX_ WorkerPool* pool);
+
+/* The file descriptor that becomes readable when jobs finish */
+int pl_worker_fd(WorkerPool* pool);
+
+/*
+ * Call the JS function with the given source on every item, using a pool of
+ * threads that lives for the duration of the call, and return an arrayref
+ * with the results in the same order.  Items are sent to the workers in
+ * chunks of chunk_size (if 0, enough for about four chunks per thread), and
+ * each chunk gets the max_timeout_us of the VM.  Croaks with the first error
+ * if the function throws for any item.
+ */
+SV* pl_worker_map(pTHX_ Duk* duk, const char* func, AV* items, int threads, size_t chunk_size);
+
+#endif
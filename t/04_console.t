@@ -59,11 +59,153 @@ sub test_assert {
     }
 }
 
+sub test_console_per_vm {
+    my $saver = $CLASS->new({save_messages => 1});
+    ok($saver, "created $CLASS object with save_messages");
+    my $printer = $CLASS->new();
+    ok($printer, "created $CLASS object without save_messages");
+
+    my ($out, $err) = output_from(sub { $saver->eval('console.log("saved")'); });
+    is($out, '', "message from first VM not printed to stdout");
+    like(join('', @{ $saver->get_msgs()->{stdout} || [] }), qr/saved/, "message from first VM was saved");
+
+    ($out, $err) = output_from(sub { $printer->eval('console.log("printed")'); });
+    like($out, qr/printed/, "message from second VM printed to stdout");
+    ok(!grep({ /printed/ } @{ $saver->get_msgs()->{stdout} || [] }), "message from second VM not saved in first VM");
+}
+
+sub test_console_buffer {
+    my $size = 4096;
+    my $vm = $CLASS->new({console_buffer_bytes => $size});
+    ok($vm, "created $CLASS object with console_buffer_bytes");
+
+    my ($out, $err) = output_from(sub { $vm->eval('console.log("buffered"); console.warn("oops")'); });
+    is($out, '', "buffered stdout message not printed yet");
+    is($err, '', "buffered stderr message not printed yet");
+
+    ($out, $err) = output_from(sub { $vm->flush_console(); });
+    is($out, "buffered\n", "buffered stdout message printed after flush_console");
+    is($err, "oops\n", "buffered stderr message printed after flush_console");
+
+    ($out, $err) = output_from(sub { $vm->flush_console(); });
+    is($out, '', "nothing left to print after flush_console");
+
+    my $line = 'x' x 99;
+    ($out, $err) = output_from(sub { $vm->eval("for (var j = 0; j < 50; ++j) { console.log('$line'); }"); });
+    ok(length($out) > 0, "buffer was flushed when it filled up");
+    ok(length($out) <= $size, "buffer was not flushed before it filled up");
+    ($out, $err) = output_from(sub { $vm->flush_console(); });
+    ok(length($out) > 0, "rest of the messages printed after flush_console");
+
+    my $big = 'y' x (2 * $size);
+    ($out, $err) = output_from(sub { $vm->eval("console.log('$big')"); });
+    is($out, "$big\n", "message larger than the buffer printed right away");
+
+    ($out, $err) = output_from(sub {
+        my $tmp = $CLASS->new({console_buffer_bytes => $size});
+        $tmp->eval('console.log("bye")');
+    });
+    is($out, "bye\n", "buffered messages printed when the VM is destroyed");
+}
+
+sub test_message_ring {
+    my $vm = $CLASS->new({save_messages => 1, max_messages => 5});
+    ok($vm, "created $CLASS object with save_messages and max_messages");
+
+    $vm->eval('for (var j = 0; j < 20; ++j) { console.log("message " + j); }');
+    my $msgs = $vm->get_msgs();
+    is_deeply($msgs->{stdout}, [ map { "message $_\n" } 15..19 ], "only kept the newest messages");
+
+    my $detailed = $vm->get_msgs_detailed();
+    is($detailed->{dropped}, 15, "counted dropped messages");
+    is(scalar @{ $detailed->{messages} }, 5, "got detailed entries for kept messages");
+    my $first = $detailed->{messages}[0];
+    is($first->{target}, 'stdout', "detailed message has the right target");
+    is($first->{level}, 'info', "detailed message has the right level");
+    is($first->{message}, "message 15\n", "detailed message has the right text");
+    ok(abs($first->{time} - time) < 60, "detailed message has a sensible timestamp");
+
+    $vm->reset_msgs();
+    $vm->eval('console.debug("d"); console.warn("w"); console.error("e")');
+    $detailed = $vm->get_msgs_detailed();
+    is($detailed->{dropped}, 0, "dropped count cleared by reset_msgs");
+    is_deeply([ map { $_->{level} } @{ $detailed->{messages} } ], [qw/ debug warn error /], "messages have the right levels");
+    is_deeply([ map { $_->{target} } @{ $detailed->{messages} } ], [qw/ stdout stderr stderr /], "messages have the right targets");
+
+    my $small = $CLASS->new({save_messages => 1, max_message_bytes => 100});
+    $small->eval('for (var j = 0; j < 10; ++j) { console.log("0123456789012345678"); }');
+    $detailed = $small->get_msgs_detailed();
+    is(scalar @{ $detailed->{messages} }, 5, "kept as many messages as fit in max_message_bytes");
+    is($detailed->{dropped}, 5, "counted messages dropped because of max_message_bytes");
+}
+
+sub test_console_format {
+    my $vm = $CLASS->new({save_messages => 1});
+    ok($vm, "created $CLASS object with save_messages");
+
+    my @values = (
+        q<{}>,
+        q<[]>,
+        q<{ name: 'gonzo', list: [1, 2.5, 'three', null, undefined, true], nested: { deep: { deeper: [] } } }>,
+        q<[ function foo() {}, new Date(0), /re+/g, 'caf\u00e9' ]>,
+        q<{ toString: function() { return 'custom'; } }>,
+    );
+    foreach my $value (@values) {
+        $vm->reset_msgs();
+        my $expected = $vm->eval("Duktape.enc('jx', $value)");
+        $vm->eval("console.log($value)");
+        is($vm->get_msgs()->{stdout}[0], "$expected\n", "console.log formats $value as JX");
+    }
+
+    $vm->reset_msgs();
+    $vm->eval('var cyclic = { name: "loop" }; cyclic.self = cyclic; console.log(cyclic)');
+    is($vm->get_msgs()->{stdout}[0], "[object Object]\n", "cyclic object falls back to a string");
+
+    $vm->reset_msgs();
+    $vm->eval('var big = []; for (var j = 0; j < 100000; ++j) { big.push(j); } console.log(big)');
+    my $got = $vm->get_msgs()->{stdout}[0];
+    like($got, qr/\.\.\.\n\z/, "very long formatted object is cut short");
+    ok(length($got) < 70000, "very long formatted object has a bounded length");
+
+    $vm->reset_msgs();
+    $vm->eval('console.format = function(v) { return "custom format"; }; console.log({ a: 1 }, "x")');
+    is($vm->get_msgs()->{stdout}[0], "custom format x\n", "user-supplied console.format is still used");
+}
+
+sub test_console_level {
+    my %expected = (
+        debug => [qw/ debug trace log info dir warn error exception /],
+        info  => [qw/ log info dir warn error exception /],
+        warn  => [qw/ warn error exception /],
+        error => [qw/ error exception /],
+    );
+    foreach my $level (sort keys %expected) {
+        my $vm = $CLASS->new({save_messages => 1, console_level => $level});
+        ok($vm, "created $CLASS object with console_level => $level");
+        foreach my $func (qw/ debug trace log info dir warn error exception /) {
+            $vm->eval("console.$func('msg_$func')");
+        }
+        my @got = map { $_->{message} =~ /msg_(\w+)/ } @{ $vm->get_msgs_detailed()->{messages} };
+        is_deeply(\@got, $expected{$level}, "got the right messages with console_level => $level");
+    }
+
+    my $vm = $CLASS->new({save_messages => 1, console_level => 'error'});
+    $vm->eval('gonzo.length');
+    like(join('', @{ $vm->get_msgs()->{stderr} || [] }), qr/ReferenceError/, "errors from JS code are not filtered");
+
+    ok(!eval { $CLASS->new({console_level => 'chatty'}); 1 }, "unknown console level is rejected");
+}
+
 sub main {
     use_ok($CLASS);
 
     test_console();
     test_assert();
+    test_console_per_vm();
+    test_console_buffer();
+    test_message_ring();
+    test_console_format();
+    test_console_level();
     done_testing;
     return 0;
 }
@@ -2,6 +2,7 @@ use strict;
 use warnings;
 
 use Data::Dumper;
+use Time::HiRes qw(time);
 use Test::More;
 
 my $CLASS = 'JavaScript::Duktape::XS';
@@ -34,7 +35,7 @@ sub test_stats {
                         next;
                     }
                     my $data = $stats->{$category};
-                    foreach my $name (qw/ memory_bytes elapsed_us /) {
+                    foreach my $name (qw/ count sum_us min_us max_us mean_us p50_us p90_us p99_us memory_bytes elapsed_us cpu_us instructions allocated_bytes freed_bytes allocations live_bytes peak_bytes gc_forced gc_reclaimed_bytes /) {
                         ok(exists $data->{$name}, "name $name exists in stats for $category");
                         ok($data->{$name} >= 0, "name $name has a valid value in stats for $category");
                     }
@@ -44,10 +45,150 @@ sub test_stats {
     }
 }
 
+sub test_memory_stats {
+    my $vm = $CLASS->new({gather_stats => 1});
+    ok($vm, "created $CLASS object with gather_stats => 1");
+
+    $vm->eval('var parts = []; for (var j = 0; j < 1000; ++j) { parts.push("part " + j); }');
+    my $run = $vm->get_stats()->{run};
+    ok($run->{allocated_bytes} > 0, "run allocated some memory");
+    ok($run->{allocations} > 0, "run did some allocations");
+    ok($run->{peak_bytes} >= $run->{live_bytes}, "peak is at least as large as live memory");
+    ok($run->{cpu_us} > 0, "run used some cpu time");
+
+    $vm->eval('parts = null;');
+    my $freed = $vm->get_stats()->{run}{freed_bytes};
+    ok($freed > 0, "dropping data freed some memory");
+}
+
+sub test_latency_stats {
+    my $vm = $CLASS->new({gather_stats => 1});
+    ok($vm, "created $CLASS object with gather_stats => 1");
+
+    my $runs = 50;
+    $vm->set('gonzo', 1) for 1..$runs;
+    my $set = $vm->get_stats()->{set};
+    is($set->{count}, $runs, "stats count all set operations");
+    ok($set->{min_us} <= $set->{mean_us}, "min latency is not above the mean");
+    ok($set->{mean_us} <= $set->{max_us}, "mean latency is not above the max");
+    ok($set->{sum_us} >= $set->{max_us}, "sum of latencies is at least the max");
+    ok($set->{p50_us} <= $set->{p90_us}, "p50 latency is not above p90");
+    ok($set->{p90_us} <= $set->{p99_us}, "p90 latency is not above p99");
+    ok($set->{p99_us} <= $set->{max_us}, "p99 latency is not above the max");
+
+    my $total = 0;
+    $total += $_ for values %{ $set->{histogram} };
+    is($total, $runs, "latency histogram counts all set operations");
+
+    $vm->reset_stats();
+    ok(!exists $vm->get_stats()->{set}, "stats are gone after reset_stats");
+    $vm->set('gonzo', 2);
+    is($vm->get_stats()->{set}{count}, 1, "stats start again after reset_stats");
+}
+
+sub test_boundary_stats {
+    my $vm = $CLASS->new({gather_stats => 1});
+    ok($vm, "created $CLASS object with gather_stats => 1");
+    $vm->reset_stats();
+
+    my $calls = 0;
+    $vm->set('perl_echo', sub { ++$calls; return $_[0]; });
+    $vm->set('data', { name => 'gonzo', list => [ 1, 2, 3 ] });
+    my $got = $vm->eval('var r = ""; for (var j = 0; j < 10; ++j) { r = perl_echo("abcd"); } r');
+    is($got, 'abcd', "callback returned the right value");
+    is($calls, 10, "callback was called the right number of times");
+
+    my $boundary = $vm->get_stats()->{boundary};
+    ok($boundary, "boundary stats exist");
+    is($boundary->{callbacks}, $calls, "boundary stats count all callbacks");
+    is($boundary->{entries}, 3, "boundary stats count two sets and one eval");
+    # callback + hash with a string and a 3-element array, plus 10 return values
+    is($boundary->{values_to_js}, 1 + 6 + $calls, "boundary stats count values converted to JS");
+    # 10 callback arguments plus the eval result
+    is($boundary->{values_to_perl}, $calls + 1, "boundary stats count values converted to Perl");
+    is($boundary->{bytes_to_perl}, 4 * ($calls + 1), "boundary stats count bytes converted to Perl");
+    ok($boundary->{bytes_to_js} >= 4 * $calls + length('namegonzolist'), "boundary stats count bytes converted to JS");
+    ok($boundary->{convert_to_perl_us} >= 0, "boundary stats have time converting to Perl");
+    ok($boundary->{convert_to_js_us} >= 0, "boundary stats have time converting to JS");
+
+    $vm->reset_stats();
+    is($vm->get_stats()->{boundary}{callbacks}, 0, "boundary stats are cleared by reset_stats");
+
+    my $quiet = $CLASS->new();
+    $quiet->set('perl_echo', sub { return $_[0]; });
+    $quiet->eval('perl_echo(1)');
+    ok(!exists $quiet->get_stats()->{boundary}, "no boundary stats without gather_stats");
+}
+
+sub test_callback_stats {
+    my $vm = $CLASS->new({gather_stats => 1});
+    ok($vm, "created $CLASS object with gather_stats => 1");
+
+    my $busy = sub { my $t = time; 1 while time - $t < 0.02; return 1; };
+    $vm->set('slow', sub { $busy->(); return 1; });
+    $vm->set('fast', sub { return 2; });
+    $vm->set('outer', sub { $busy->(); return $vm->eval('slow()'); });
+    $vm->set('unused', sub { return 3; });
+    $vm->eval('for (var j = 0; j < 10; ++j) { fast(); } slow(); outer();');
+
+    my $callbacks = $vm->get_stats()->{callbacks};
+    ok($callbacks, "callback stats exist");
+    is($callbacks->{fast}{calls}, 10, "fast callback was called 10 times");
+    is($callbacks->{slow}{calls}, 2, "slow callback was called twice");
+    is($callbacks->{outer}{calls}, 1, "outer callback was called once");
+    ok(!exists $callbacks->{unused}, "unused callback has no stats");
+    foreach my $name (sort keys %$callbacks) {
+        my $data = $callbacks->{$name};
+        ok($data->{self_us} <= $data->{total_us}, "self time for $name is not above its total time");
+    }
+    ok($callbacks->{slow}{total_us} > $callbacks->{fast}{total_us}, "slow callback takes longer than fast callback");
+    ok($callbacks->{outer}{total_us} - $callbacks->{outer}{self_us} >= $callbacks->{slow}{total_us} / 2 * 0.9,
+       "nested callback time is not part of outer self time");
+
+    $vm->reset_stats();
+    ok(!exists $vm->get_stats()->{callbacks}, "callback stats are gone after reset_stats");
+    $vm->eval('fast()');
+    is($vm->get_stats()->{callbacks}{fast}{calls}, 1, "callback stats start again after reset_stats");
+}
+
+sub test_raw_stats {
+    my $vm = $CLASS->new({gather_stats => 1});
+    ok($vm, "created $CLASS object with gather_stats => 1");
+
+    my $names = $vm->get_stats_raw_names();
+    is(ref $names, 'ARRAY', "raw stats names are an arrayref");
+    is($names->[0], 'version', "first raw stats value is the version");
+
+    my %raw;
+    @raw{@$names} = unpack('d*', $vm->get_stats_raw());
+    is(scalar keys %raw, scalar @$names, "got one raw value per name");
+    is($raw{version}, 1, "raw stats have the right version");
+    is($raw{'set.count'}, 0, "no set operations in raw stats yet");
+
+    $vm->set('gonzo', 1) for 1..5;
+    $vm->eval('gonzo + 1');
+    @raw{@$names} = unpack('d*', $vm->get_stats_raw());
+    my $stats = $vm->get_stats();
+    is($raw{'set.count'}, 5, "raw stats count set operations");
+    foreach my $name (qw/ count sum_us min_us max_us p50_us p90_us p99_us /) {
+        is($raw{"run.$name"}, $stats->{run}{$name}, "raw stats agree on run $name");
+    }
+    is($raw{'boundary.entries'}, $stats->{boundary}{entries}, "raw stats agree on boundary entries");
+
+    $vm->reset_stats();
+    @raw{@$names} = unpack('d*', $vm->get_stats_raw());
+    is($raw{'set.count'}, 0, "raw stats are cleared by reset_stats");
+}
+
 sub main {
     use_ok($CLASS);
 
     test_stats();
+    test_memory_stats();
+    test_latency_stats();
+    test_boundary_stats();
+    test_callback_stats();
+    test_raw_stats();
     done_testing;
     return 0;
 }
@@ -23,10 +23,99 @@ sub test_run_gc {
     ok($got > 0, "ran GC with a non-zero number of passes ($got)");
 }
 
+sub test_run_gc_modes {
+    my $vm = $CLASS->new();
+    ok($vm, "created $CLASS object");
+
+    my %expected = (
+        full    => 2,
+        light   => 1,
+        compact => 1,
+    );
+    foreach my $mode (sort keys %expected) {
+        $vm->eval('var data = []; for (var j = 0; j < 1000; ++j) { data.push({ id: j }); } data = null;');
+        my $got = $vm->run_gc({ mode => $mode });
+        is($got, $expected{$mode}, "ran GC in mode $mode with $expected{$mode} passes");
+    }
+
+    ok(!eval { $vm->run_gc({ mode => 'gonzo' }); 1 }, "unknown GC mode is an error");
+    ok(!eval { $vm->run_gc({ gonzo => 1 }); 1 }, "unknown GC option is an error");
+}
+
+sub test_run_gc_budget {
+    my $vm = $CLASS->new();
+    ok($vm, "created $CLASS object");
+    $vm->eval('var data = []; for (var j = 0; j < 100000; ++j) { data.push({ id: j }); }');
+
+    # the first round always takes longer than this, so there is no second one
+    my $got = $vm->run_gc({ mode => 'full', budget_us => 1 });
+    is($got, 1, "a tiny budget stops a full GC after the first round");
+
+    # now we know how long a round takes, so we do not even start one
+    foreach my $mode (qw(full light compact)) {
+        $vm->run_gc({ mode => $mode });
+        $got = $vm->run_gc({ mode => $mode, budget_us => 1 });
+        is($got, 0, "a tiny budget skips a $mode GC that would not fit");
+    }
+
+    $got = $vm->run_gc({ mode => 'light', budget_us => 10_000_000 });
+    is($got, 1, "a large budget lets a light GC run");
+    $got = $vm->run_gc({ mode => 'full', budget_us => 10_000_000 });
+    is($got, 2, "a large budget lets a full GC run both rounds");
+}
+
+sub test_gc_stats {
+    my $vm = $CLASS->new({ gather_stats => 1 });
+    ok($vm, "created $CLASS object with gather_stats => 1");
+
+    $vm->run_gc();
+    $vm->run_gc({ mode => 'light' });
+    my $gc = $vm->get_stats()->{gc};
+    ok($gc, "stats have a gc category");
+    is($gc->{runs}, 3, "stats have the number of GC passes");
+    is($gc->{idle_runs}, 0, "no GC passes while idle");
+    ok($gc->{pause_max_us} > 0, "stats have a maximum GC pause");
+    ok($gc->{pause_total_us} >= $gc->{pause_max_us}, "total pause is at least as large as the maximum");
+    my $histogram = $gc->{pause_histogram};
+    is(scalar @$histogram, 24, "pause histogram has the right number of buckets");
+    my $total = 0;
+    $total += $_ for @$histogram;
+    is($total, 3, "pause histogram counts all GC passes");
+
+    $vm->reset_stats();
+    ok(!exists $vm->get_stats()->{gc}, "GC stats are gone after reset_stats");
+}
+
+sub test_idle_gc {
+    foreach my $idle_gc (0, 1) {
+        my $vm = $CLASS->new({ gather_stats => 1, idle_gc => $idle_gc });
+        ok($vm, "created $CLASS object with idle_gc => $idle_gc");
+
+        $vm->eval(<<JS);
+var done = 0;
+var data = [];
+for (var j = 0; j < 1000; ++j) { data.push({ id: j }); }
+data = null;
+setTimeout(function() { done = 1; }, 50);
+JS
+        is($vm->get('done'), 1, "timer fired with idle_gc => $idle_gc");
+        my $runs = ($vm->get_stats()->{gc} || {})->{idle_runs} || 0;
+        if ($idle_gc) {
+            ok($runs > 0, "ran GC while idle");
+        } else {
+            is($runs, 0, "did not run GC while idle");
+        }
+    }
+}
+
 sub main {
     use_ok($CLASS);
 
     test_run_gc();
+    test_run_gc_modes();
+    test_run_gc_budget();
+    test_gc_stats();
+    test_idle_gc();
     done_testing;
 
     return 0;
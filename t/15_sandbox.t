@@ -3,7 +3,7 @@ use warnings;
 
 use Data::Dumper;
 use Test::More;
-use Test::Output qw/ stderr_like /;
+use Test::Output qw/ stderr_like stderr_unlike /;
 
 my $CLASS = 'JavaScript::Duktape::XS';
 
@@ -33,11 +33,98 @@ sub test_sandbox_runtime {
                 "got correct error from runtime sandbox";
 }
 
+sub test_sandbox_runtime_watchdog {
+    my $vm = $CLASS->new({ max_timeout_us => 0, timeout_watchdog => 1 });
+    ok($vm, "created $CLASS object with max_timeout_us => 0 and timeout_watchdog => 1");
+    stderr_like sub { $vm->eval(get_js()); },
+                qr/error: RangeError: execution timeout/,
+                "got correct error from runtime sandbox with watchdog";
+
+    my $got = $vm->eval('var total = 0; for (var j = 0; j < 1000; ++j) { total += j; } total');
+    is($got, 499500, "VM runs fine after a watchdog timeout");
+}
+
+sub test_sandbox_cpu_time {
+    my $vm = $CLASS->new({ max_cpu_time_us => 0 });
+    ok($vm, "created $CLASS object with max_cpu_time_us => 0");
+    stderr_like sub { $vm->eval(get_js()); },
+                qr/error: RangeError: execution timeout/,
+                "got correct error from cpu time sandbox";
+}
+
+sub test_sandbox_instructions {
+    my $budget = 2_000_000;
+    my $vm = $CLASS->new({ max_instructions => $budget, gather_stats => 1 });
+    ok($vm, "created $CLASS object with max_instructions => $budget");
+    my $js = 'var count = 0; for (var j = 0; j < 1000000000; ++j) { ++count; }';
+    stderr_like sub { $vm->eval($js); },
+                qr/error: RangeError: execution timeout/,
+                "got correct error from instruction sandbox";
+    ok($vm->get('count') < 1000000000, "loop was stopped by the instruction budget");
+    ok($vm->get_stats()->{run}{instructions} > $budget, "instruction count reported in stats");
+
+    my $got = $vm->eval('var total = 0; for (var j = 0; j < 1000; ++j) { total += j; } total');
+    is($got, 499500, "budget applies to each call separately");
+
+    # unwinding through catchpoints after the timeout must not count as running code
+    $vm = $CLASS->new({ max_instructions => $budget, gather_stats => 1 });
+    $js = 'function nest(n) { if (n == 0) { for (;;) {} } try { nest(n - 1); } finally { } } nest(50);';
+    stderr_like sub { $vm->eval($js); },
+                qr/error: RangeError: execution timeout/,
+                "got correct error from instruction sandbox with nested try / finally";
+    my $instructions = $vm->get_stats()->{run}{instructions};
+    ok($instructions > $budget && $instructions < 1.5 * $budget,
+       "instruction count stays close to the budget with nested try / finally ($instructions)");
+}
+
+sub test_sandbox_soft_memory {
+    my $vm = $CLASS->new({ soft_memory_bytes => 512 * 1024, max_memory_bytes => 4 * 1024 * 1024, gather_stats => 1 });
+    ok($vm, "created $CLASS object with soft_memory_bytes and max_memory_bytes");
+    my $js = <<JS;
+var kept = 0;
+for (var j = 0; j < 20000; ++j) {
+    var a = { id: j, payload: 'garbage ' + j };
+    var b = { other: a };
+    a.other = b;  /* a reference cycle, only mark-and-sweep can reclaim it */
+    ++kept;
+}
+kept;
+JS
+    my $got;
+    stderr_unlike sub { $got = $vm->eval($js); },
+                  qr/maximum allocation size reached/,
+                  "no hard limit errors with a soft memory limit";
+    is($got, 20000, "script with cyclic garbage ran to completion");
+
+    my $run = $vm->get_stats()->{run};
+    ok($run->{gc_forced} > 0, "soft limit forced some collections");
+    ok($run->{gc_reclaimed_bytes} > 0, "forced collections reclaimed some memory");
+    ok($run->{peak_bytes} <= 4 * 1024 * 1024, "heap stayed under the hard limit");
+}
+
+sub test_sandbox_soft_memory_growth {
+    my $soft = 128 * 1024;
+    my $vm = $CLASS->new({ soft_memory_bytes => $soft, gather_stats => 1 });
+    ok($vm, "created $CLASS object with a small soft_memory_bytes");
+    my $got = $vm->eval('var a = []; for (var j = 0; j < 200000; ++j) { a.push({ id: j }); } a.length');
+    is($got, 200000, "heap grew well past the soft limit");
+
+    # the trigger moves up with the live heap, so this is logarithmic in its size
+    my $run = $vm->get_stats()->{run};
+    ok($run->{gc_forced} > 0, "soft limit forced some collections");
+    ok($run->{gc_forced} <= 30, "growing heap forced few collections ($run->{gc_forced})");
+}
+
 sub main {
     use_ok($CLASS);
 
     test_sandbox_memory();
     test_sandbox_runtime();
+    test_sandbox_runtime_watchdog();
+    test_sandbox_cpu_time();
+    test_sandbox_instructions();
+    test_sandbox_soft_memory();
+    test_sandbox_soft_memory_growth();
     done_testing;
     return 0;
 }
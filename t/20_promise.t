@@ -0,0 +1,135 @@
+use strict;
+use warnings;
+
+use Data::Dumper;
+use Test::More;
+
+my $CLASS = 'JavaScript::Duktape::XS';
+
+sub test_microtask_order {
+    my $vm = $CLASS->new();
+    ok($vm, "created $CLASS object");
+
+    my $js = <<JS;
+var order = [];
+setTimeout(function() { order.push('timeout'); }, 0);
+queueMicrotask(function() {
+    order.push('job1');
+    queueMicrotask(function() { order.push('job3'); });
+});
+queueMicrotask(function() { order.push('job2'); });
+order.push('sync');
+JS
+    $vm->eval($js);
+    my $got = $vm->get('order');
+    is_deeply($got, [qw/ sync job1 job2 job3 timeout /],
+              "jobs are drained to completion before timers");
+
+    $vm->eval('var inner = []; setTimeout(function() { queueMicrotask(function() { inner.push("job"); }); setTimeout(function() { inner.push("timeout"); }, 0); }, 0);');
+    is_deeply($vm->get('inner'), [qw/ job timeout /],
+              "jobs queued from a timer run before the next timer");
+}
+
+sub test_promise {
+    my $vm = $CLASS->new();
+    ok($vm, "created $CLASS object");
+
+    is($vm->typeof('Promise'), 'function', 'Promise is available');
+
+    my %cases = (
+        'chained then' => [
+            'var got; Promise.resolve(1).then(function(v) { return v + 1; }).then(function(v) { got = v * 10; });',
+            20,
+        ],
+        'rejection and catch' => [
+            'var got; Promise.reject(new Error("bad")).then(function() { got = "wrong"; })["catch"](function(e) { got = e.message; });',
+            'bad',
+        ],
+        'thrown in handler' => [
+            'var got; new Promise(function(resolve) { resolve(3); }).then(function() { throw 7; })["catch"](function(e) { got = e; });',
+            7,
+        ],
+        'thenable adoption' => [
+            'var got; Promise.resolve({ then: function(r) { r("thenable"); } }).then(function(v) { got = v; });',
+            'thenable',
+        ],
+        'all' => [
+            'var got; Promise.all([1, Promise.resolve(2), new Promise(function(r) { setTimeout(function() { r(3); }, 5); })]).then(function(v) { got = v.join(","); });',
+            '1,2,3',
+        ],
+        'race' => [
+            'var got; Promise.race([new Promise(function(r) { setTimeout(function() { r("slow"); }, 20); }), Promise.resolve("fast")]).then(function(v) { got = v; });',
+            'fast',
+        ],
+        'finally' => [
+            'var got = ""; Promise.resolve("x")["finally"](function() { got += "f"; }).then(function(v) { got += v; });',
+            'fx',
+        ],
+    );
+    foreach my $case (sort keys %cases) {
+        my ($js, $expected) = @{ $cases{$case} };
+        $vm->eval($js);
+        my $got = $vm->get('got');
+        is($got, $expected, "promise $case");
+    }
+}
+
+sub test_timers_per_vm {
+    my @vms = map { $CLASS->new() } 1..2;
+
+    # run the event loop of the second VM from a timer of the first one,
+    # while the first one still has a pending timer
+    $vms[0]->set('run_other', sub {
+        $vms[1]->eval(q{
+            var fired = [];
+            setTimeout(function() { fired.push('timer1'); }, 1);
+            queueMicrotask(function() { fired.push('job1'); });
+        });
+    });
+    $vms[0]->eval(q{
+        var fired = [];
+        setTimeout(function() { fired.push('timer0'); run_other(); }, 1);
+        setTimeout(function() { fired.push('late0'); }, 20);
+    });
+    is($vms[0]->eval('fired.join(",")'), 'timer0,late0', "first VM ran its own timers");
+    is($vms[1]->eval('fired.join(",")'), 'job1,timer1', "second VM ran its own timers and jobs");
+}
+
+sub test_jobs_per_vm {
+    my $vm = $CLASS->new();
+    my @others;
+
+    # create and run other VMs while the first one still has queued jobs
+    $vm->set('make_other', sub {
+        my $other = $CLASS->new();
+        $other->eval(q{
+            var ran = [];
+            queueMicrotask(function() { ran.push('other'); });
+            Promise.resolve('promise').then(function(v) { ran.push(v); });
+        });
+        push @others, $other;
+    });
+    $vm->eval(q{
+        var ran = [];
+        queueMicrotask(function() { ran.push('job1'); make_other(); });
+        queueMicrotask(function() { ran.push('job2'); });
+        Promise.resolve('promise').then(function(v) { ran.push(v); });
+        make_other();
+    });
+    is($vm->eval('ran.join(",")'), 'job1,job2,promise', "jobs survive creating other VMs");
+    is_deeply([ map { $_->eval('ran.join(",")') } @others ], [ ('other,promise') x 2 ],
+              "other VMs ran only their own jobs");
+}
+
+sub main {
+    use_ok($CLASS);
+
+    test_microtask_order();
+    test_promise();
+    test_timers_per_vm();
+    test_jobs_per_vm();
+    done_testing;
+    return 0;
+}
+
+exit main();
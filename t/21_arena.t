@@ -0,0 +1,79 @@
+use strict;
+use warnings;
+
+use Data::Dumper;
+use Test::More;
+use Test::Output qw/ stderr_like /;
+
+my $CLASS = 'JavaScript::Duktape::XS';
+
+sub get_js {
+    my $js = <<JS;
+var data = [];
+for (var j = 0; j < 2000; ++j) {
+    data.push({ id: j, name: 'item_' + j, tags: [ j % 3, j % 5, j % 7 ] });
+}
+var big = new Array(5000).join('x');
+var total = 0;
+for (var j = 0; j < data.length; ++j) {
+    total += data[j].id + data[j].tags.length + data[j].name.length;
+}
+data = data.slice(0, 10);
+JS
+    return $js;
+}
+
+sub test_arena {
+    my %results;
+    foreach my $arena (0, 1) {
+        my $vm = $CLASS->new({ arena_allocator => $arena });
+        ok($vm, "created $CLASS object with arena_allocator => $arena");
+
+        $vm->eval(get_js());
+        $results{$arena} = {
+            total => $vm->get('total'),
+            data  => $vm->get('data'),
+            big   => length($vm->get('big')),
+        };
+        $vm->run_gc();
+
+        $vm->reset();
+        $vm->eval('var after = [1, 2, 3].map(function(x) { return x * 2; });');
+        is_deeply($vm->get('after'), [2, 4, 6], "VM works after reset with arena_allocator => $arena");
+    }
+    is_deeply($results{1}, $results{0}, "arena allocator gives the same results as malloc");
+}
+
+sub test_arena_reset {
+    foreach my $madvise (0, 1) {
+        my $vm = $CLASS->new({ arena_allocator => 1, arena_madvise => $madvise });
+        ok($vm, "created $CLASS object with arena_allocator and arena_madvise => $madvise");
+        for my $round (1..3) {
+            $vm->eval(get_js());
+            is($vm->get('big'), 'x' x 4999, "VM works in round $round with arena_madvise => $madvise");
+            $vm->reset();
+            ok(!$vm->exists('big'), "VM is pristine after reset in round $round with arena_madvise => $madvise");
+        }
+    }
+}
+
+sub test_arena_sandbox {
+    my $vm = $CLASS->new({ arena_allocator => 1, max_memory_bytes => 0 });
+    ok($vm, "created $CLASS object with arena_allocator and max_memory_bytes => 0");
+    my $js = "var str = ''; for (var j = 0; j < 1000000000; j++) { str += 'gonzo'; }";
+    stderr_like sub { $vm->eval($js); },
+                qr/error: Error: alloc failed/,
+                "got correct error from memory sandbox with arena";
+}
+
+sub main {
+    use_ok($CLASS);
+
+    test_arena();
+    test_arena_reset();
+    test_arena_sandbox();
+    done_testing;
+    return 0;
+}
+
+exit main();
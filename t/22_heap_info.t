@@ -0,0 +1,57 @@
+use strict;
+use warnings;
+
+use Data::Dumper;
+use Test::More;
+
+my $CLASS = 'JavaScript::Duktape::XS';
+
+sub test_heap_info {
+    my $vm = $CLASS->new();
+    ok($vm, "created $CLASS object");
+
+    my $before = $vm->heap_info();
+    # printf STDERR ("HEAP INFO: %s", Dumper($before));
+    foreach my $type (qw/ objects functions threads strings buffers /) {
+        ok(exists $before->{$type}, "heap info has type $type");
+        ok($before->{$type}{count} > 0, "heap has some $type");
+        ok($before->{$type}{bytes} > 0, "$type use some memory");
+    }
+    foreach my $name (qw/ size used longest_chain load_factor /) {
+        ok(exists $before->{string_table}{$name}, "heap info has $name for string table");
+    }
+    ok($before->{string_table}{used} <= $before->{string_table}{size}, "string table used buckets within size");
+    ok($before->{total_bytes} >= $before->{other_bytes}, "total bytes includes other bytes");
+
+    $vm->eval('var data = []; for (var j = 0; j < 1000; ++j) { data.push({ id: j, name: "name_" + j }); }');
+    my $after = $vm->heap_info();
+    ok($after->{objects}{count} >= $before->{objects}{count} + 1000, "heap info sees new objects");
+    ok($after->{strings}{count} >= $before->{strings}{count} + 1000, "heap info sees new strings");
+    ok($after->{total_bytes} > $before->{total_bytes}, "heap grew");
+}
+
+sub test_heap_info_freed {
+    my $vm = $CLASS->new();
+    ok($vm, "created $CLASS object");
+
+    my $before = $vm->heap_info()->{freed};
+    $vm->eval('var data = []; for (var j = 0; j < 100; ++j) { data.push({ id: j }); } data = null;');
+    my $middle = $vm->heap_info()->{freed};
+    ok($middle->{refcount} >= $before->{refcount} + 100, "refcounting freed dropped objects");
+
+    $vm->eval('for (var j = 0; j < 100; ++j) { var a = {}; var b = { a: a }; a.b = b; }');
+    $vm->run_gc();
+    my $after = $vm->heap_info()->{freed};
+    ok($after->{mark_and_sweep} >= $middle->{mark_and_sweep} + 100, "mark-and-sweep freed reference cycles");
+}
+
+sub main {
+    use_ok($CLASS);
+
+    test_heap_info();
+    test_heap_info_freed();
+    done_testing;
+    return 0;
+}
+
+exit main();
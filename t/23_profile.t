@@ -0,0 +1,91 @@
+use strict;
+use warnings;
+
+use Data::Dumper;
+use Test::More;
+
+my $CLASS = 'JavaScript::Duktape::XS';
+
+sub get_js {
+    my $js = <<JS;
+function fib(n) {
+    if (n <= 1) { return 1; }
+    return fib(n - 1) + fib(n - 2);
+}
+function busy() {
+    var t0 = Date.now();
+    var total = 0;
+    while (Date.now() - t0 < 200) {
+        total += fib(15);
+    }
+    return total;
+}
+busy();
+JS
+    return $js;
+}
+
+sub test_profile {
+    my $vm = $CLASS->new({ profile_interval_us => 1000 });
+    ok($vm, "created $CLASS object with profile_interval_us");
+
+    $vm->reset_profile();
+    is($vm->profile_report(), '', "profile report is empty after reset_profile");
+
+    $vm->eval(get_js(), 'busy.js');
+    my $report = $vm->profile_report();
+    # printf STDERR ("PROFILE: %s", $report);
+    my @lines = split /\n/, $report;
+    ok(scalar @lines > 0, "profile report has some stacks");
+
+    my $samples = 0;
+    my $valid = 1;
+    foreach my $line (@lines) {
+        if ($line !~ m/^(.+) (\d+)$/) {
+            $valid = 0;
+            next;
+        }
+        $samples += $2;
+    }
+    ok($valid, "all lines in the profile report are folded stacks");
+    ok($samples > 10, "profile has enough samples ($samples)");
+    ok(scalar (grep { m/busy \(busy\.js:\d+\);fib \(busy\.js:\d+\)/ } @lines), "profile shows fib called from busy, with file and line");
+
+    $vm->reset_profile();
+    is($vm->profile_report(), '', "profile report is empty again after reset_profile");
+}
+
+sub test_no_setup_samples {
+    # sample as often as possible, so setting up the VM would show up if it was sampled
+    my $vm = $CLASS->new({ profile_interval_us => 0.001 });
+    ok($vm, "created $CLASS object sampling all the time");
+    is($vm->profile_report(), '', "creating the VM is not profiled");
+
+    $vm->reset();
+    $vm->reset();
+    is($vm->profile_report(), '', "resetting the VM is not profiled");
+
+    $vm->eval(get_js(), 'busy.js');
+    my @frames = map { split /;/ } map { m/^(.+) \d+$/ ? $1 : () } split /\n/, $vm->profile_report();
+    is_deeply([ grep { !m/\(busy\.js:\d+\)$/ && !m/^\[/ } @frames ], [], "only frames from the profiled code")
+        or diag(Dumper(\@frames));
+}
+
+sub test_no_profile {
+    my $vm = $CLASS->new();
+    ok($vm, "created $CLASS object without profiling");
+    $vm->eval('var x = 1 + 1;');
+    is($vm->profile_report(), '', "profile report is empty when not profiling");
+}
+
+sub main {
+    use_ok($CLASS);
+
+    test_profile();
+    test_no_setup_samples();
+    test_no_profile();
+    done_testing;
+    return 0;
+}
+
+exit main();
@@ -0,0 +1,87 @@
+use strict;
+use warnings;
+
+use Data::Dumper;
+use File::Path qw(make_path);
+use File::Temp qw(tempdir);
+use Test::More;
+
+my $CLASS = 'JavaScript::Duktape::XS';
+
+sub write_file {
+    my ($dir, $name, $contents) = @_;
+    my $path = "$dir/$name";
+    (my $parent = $path) =~ s{/[^/]+\z}{};
+    make_path($parent);
+    open my $fh, '>', $path or die "Could not write $path: $!";
+    print $fh $contents;
+    close $fh;
+    return $path;
+}
+
+sub create_tree {
+    my $root = tempdir(CLEANUP => 1);
+    write_file($root, 'lib/main.js', "var helper = require('./helper'); module.exports = 'main+' + helper;");
+    write_file($root, 'lib/helper.js', "module.exports = 'helper';");
+    write_file($root, 'lib/sub/deep.js', "module.exports = 'deep+' + require('../helper');");
+    write_file($root, 'vendor/pkg/package.json', '{ "name": "pkg", "main": "./src/entry" }');
+    write_file($root, 'vendor/pkg/src/entry.js', "module.exports = 'pkg entry';");
+    write_file($root, 'vendor/idx/index.js', "module.exports = 'index';");
+    write_file($root, 'vendor/data.json', '{ "answer": 42 }');
+    write_file($root, 'lib/shadow.js', "module.exports = 'first';");
+    write_file($root, 'vendor/shadow.js', "module.exports = 'second';");
+    return $root;
+}
+
+sub test_native_resolver {
+    my $root = create_tree();
+    my $vm = $CLASS->new({ module_paths => [ "$root/lib", "$root/vendor" ] });
+    ok($vm, "created $CLASS object with module_paths");
+
+    is($vm->eval('require("main")'), 'main+helper', "resolved module and its relative dependency");
+    is($vm->eval('require("sub/deep")'), 'deep+helper', "resolved parent-relative dependency");
+    is($vm->eval('require("pkg")'), 'pkg entry', "resolved package main");
+    is($vm->eval('require("idx")'), 'index', "resolved directory index");
+    is($vm->eval('require("data").answer'), 42, "loaded JSON module");
+    is($vm->eval('require("shadow")'), 'first', "search paths are tried in order");
+    is($vm->eval('require("main") === require("main.js")'), 1, "same file resolves to the same module");
+    is($vm->eval("require('$root/lib/helper')"), 'helper', "resolved absolute path");
+
+    my $id = $vm->eval('Object.keys(require.cache).filter(function(k) { return /helper/.test(k); })[0]');
+    is($id, "$root/lib/helper.js", "module id is the normalized file name");
+
+    my $err = $vm->eval('var e = ""; try { require("missing"); } catch (x) { e = String(x); } e');
+    like($err, qr/cannot find module: missing/, "missing module reports an error");
+
+    write_file($root, 'lib/missing.js', "module.exports = 'late';");
+    $err = $vm->eval('var e = ""; try { require("missing"); } catch (x) { e = String(x); } e');
+    like($err, qr/cannot find module: missing/, "failed filesystem lookups are cached");
+
+    my $fresh = $CLASS->new({ module_paths => [ "$root/lib" ] });
+    is($fresh->eval('require("missing")'), 'late', "cache is per object");
+}
+
+sub test_perl_fallback {
+    my $root = create_tree();
+    my $vm = $CLASS->new({ module_paths => [ "$root/lib" ] });
+    ok($vm, "created $CLASS object with module_paths");
+
+    my @resolved;
+    $vm->set('perl_module_resolve', sub { push @resolved, $_[0]; return "$_[0].perl" });
+    $vm->set('perl_module_load', sub { return "module.exports = 'from perl: $_[0]';" });
+
+    is($vm->eval('require("helper")'), 'helper', "native resolver used when it finds the module");
+    is($vm->eval('require("virtual")'), 'from perl: virtual.perl', "Perl callbacks used when native resolver fails");
+    is_deeply(\@resolved, [ 'virtual' ], "Perl resolver only called for modules not found natively");
+}
+
+sub main {
+    use_ok($CLASS);
+
+    test_native_resolver();
+    test_perl_fallback();
+    done_testing;
+    return 0;
+}
+
+exit main();
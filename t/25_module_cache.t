@@ -0,0 +1,151 @@
+use strict;
+use warnings;
+
+use Data::Dumper;
+use File::Temp qw(tempdir);
+use Test::More;
+
+my $CLASS = 'JavaScript::Duktape::XS';
+
+sub write_file {
+    my ($path, $contents) = @_;
+    open my $fh, '>', $path or die "Could not write $path: $!";
+    print $fh $contents;
+    close $fh;
+}
+
+sub cache_stats {
+    my ($vm) = @_;
+    my $stats = $vm->get_stats();
+    return $stats->{module_cache};
+}
+
+sub run_in_child {
+    my ($code) = @_;
+    my $pid = fork();
+    die "Could not fork: $!" unless defined $pid;
+    if (!$pid) {
+        $code->();
+        exit 0;
+    }
+    waitpid($pid, 0);
+    return $? >> 8;
+}
+
+sub test_memory_cache {
+    my $dir = tempdir(CLEANUP => 1);
+    write_file("$dir/square.js", "module.exports = function(x) { return x * x; };");
+    write_file("$dir/broken.js", "module.exports = 1;\nthrow new Error('broken module');");
+
+    my %opt = (module_paths => [ $dir ], module_cache => 1, gather_stats => 1);
+    my $first = $CLASS->new(\%opt);
+    is($first->eval('require("square")(7)'), 49, "module works the first time");
+    is_deeply(cache_stats($first), { hits => 0, disk_hits => 0, bundle_hits => 0, shared_hits => 0, misses => 1 }, "first VM compiled the module");
+
+    my $second = $CLASS->new(\%opt);
+    is($second->eval('require("square")(8)'), 64, "module works from the cache");
+    is_deeply(cache_stats($second), { hits => 1, disk_hits => 0, bundle_hits => 0, shared_hits => 0, misses => 0 }, "second VM used the cached bytecode");
+
+    write_file("$dir/square.js", "module.exports = function(x) { return -x * x; };");
+    my $third = $CLASS->new(\%opt);
+    is($third->eval('require("square")(8)'), -64, "changed module is compiled again");
+    is_deeply(cache_stats($third), { hits => 0, disk_hits => 0, bundle_hits => 0, shared_hits => 0, misses => 1 }, "changed source is a miss");
+
+    for my $pass (1..2) {
+        my $vm = $CLASS->new(\%opt);
+        my $err = $vm->eval('var e = ""; try { require("broken"); } catch (x) { e = String(x.stack); } e');
+        like($err, qr/broken module/, "error thrown from module on pass $pass");
+        like($err, qr/\Q$dir\E\/broken\.js:2/, "error points to module file and line on pass $pass");
+    }
+
+    my $plain = $CLASS->new({ module_paths => [ $dir ], gather_stats => 1 });
+    is($plain->eval('require("square")(3)'), -9, "module works without the cache");
+    ok(!exists $plain->get_stats()->{module_cache}, "no cache stats without the cache");
+}
+
+sub test_disk_cache {
+    my $dir = tempdir(CLEANUP => 1);
+    my $cache_dir = tempdir(CLEANUP => 1);
+    write_file("$dir/cube.js", "module.exports = function(x) { return x * x * x; };");
+    write_file("$dir/twice.js", "module.exports = function(x) { return 2 * x; };");
+
+    my %opt = (module_paths => [ $dir ], module_cache_dir => $cache_dir, gather_stats => 1);
+
+    # populate the disk cache from other processes, so we do not have the
+    # modules in our memory cache
+    for my $module (qw(cube twice)) {
+        my $status = run_in_child(sub {
+            my $vm = $CLASS->new(\%opt);
+            exit($vm->eval("require('$module')(3)") > 0 ? 0 : 1);
+        });
+        is($status, 0, "child process loaded module $module");
+    }
+    my @files = glob("$cache_dir/*.jsbc");
+    is(scalar @files, 2, "bytecode files written to cache directory");
+    is_deeply([ glob("$cache_dir/*.tmp") ], [], "no temporary files left behind");
+
+    my $vm = $CLASS->new(\%opt);
+    is($vm->eval('require("cube")(3)'), 27, "module works from the disk cache");
+    is_deeply(cache_stats($vm), { hits => 0, disk_hits => 1, bundle_hits => 0, shared_hits => 0, misses => 0 }, "bytecode read from the disk cache");
+
+    # corrupt the cache files; cube is already in memory, twice must be
+    # compiled again
+    my $junk = "PLDUKBC1 this is not bytecode";
+    write_file($_, $junk) for @files;
+    my $other = $CLASS->new(\%opt);
+    is($other->eval('require("twice")(3)'), 6, "module works with a corrupted cache file");
+    is_deeply(cache_stats($other), { hits => 0, disk_hits => 0, bundle_hits => 0, shared_hits => 0, misses => 1 }, "corrupted cache file ignored");
+    is(scalar(grep { -s $_ > length($junk) } glob("$cache_dir/*.jsbc")), 1, "corrupted cache file rewritten");
+}
+
+sub test_shared_modules {
+    my $prefix = "shared_$$";
+    my %sources = (
+        "$prefix/util" => "module.exports = { twice: function(x) { return 2 * x; } };",
+        "$prefix/main" => "var util = require('$prefix/util'); exports.value = util.twice(21); exports.loaded = module.loaded;",
+    );
+    my @loaded;
+    my $create = sub {
+        my (%opt) = @_;
+        my $vm = $CLASS->new({ gather_stats => 1, %opt });
+        $vm->set('perl_module_resolve', sub { return $_[0] });
+        $vm->set('perl_module_load', sub { push @loaded, $_[0]; return $sources{$_[0]} });
+        return $vm;
+    };
+
+    my $first = $create->(share_modules => 1);
+    is($first->eval("require('$prefix/main').value"), 42, "shared module works the first time");
+    is_deeply([ sort @loaded ], [ sort keys %sources ], "loader called the first time");
+    is($first->get_stats()->{module_cache}{misses}, 2, "modules compiled the first time");
+
+    @loaded = ();
+    $sources{"$prefix/util"} = "module.exports = { twice: function(x) { return 0; } };";
+    my $second = $create->(share_modules => 1);
+    is($second->eval("require('$prefix/main').value"), 42, "shared module works from the cache");
+    is($second->eval("require('$prefix/main').loaded"), 0, "module not flagged as loaded while running");
+    is($second->eval("require.cache['$prefix/main'].loaded"), 1, "module flagged as loaded after running");
+    is_deeply(\@loaded, [], "loader not called for shared modules");
+    is_deeply($second->get_stats()->{module_cache}, { hits => 0, disk_hits => 0, bundle_hits => 0, shared_hits => 2, misses => 0 }, "shared modules counted");
+
+    my $unshared = $create->(module_cache => 1);
+    is($unshared->eval("require('$prefix/main').value"), 0, "without share_modules the loader is called");
+    is_deeply([ sort @loaded ], [ sort keys %sources ], "loader called without share_modules");
+
+    @loaded = ();
+    $CLASS->clear_module_cache();
+    my $third = $create->(share_modules => 1);
+    is($third->eval("require('$prefix/main').value"), 0, "cleared cache picks up the new source");
+    is_deeply([ sort @loaded ], [ sort keys %sources ], "loader called after clearing the cache");
+}
+
+sub main {
+    use_ok($CLASS);
+
+    test_memory_cache();
+    test_disk_cache();
+    test_shared_modules();
+    done_testing;
+    return 0;
+}
+
+exit main();
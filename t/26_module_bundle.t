@@ -0,0 +1,97 @@
+use strict;
+use warnings;
+
+use Data::Dumper;
+use File::Path qw(make_path);
+use File::Temp qw(tempdir);
+use Test::More;
+
+my $CLASS = 'JavaScript::Duktape::XS';
+my $TOOL = 'bin/js_bundle.pl';
+
+sub write_file {
+    my ($dir, $name, $contents) = @_;
+    my $path = "$dir/$name";
+    (my $parent = $path) =~ s{/[^/]+\z}{};
+    make_path($parent);
+    open my $fh, '>', $path or die "Could not write $path: $!";
+    print $fh $contents;
+    close $fh;
+    return $path;
+}
+
+sub create_tree {
+    my $root = tempdir(CLEANUP => 1);
+    write_file($root, 'main.js', "var add = require('./lib/add'); module.exports = add(require('config').base, 2);");
+    write_file($root, 'lib/add.js', "module.exports = function(a, b) { return a + b; };");
+    write_file($root, 'lib/fail.js', "module.exports = 1;\nthrow new Error('failing module');");
+    write_file($root, 'config.json', '{ "base": 40 }');
+    write_file($root, 'widgets/index.js', "module.exports = 'widgets ' + require('../lib/add')(1, 1);");
+    return $root;
+}
+
+sub build_bundle {
+    my ($root, @args) = @_;
+    my $output = "$root/modules.bundle";
+    my $rc = system($^X, (map { "-I$_" } @INC), $TOOL, @args, '--output', $output, $root);
+    is($rc, 0, "built bundle with @args");
+    return $output;
+}
+
+sub test_bundle {
+    my ($bytecode) = @_;
+    my $root = create_tree();
+    my $bundle = build_bundle($root, $bytecode ? ('--bytecode') : ());
+    my $label = $bytecode ? 'with bytecode' : 'source only';
+
+    # make sure we are not reading the files
+    unlink "$root/main.js" or die "Could not remove main.js: $!";
+
+    my $vm = $CLASS->new({ module_bundle => $bundle, gather_stats => 1 });
+    ok($vm, "created $CLASS object with module_bundle, $label");
+    is($vm->eval('require("main")'), 42, "module, relative module and JSON loaded from bundle, $label");
+    is($vm->eval('require("./widgets")'), 'widgets 2', "directory index loaded from bundle, $label");
+    is($vm->eval('require("main.js") === require("main")'), 1, "same module for equivalent ids, $label");
+
+    my $err = $vm->eval('var e = ""; try { require("lib/fail"); } catch (x) { e = String(x.stack); } e');
+    like($err, qr/failing module/, "error thrown from bundled module, $label");
+    like($err, qr/lib\/fail\.js:2/, "error points to module id and line, $label");
+
+    $err = $vm->eval('var e = ""; try { require("missing"); } catch (x) { e = String(x); } e');
+    like($err, qr/missing/, "missing module reported, $label");
+
+    my $stats = $vm->get_stats()->{module_cache};
+    is($stats->{bundle_hits}, $bytecode ? 5 : 0, "precompiled code used, $label");
+}
+
+sub test_fallback {
+    my $root = create_tree();
+    my $bundle = build_bundle($root);
+    my $extra = tempdir(CLEANUP => 1);
+    write_file($extra, 'extra.js', "module.exports = 'extra';");
+
+    my $vm = $CLASS->new({ module_bundle => $bundle, module_paths => [ $extra ] });
+    is($vm->eval('require("main")'), 42, "module loaded from bundle");
+    is($vm->eval('require("extra")'), 'extra', "module not in bundle loaded from module_paths");
+}
+
+sub test_invalid_bundle {
+    my $root = tempdir(CLEANUP => 1);
+    my $path = write_file($root, 'bad.bundle', "this is not a bundle");
+    ok(!eval { $CLASS->new({ module_bundle => $path }); 1 }, "invalid bundle rejected");
+    like($@, qr/Could not open module bundle/, "invalid bundle error message");
+    ok(!eval { $CLASS->new({ module_bundle => "$root/missing.bundle" }); 1 }, "missing bundle rejected");
+}
+
+sub main {
+    use_ok($CLASS);
+
+    test_bundle(0);
+    test_bundle(1);
+    test_fallback();
+    test_invalid_bundle();
+    done_testing;
+    return 0;
+}
+
+exit main();
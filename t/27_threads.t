@@ -0,0 +1,107 @@
+use strict;
+use warnings;
+
+use Config;
+use Data::Dumper;
+use Test::More;
+
+BEGIN {
+    if (!$Config{useithreads}) {
+        plan skip_all => 'Perl not built with ithreads';
+    }
+}
+
+use threads;
+
+my $CLASS = 'JavaScript::Duktape::XS';
+
+use constant THREADS    => 8;
+use constant ITERATIONS => 20;
+
+# run a bit of everything in a VM, returning a summary of what happened
+sub exercise_vm {
+    my ($tid, $iteration) = @_;
+    my $vm = $CLASS->new({ save_messages => 1, gather_stats => 1 });
+    my $base = $tid * 1000 + $iteration;
+
+    my @callbacks;
+    $vm->set('perl_cb', sub { push @callbacks, $_[0]; return $_[0] * 2 });
+    $vm->set('data', { base => $base, list => [ 1 .. 10 ] });
+
+    my $sum = $vm->eval(q{
+        var total = 0;
+        for (var j = 0; j < data.list.length; ++j) {
+            total += perl_cb(data.list[j]);
+        }
+        total + data.base;
+    });
+
+    # timers and jobs live in each heap; interleave them with other VMs
+    $vm->eval(qq{
+        var order = [];
+        setTimeout(function() { order.push('t2'); }, 10);
+        setTimeout(function() { order.push('t1'); Promise.resolve().then(function() { order.push('job'); }); }, 1);
+        var handle = setInterval(function() { order.push('i'); clearInterval(handle); }, 5);
+        console.log('thread $tid iteration $iteration');
+    });
+    $vm->dispatch_function_in_event_loop('Object');
+    my $order = $vm->eval('order.join(",")');
+
+    my $msgs = $vm->get_msgs();
+    return {
+        sum => $sum,
+        callbacks => scalar @callbacks,
+        order => $order,
+        message => $msgs->{stdout}[0],
+    };
+}
+
+sub test_parallel_vms {
+    my @threads = map {
+        my $tid = $_;
+        threads->create({ context => 'list' }, sub {
+            my @results;
+            foreach my $iteration (1 .. ITERATIONS) {
+                push @results, exercise_vm($tid, $iteration);
+            }
+            return @results;
+        });
+    } 1 .. THREADS;
+
+    foreach my $tid (1 .. THREADS) {
+        my @results = $threads[$tid - 1]->join();
+        is(scalar @results, ITERATIONS, "thread $tid ran all iterations");
+        my @bad;
+        foreach my $iteration (1 .. ITERATIONS) {
+            my $result = $results[$iteration - 1];
+            my $expected = {
+                sum => 110 + $tid * 1000 + $iteration,
+                callbacks => 10,
+                order => 't1,job,i,t2',
+                message => "thread $tid iteration $iteration\n",
+            };
+            push @bad, Dumper($result) unless eq_hash($result, $expected);
+        }
+        ok(!@bad, "thread $tid got the right results") or diag(@bad);
+    }
+}
+
+sub test_object_not_cloned {
+    my $vm = $CLASS->new();
+    $vm->set('value', 42);
+
+    my $thr = threads->create(sub { return (ref $vm) . ' ' . (defined $$vm ? 'defined' : 'undef') });
+    is($thr->join(), 'SCALAR undef', "object is not cloned into a new thread");
+    is($vm->get('value'), 42, "object still works in its own thread");
+}
+
+sub main {
+    use_ok($CLASS);
+
+    test_parallel_vms();
+    test_object_not_cloned();
+    done_testing;
+    return 0;
+}
+
+exit main();
@@ -0,0 +1,237 @@
+use strict;
+use warnings;
+
+use Data::Dumper;
+use IO::Select;
+use Test::More;
+
+my $CLASS = 'JavaScript::Duktape::XS';
+my $WORKERS = "${CLASS}::Workers";
+
+# collect results until nothing is pending, keyed by id
+sub collect_all {
+    my ($workers) = @_;
+    my %results;
+    while ($workers->pending()) {
+        foreach my $result ($workers->wait_results()) {
+            $results{$result->{id}} = $result;
+        }
+    }
+    return \%results;
+}
+
+# post a single message and collect its result
+sub collect_all_after_post {
+    my ($workers, $message) = @_;
+    $workers->post($message);
+    return collect_all($workers);
+}
+
+sub test_messages {
+    my $workers = $WORKERS->new({
+        threads => 4,
+        source  => q{
+            var calls = 0;
+            function onmessage(msg) {
+                ++calls;
+                return { sum: msg.a + msg.b, name: msg.name, calls: calls };
+            }
+        },
+    });
+
+    my %expected;
+    foreach my $j (1 .. 50) {
+        my $id = $workers->post({ a => $j, b => 2 * $j, name => "job $j" });
+        $expected{$id} = { sum => 3 * $j, name => "job $j" };
+    }
+    is($workers->pending(), 50, "all messages pending");
+
+    my $results = collect_all($workers);
+    is(scalar keys %$results, 50, "got a result for every message");
+    my $ok = 1;
+    foreach my $id (keys %expected) {
+        my $result = $results->{$id}{result};
+        $ok = 0 unless $result && $result->{sum} == $expected{$id}{sum} && $result->{name} eq $expected{$id}{name};
+    }
+    ok($ok, "results match their messages") or diag(Dumper($results));
+    is($workers->pending(), 0, "nothing pending after collecting");
+    is_deeply([ $workers->poll() ], [], "nothing to poll after collecting");
+}
+
+sub test_errors {
+    my $workers = $WORKERS->new({
+        threads => 2,
+        handler => 'work',
+        source  => q{
+            function work(n) {
+                if (n < 0) throw new RangeError('negative: ' + n);
+                return n === 0 ? undefined : Math.sqrt(n);
+            }
+        },
+    });
+
+    my $good = $workers->post(16);
+    my $bad = $workers->post(-1);
+    my $empty = $workers->post(0);
+    my $results = collect_all($workers);
+    is($results->{$good}{result}, 4, "handler named by the handler option is called");
+    like($results->{$bad}{error}, qr/RangeError: negative: -1/, "errors thrown by the handler are returned");
+    ok(!defined $results->{$bad}{result}, "failed job has no result");
+    ok(exists $results->{$empty}{result} && !defined $results->{$empty}{result}, "undefined comes back as undef");
+
+    my $broken = $WORKERS->new({ threads => 2, source => 'this is not javascript' });
+    my $id = $broken->post(1);
+    $results = collect_all($broken);
+    like($results->{$id}{error}, qr/SyntaxError/, "errors in the source fail every job");
+
+    eval { $WORKERS->new({ threads => 1 }) };
+    like($@, qr/source/, "source is required");
+    eval { $WORKERS->new({ source => '', bogus => 1 }) };
+    like($@, qr/Unknown worker option/, "unknown options are rejected");
+}
+
+sub test_timeout {
+    my $workers = $WORKERS->new({
+        threads        => 1,
+        max_timeout_us => 500_000,
+        source         => q{
+            function onmessage(msg) {
+                if (msg.spin) for (;;) {}
+                return 'done';
+            }
+        },
+    });
+
+    my $spin = $workers->post({ spin => 1 });
+    my $next = $workers->post({ spin => 0 });
+    my $results = collect_all($workers);
+    like($results->{$spin}{error}, qr/RangeError/, "runaway job is stopped by max_timeout_us");
+    is($results->{$next}{result}, 'done', "worker keeps going after a timeout");
+}
+
+sub test_fd {
+    my $workers = $WORKERS->new({
+        threads => 2,
+        source  => 'function onmessage(msg) { return msg * 2; }',
+    });
+
+    my $fd = $workers->fd();
+    ok($fd > 2, "got a file descriptor");
+    my $select = IO::Select->new($fd);
+
+    $workers->post($_) for 1 .. 10;
+    my @results;
+    while (@results < 10) {
+        my @ready = $select->can_read(10);
+        last unless @ready;
+        push @results, $workers->poll();
+    }
+    is_deeply([ sort { $a <=> $b } map { $_->{result} } @results ], [ map { $_ * 2 } 1 .. 10 ],
+              "results collected by polling when the fd is readable");
+
+    my @none = $workers->wait_results(1000);
+    is_deeply(\@none, [], "waiting with a timeout and nothing pending returns nothing");
+}
+
+sub test_parallel {
+    my $workers = $WORKERS->new({
+        threads => 4,
+        source  => q{
+            function onmessage(n) {
+                var x = 0;
+                for (var j = 0; j < n; ++j) x = (x * 31 + j) % 1000003;
+                return x;
+            }
+        },
+    });
+
+    # just check that we can keep all the workers busy and get everything back
+    my %ids = map { $workers->post(200_000) => 1 } 1 .. 16;
+    my $results = collect_all($workers);
+    is_deeply([ sort keys %$results ], [ sort keys %ids ], "got all results from busy workers");
+    my %values = map { $_->{result} => 1 } values %$results;
+    is(scalar keys %values, 1, "all workers computed the same value");
+
+    # dropping a pool with jobs still queued must not hang
+    $workers->post(200_000) for 1 .. 16;
+    undef $workers;
+    pass("pool with queued jobs destroyed");
+}
+
+sub test_fork {
+    my $workers = $WORKERS->new({
+        threads => 2,
+        source  => 'function onmessage(msg) { return msg + 1; }',
+    });
+    is_deeply([ map { $_->{result} } values %{ collect_all_after_post($workers, 1) } ], [ 2 ], "pool works before forking");
+
+    # the child exits normally, so it destroys its copy of the pool
+    my $pid = fork();
+    die "Could not fork: $!" unless defined $pid;
+    if (!$pid) {
+        my $ok = !eval { $workers->post(1); 1 } && $@ =~ m/forked process/;
+        $ok &&= !eval { $workers->wait_results(); 1 } && $@ =~ m/forked process/;
+        $ok &&= !eval { $workers->pending(); 1 } && $@ =~ m/forked process/;
+        exit($ok ? 0 : 1);
+    }
+
+    my $status;
+    eval {
+        local $SIG{ALRM} = sub { die "timeout\n" };
+        alarm 20;
+        waitpid($pid, 0);
+        $status = $? >> 8;
+        alarm 0;
+    };
+    if ($@) {
+        kill 'KILL', $pid;
+        waitpid($pid, 0);
+    }
+    is($status, 0, "child could not use the pool, and exited without hanging");
+
+    is_deeply([ map { $_->{result} } values %{ collect_all_after_post($workers, 41) } ], [ 42 ], "pool still works in the parent");
+}
+
+sub test_parallel_map {
+    my $vm = $CLASS->new();
+    my @items = map { { n => $_, name => "item $_" } } 1 .. 1000;
+
+    my $mapped = $vm->parallel_map('function(item) { return item.name + ": " + item.n * item.n; }',
+                                   \@items, { threads => 4 });
+    is_deeply($mapped, [ map { "item $_: " . $_ * $_ } 1 .. 1000 ], "results come back in order");
+
+    foreach my $chunk_size (1, 7, 1000, 5000) {
+        my $doubled = $vm->parallel_map('function(n) { return n * 2; }', [ 1 .. 100 ],
+                                        { threads => 3, chunk_size => $chunk_size });
+        is_deeply($doubled, [ map { $_ * 2 } 1 .. 100 ], "results in order with chunk_size $chunk_size");
+    }
+
+    is_deeply($vm->parallel_map('function(n) { return n; }', []), [], "empty list maps to empty list");
+    is_deeply($vm->parallel_map('function(n) { return n === 2 ? undefined : [n]; }', [ 1, 2, undef ]),
+              [ [1], undef, [undef] ], "undefined and null come back as undef");
+
+    eval { $vm->parallel_map('function(n) { if (n == 50) throw new Error("bad item " + n); return n; }', [ 1 .. 100 ]) };
+    like($@, qr/bad item 50/, "errors from the function are reported");
+    eval { $vm->parallel_map('42', [ 1 ]) };
+    like($@, qr/needs a function/, "source must be a function");
+    eval { $vm->parallel_map('function(n) { return n; }', [ 1 ], { bogus => 1 }) };
+    like($@, qr/Unknown parallel_map option/, "unknown options are rejected");
+
+    is($vm->eval('typeof __pl_map_func'), 'undefined', "the VM itself is not touched");
+}
+
+sub main {
+    use_ok($CLASS);
+
+    test_messages();
+    test_errors();
+    test_timeout();
+    test_fd();
+    test_parallel();
+    test_fork();
+    test_parallel_map();
+    done_testing;
+    return 0;
+}
+
+exit main();